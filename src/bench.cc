@@ -0,0 +1,607 @@
+// Benchmarks for the native geometry code.
+//
+// Usage: bench [--mesh file.stl] [group...]
+//
+// Runs the given groups of benchmarks (e.g. mesh_tree), or all of them. The mesh defaults to
+// things/left.stl so run it from the root of the repository.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <glm/glm.hpp>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "evaluator.h"
+#include "import.h"
+#include "key.h"
+#include "mesh.h"
+#include "mesh_decimate.h"
+#include "mesh_repair.h"
+#include "mesh_tree.h"
+#include "polygon.h"
+#include "predicates.h"
+#include "scad.h"
+#include "sdf.h"
+#include "thread_pool.h"
+#include "transform.h"
+
+using namespace scad;
+
+namespace {
+
+struct Options {
+  std::string mesh_file = "things/left.stl";
+  std::vector<std::string> groups;
+};
+
+bool Selected(const Options& options, const std::string& group) {
+  return options.groups.empty() ||
+         std::find(options.groups.begin(), options.groups.end(), group) != options.groups.end();
+}
+
+// Runs f until at least a quarter of a second has passed and prints the time per run. items is
+// the number of operations one run does, e.g. queries, and is used to print the time per item.
+void Time(const std::string& name, size_t items, const std::function<void()>& f) {
+  using Clock = std::chrono::steady_clock;
+  f();
+  int runs = 0;
+  Clock::time_point start = Clock::now();
+  double seconds = 0;
+  do {
+    f();
+    ++runs;
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (seconds < 0.25);
+  double per_run = seconds / runs;
+  printf("%-36s %12.3f ms %12.1f ns/item\n", name.c_str(), per_run * 1e3, per_run * 1e9 / items);
+}
+
+glm::dvec3 RandomPoint(std::mt19937* random, const Aabb& box) {
+  std::uniform_real_distribution<double> unit(0, 1);
+  glm::dvec3 t(unit(*random), unit(*random), unit(*random));
+  return box.min + (box.max - box.min) * t;
+}
+
+// Distance from p to the mesh by asking each triangle on its own.
+double ReferenceDistance(const Mesh& mesh, const glm::dvec3& p) {
+  double best = std::numeric_limits<double>::infinity();
+  for (const auto& t : mesh.triangles) {
+    Mesh triangle;
+    triangle.vertices = {mesh.vertices[t[0]], mesh.vertices[t[1]], mesh.vertices[t[2]]};
+    triangle.triangles = {{0, 1, 2}};
+    MeshTree tree(triangle);
+    MeshTree::Hit hit;
+    if (tree.ClosestPoint(p, &hit)) {
+      best = std::min(best, hit.distance);
+    }
+  }
+  return best;
+}
+
+void BenchMeshTree(const Options& options) {
+  Mesh mesh;
+  if (!ImportMesh(options.mesh_file, &mesh)) {
+    fprintf(stderr, "Skipping mesh_tree, could not read %s\n", options.mesh_file.c_str());
+    return;
+  }
+  printf("%s: %zu triangles\n", options.mesh_file.c_str(), mesh.triangles.size());
+  Aabb bounds = mesh.Bounds();
+  glm::dvec3 size = bounds.size();
+
+  Time("mesh_tree/build", mesh.triangles.size(), [&] { MeshTree tree(mesh); });
+  MeshTree tree(mesh);
+
+  std::mt19937 random(1);
+  const int kQueries = 10000;
+  std::vector<glm::dvec3> points;
+  for (int i = 0; i < kQueries; ++i) {
+    points.push_back(RandomPoint(&random, bounds));
+  }
+
+  std::vector<uint32_t> found;
+  Time("mesh_tree/query_box", kQueries, [&] {
+    for (const glm::dvec3& p : points) {
+      found.clear();
+      tree.Query(Aabb(p - size * 0.01, p + size * 0.01), &found);
+    }
+  });
+
+  double total = 0;
+  Time("mesh_tree/closest_point", kQueries, [&] {
+    total = 0;
+    for (const glm::dvec3& p : points) {
+      MeshTree::Hit hit;
+      tree.ClosestPoint(p, &hit);
+      total += hit.distance;
+    }
+  });
+
+  // Rays from random points towards random points, the way a wall thickness check would shoot
+  // them along the inward normals.
+  std::vector<glm::dvec3> directions;
+  for (int i = 0; i < kQueries; ++i) {
+    directions.push_back(RandomPoint(&random, bounds) - points[i]);
+  }
+  int hits = 0;
+  Time("mesh_tree/raycast", kQueries, [&] {
+    hits = 0;
+    for (int i = 0; i < kQueries; ++i) {
+      MeshTree::Hit hit;
+      hits += tree.Raycast(points[i], directions[i], &hit);
+    }
+  });
+  printf("  %d of %d rays hit\n", hits, kQueries);
+
+  // Overlap of the mesh with a copy of itself moved by a tenth of its size, e.g. the two halves
+  // of a model or a part and its clearance envelope.
+  Mesh moved = mesh;
+  for (glm::dvec3& v : moved.vertices) {
+    v += size * 0.1;
+  }
+  MeshTree moved_tree(moved);
+  std::vector<std::pair<uint32_t, uint32_t>> pairs;
+  Time("mesh_tree/query_pairs", mesh.triangles.size(), [&] {
+    pairs.clear();
+    tree.QueryPairs(moved_tree, &pairs);
+  });
+  printf("  %zu candidate pairs\n", pairs.size());
+  bool intersects = false;
+  Time("mesh_tree/intersects", mesh.triangles.size(), [&] {
+    intersects = tree.Intersects(moved_tree);
+  });
+  printf("  intersects: %s\n", intersects ? "yes" : "no");
+
+  // Checks the closest points against asking every triangle.
+  const int kChecked = 20;
+  int mismatches = 0;
+  for (int i = 0; i < kChecked; ++i) {
+    MeshTree::Hit hit;
+    tree.ClosestPoint(points[i], &hit);
+    if (std::abs(hit.distance - ReferenceDistance(mesh, points[i])) > 1e-9) {
+      ++mismatches;
+    }
+  }
+  printf("  %d of %d closest points differ from the reference\n", mismatches, kChecked);
+}
+
+void BenchPredicates(const Options& options) {
+  Mesh mesh;
+  if (!ImportMesh(options.mesh_file, &mesh)) {
+    fprintf(stderr, "Skipping predicates, could not read %s\n", options.mesh_file.c_str());
+    return;
+  }
+  // Each triangle against a corner of the next one. Neighbors in an stl are mostly in the same
+  // face so this is full of exactly coplanar points, like the hulls of the case are.
+  std::vector<std::array<glm::dvec3, 4>> model;
+  for (size_t i = 0; i + 1 < mesh.triangles.size(); ++i) {
+    const auto& t = mesh.triangles[i];
+    const auto& next = mesh.triangles[i + 1];
+    model.push_back({mesh.vertices[t[0]],
+                     mesh.vertices[t[1]],
+                     mesh.vertices[t[2]],
+                     mesh.vertices[next[(i / 2) % 3]]});
+  }
+  std::mt19937 random(1);
+  Aabb bounds = mesh.Bounds();
+  std::vector<std::array<glm::dvec3, 4>> uniform;
+  for (size_t i = 0; i < model.size(); ++i) {
+    uniform.push_back({RandomPoint(&random, bounds),
+                       RandomPoint(&random, bounds),
+                       RandomPoint(&random, bounds),
+                       RandomPoint(&random, bounds)});
+  }
+
+  for (const auto& [name, points] : {std::make_pair("uniform", &uniform),
+                                     std::make_pair("model", &model)}) {
+    double sum = 0;
+    Time(std::string("predicates/naive_orient3d_") + name, points->size(), [&] {
+      for (const auto& p : *points) {
+        glm::dvec3 ad = p[0] - p[3];
+        glm::dvec3 bd = p[1] - p[3];
+        glm::dvec3 cd = p[2] - p[3];
+        sum += glm::dot(ad, glm::cross(bd, cd));
+      }
+    });
+    ResetExactPredicateCounts();
+    int runs = 0;
+    Time(std::string("predicates/orient3d_") + name, points->size(), [&] {
+      ++runs;
+      for (const auto& p : *points) {
+        sum += Orient3d(p[0], p[1], p[2], p[3]);
+      }
+    });
+    double exact = ExactPredicateCounts().orient3d;
+    printf("  %.2f%% exact\n", exact * 100 / (static_cast<double>(runs) * points->size()));
+
+    ResetExactPredicateCounts();
+    runs = 0;
+    Time(std::string("predicates/orient2d_") + name, points->size(), [&] {
+      ++runs;
+      for (const auto& p : *points) {
+        sum += Orient2d(glm::dvec2(p[0]), glm::dvec2(p[1]), glm::dvec2(p[3]));
+      }
+    });
+    exact = ExactPredicateCounts().orient2d;
+    printf("  %.2f%% exact\n", exact * 100 / (static_cast<double>(runs) * points->size()));
+
+    ResetExactPredicateCounts();
+    runs = 0;
+    Time(std::string("predicates/incircle_") + name, points->size(), [&] {
+      ++runs;
+      for (const auto& p : *points) {
+        sum += InCircle(glm::dvec2(p[0]), glm::dvec2(p[1]), glm::dvec2(p[2]), glm::dvec2(p[3]));
+      }
+    });
+    exact = ExactPredicateCounts().incircle;
+    printf("  %.2f%% exact\n", exact * 100 / (static_cast<double>(runs) * points->size()));
+    if (sum == 1234.5) {
+      // Keeps the sums alive.
+      printf("\n");
+    }
+  }
+}
+
+size_t CountPoints(const Paths& paths) {
+  size_t count = 0;
+  for (const Path& path : paths) {
+    count += path.size();
+  }
+  return count;
+}
+
+double Area(const Paths& paths) {
+  double area = 0;
+  for (const Path& path : paths) {
+    area += SignedArea(path);
+  }
+  return area;
+}
+
+// The outline of the mesh seen from above, the footprint the bottom plate is built from.
+void BenchPolygon(const Options& options) {
+  Mesh mesh;
+  if (!ImportMesh(options.mesh_file, &mesh)) {
+    fprintf(stderr, "Skipping polygon, could not read %s\n", options.mesh_file.c_str());
+    return;
+  }
+  std::vector<Paths> triangles;
+  for (const auto& t : mesh.triangles) {
+    Path path = {glm::dvec2(mesh.vertices[t[0]]),
+                 glm::dvec2(mesh.vertices[t[1]]),
+                 glm::dvec2(mesh.vertices[t[2]])};
+    double area = SignedArea(path);
+    if (area < 0) {
+      std::reverse(path.begin(), path.end());
+    }
+    if (area != 0) {
+      triangles.push_back({std::move(path)});
+    }
+  }
+  Paths outline;
+  Time("polygon/union_projected", triangles.size(), [&] { 
+    outline = PolygonBoolean(PolygonOp::kUnion, triangles);
+  });
+  printf("  %zu triangles to %zu paths, %zu points, area %.1f\n",
+         triangles.size(),
+         outline.size(),
+         CountPoints(outline),
+         Area(outline));
+
+  struct Offset {
+    const char* name;
+    double delta;
+    JoinType join;
+  };
+  for (const Offset& offset : {Offset{"offset_round", 2, JoinType::kRound},
+                               Offset{"offset_round_inwards", -2, JoinType::kRound},
+                               Offset{"offset_miter", 2, JoinType::kMiter},
+                               Offset{"offset_chamfer", 2, JoinType::kSquare}}) {
+    Paths result;
+    Time(std::string("polygon/") + offset.name, CountPoints(outline), [&] {
+      result = OffsetPolygons(outline, offset.delta, offset.join, 16);
+    });
+    printf("  %zu paths, %zu points, area %.1f\n", result.size(), CountPoints(result), Area(result));
+  }
+
+  std::vector<glm::dvec2> vertices;
+  std::vector<std::array<uint32_t, 3>> triangulation;
+  Time("polygon/triangulate", CountPoints(outline), [&] {
+    vertices.clear();
+    triangulation.clear();
+    TriangulatePolygons(outline, &vertices, &triangulation);
+  });
+  double area = 0;
+  for (const auto& t : triangulation) {
+    area += SignedArea({vertices[t[0]], vertices[t[1]], vertices[t[2]]});
+  }
+  printf("  %zu triangles, area %.1f\n", triangulation.size(), area);
+}
+
+double Volume(const Mesh& mesh) {
+  double volume = 0;
+  for (const auto& t : mesh.triangles) {
+    volume += glm::dot(mesh.vertices[t[0]], glm::cross(mesh.vertices[t[1]], mesh.vertices[t[2]]));
+  }
+  return volume / 6;
+}
+
+// Hollows the whole mesh to the 2 mm walls of the case, what Shape::Shell does for imports.
+void BenchShell(const Options& options) {
+  Mesh mesh;
+  if (!ImportMesh(options.mesh_file, &mesh)) {
+    fprintf(stderr, "Skipping shell, could not read %s\n", options.mesh_file.c_str());
+    return;
+  }
+  printf("%s: %zu triangles, volume %.1f\n",
+         options.mesh_file.c_str(),
+         mesh.triangles.size(),
+         Volume(mesh));
+  ThreadPool pool;
+  for (double cell_size : {1.0, 0.5}) {
+    Mesh shell;
+    Time("shell/" + std::to_string(cell_size).substr(0, 3) + "mm_cells", 1, [&] {
+      SdfProgram program;
+      program.CompileShell({}, {mesh}, 2, 4 * cell_size, &pool);
+      shell = MeshSdf(program, mesh.Bounds(), cell_size, &pool);
+    });
+    printf("  %zu triangles, volume %.1f\n", shell.triangles.size(), Volume(shell));
+  }
+}
+
+// A wall segment with rounded edges, the hull of spheres at the corners of a slanted box, built
+// as a hull of sphere primitives and as a rounded hull.
+void BenchRoundedHull() {
+  std::vector<Point3d> corners;
+  for (int i = 0; i < 8; ++i) {
+    corners.push_back({i & 1 ? 20.0 : 0.0, i & 2 ? 4.0 : 0.0, i & 4 ? 12.0 + (i & 1) * 3 : 0.0});
+  }
+  for (double fn : {30.0, 64.0}) {
+    std::vector<Shape> spheres;
+    for (const Point3d& p : corners) {
+      spheres.push_back(Sphere(1.5, fn).Translate(p.x, p.y, p.z));
+    }
+    std::string suffix = "_fn" + std::to_string(static_cast<int>(fn));
+    Shape rounded = RoundedHull(corners, 1.5, fn);
+    for (const auto& [name, shape] : {std::make_pair("hull_of_spheres", HullAll(spheres)),
+                                      std::make_pair("rounded_hull", rounded)}) {
+      Mesh mesh;
+      Time(std::string("rounded_hull/") + name + suffix, 1, [&] {
+        // A new evaluator each time so nothing is cached.
+        Evaluator evaluator(nullptr);
+        evaluator.EvaluateMesh(shape, &mesh);
+      });
+      printf("  %zu triangles, volume %.3f\n", mesh.triangles.size(), Volume(mesh));
+    }
+  }
+}
+
+void PrintMeshStats(const char* label, const MeshStats& stats) {
+  printf("  %s: %zu vertices, %zu triangles, %zu boundary, %zu non manifold, %zu misoriented "
+         "edges, %zu degenerate, %zu sliver triangles\n",
+         label,
+         stats.vertices,
+         stats.triangles,
+         stats.boundary_edges,
+         stats.non_manifold_edges,
+         stats.misoriented_edges,
+         stats.degenerate_triangles,
+         stats.sliver_triangles);
+}
+
+void PrintRepairStats(const MeshRepairStats& stats) {
+  PrintMeshStats("before", stats.before);
+  PrintMeshStats("after", stats.after);
+  printf("  merged %zu vertices, collapsed %zu, removed %zu duplicate, flipped %zu triangles, "
+         "filled %zu holes\n",
+         stats.merged_vertices,
+         stats.collapsed_triangles,
+         stats.duplicate_triangles,
+         stats.flipped_triangles,
+         stats.filled_holes);
+}
+
+// Checks and repairs the mesh as imported, and a copy damaged the way exported stls often are:
+// every triangle with its own corners moved by less than the weld tolerance, some triangles
+// missing and some facing the wrong way.
+void BenchMeshRepair(const Options& options) {
+  Mesh mesh;
+  if (!ImportMesh(options.mesh_file, &mesh)) {
+    fprintf(stderr, "Skipping mesh_repair, could not read %s\n", options.mesh_file.c_str());
+    return;
+  }
+  printf("%s: %zu triangles\n", options.mesh_file.c_str(), mesh.triangles.size());
+  ThreadPool pool;
+  Time("mesh_repair/check", mesh.triangles.size(), [&] { CheckMesh(mesh, 1e-5, &pool); });
+
+  Mesh damaged;
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> jitter(-0.2 * kGeometryEpsilon, 0.2 * kGeometryEpsilon);
+  for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+    if (i % 500 == 7) {
+      continue;
+    }
+    auto t = mesh.triangles[i];
+    if (i % 97 == 3) {
+      std::swap(t[1], t[2]);
+    }
+    uint32_t first = static_cast<uint32_t>(damaged.vertices.size());
+    for (uint32_t v : t) {
+      damaged.vertices.push_back(mesh.vertices[v] +
+                                 glm::dvec3(jitter(random), jitter(random), jitter(random)));
+    }
+    damaged.triangles.push_back({first, first + 1, first + 2});
+  }
+
+  for (const auto& [name, input] :
+       {std::make_pair("imported", &mesh), std::make_pair("damaged", &damaged)}) {
+    MeshRepairStats stats;
+    Mesh repaired;
+    Time(std::string("mesh_repair/repair_") + name, input->triangles.size(), [&] {
+      repaired = RepairMesh(*input, MeshRepairOptions(), &pool, &stats);
+    });
+    PrintRepairStats(stats);
+    printf("  volume %.1f -> %.1f\n", Volume(*input), Volume(repaired));
+  }
+}
+
+// Decimates the mesh to triangle budgets and to error bounds, as for preview meshes, on one
+// thread and on the pool.
+void BenchDecimate(const Options& options) {
+  Mesh mesh;
+  if (!ImportMesh(options.mesh_file, &mesh)) {
+    fprintf(stderr, "Skipping decimate, could not read %s\n", options.mesh_file.c_str());
+    return;
+  }
+  printf("%s: %zu triangles, volume %.1f\n",
+         options.mesh_file.c_str(),
+         mesh.triangles.size(),
+         Volume(mesh));
+  ThreadPool pool;
+  std::vector<std::pair<std::string, DecimateOptions>> cases;
+  for (int percent : {50, 10}) {
+    DecimateOptions budget;
+    budget.max_triangles = mesh.triangles.size() * percent / 100;
+    cases.push_back({std::to_string(percent) + "_percent", budget});
+  }
+  for (double error : {0.01, 0.05}) {
+    DecimateOptions bound;
+    bound.max_error = error;
+    cases.push_back({"error_" + std::to_string(error).substr(0, 4), bound});
+  }
+  for (const auto& [name, decimate_options] : cases) {
+    DecimateStats stats;
+    Mesh decimated;
+    Time("decimate/" + name + "_serial", mesh.triangles.size(), [&] {
+      decimated = DecimateMesh(mesh, decimate_options, nullptr, &stats);
+    });
+    Time("decimate/" + name + "_pool", mesh.triangles.size(), [&] {
+      decimated = DecimateMesh(mesh, decimate_options, &pool, &stats);
+    });
+    MeshStats check = CheckMesh(decimated);
+    printf("  %zu triangles, error %.4f, volume %.1f, %zu boundary and %zu non manifold edges\n",
+           stats.triangles_after,
+           stats.max_error,
+           Volume(decimated),
+           check.boundary_edges,
+           check.non_manifold_edges);
+  }
+}
+
+// Points through a chain of keys like the thumb cluster, each placed relative to the previous one:
+// per transform as before lists cached their matrix, through the cached matrix and through corner
+// queries, which build new lists from the transforms of the keys.
+void BenchTransform() {
+  const int kKeys = 8;
+  std::vector<Key> keys(kKeys);
+  // The transforms of the last key, which come first.
+  std::vector<Transform> transforms;
+  for (int i = 0; i < kKeys; ++i) {
+    keys[i].t() = Transform(19, 0, 0).SetRotation(4, 2, -3 * i);
+    if (i > 0) {
+      keys[i].SetParent(keys[i - 1]);
+    }
+    transforms.insert(transforms.begin(), keys[i].t());
+  }
+  TransformList list = keys.back().GetTransforms();
+
+  const int kPoints = 1000;
+  std::vector<glm::vec3> points;
+  for (int i = 0; i < kPoints; ++i) {
+    points.push_back(glm::vec3(i % 10, i / 10 % 10, i / 100));
+  }
+  glm::vec3 sum(0);
+  Time("transform/per_transform", kPoints, [&] {
+    for (const glm::vec3& p : points) {
+      glm::vec3 q = p;
+      for (const Transform& t : transforms) {
+        q = t.Apply(q);
+      }
+      sum += q;
+    }
+  });
+  Time("transform/cached_matrix", kPoints, [&] {
+    for (const glm::vec3& p : points) {
+      sum += list.Apply(p);
+    }
+  });
+  Time("transform/key_corners", 4, [&] {
+    for (const TransformList& corner : keys.back().GetCorners()) {
+      sum += corner.Apply(kOrigin);
+    }
+  });
+  std::vector<glm::dvec3> double_points(points.begin(), points.end());
+  glm::dvec3 double_sum(0);
+  Time("transform/cached_matrix_double", kPoints, [&] {
+    for (const glm::dvec3& p : double_points) {
+      double_sum += list.Apply(p);
+    }
+  });
+  std::vector<glm::vec3> out(points.size());
+  Time("transform/batch", kPoints, [&] {
+    list.ApplyBatch(points.data(), points.size(), out.data());
+    sum += out.back();
+  });
+  float max_difference = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    glm::vec3 difference = glm::abs(out[i] - list.Apply(points[i]));
+    max_difference = std::max({max_difference, difference.x, difference.y, difference.z});
+  }
+  printf("  batch differs from Apply by at most %g\n", max_difference);
+  double max_double_difference = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    glm::dvec3 difference = glm::abs(glm::dvec3(out[i]) - list.Apply(double_points[i]));
+    max_double_difference =
+        std::max({max_double_difference, difference.x, difference.y, difference.z});
+  }
+  printf("  batch differs from the double path by at most %g\n", max_double_difference);
+  glm::vec3 corner = keys.back().GetTopRight().Apply(kOrigin);
+  printf("  top right corner (%.4f, %.4f, %.4f)\n", corner.x, corner.y, corner.z);
+  // Uses the sums so the loops aren't optimized away.
+  if (std::isnan(sum.x + sum.y + sum.z + double_sum.x + double_sum.y + double_sum.z)) {
+    printf("  nan\n");
+  }
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+      options.mesh_file = argv[++i];
+    } else {
+      options.groups.push_back(argv[i]);
+    }
+  }
+  if (Selected(options, "mesh_tree")) {
+    BenchMeshTree(options);
+  }
+  if (Selected(options, "predicates")) {
+    BenchPredicates(options);
+  }
+  if (Selected(options, "polygon")) {
+    BenchPolygon(options);
+  }
+  if (Selected(options, "shell")) {
+    BenchShell(options);
+  }
+  if (Selected(options, "rounded_hull")) {
+    BenchRoundedHull();
+  }
+  if (Selected(options, "mesh_repair")) {
+    BenchMeshRepair(options);
+  }
+  if (Selected(options, "decimate")) {
+    BenchDecimate(options);
+  }
+  if (Selected(options, "transform")) {
+    BenchTransform();
+  }
+  return 0;
+}
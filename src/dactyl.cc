@@ -1,9 +1,15 @@
+#include <cstdio>
+#include <cstdlib>
 #include <glm/glm.hpp>
 #include <string>
 #include <vector>
 
+#include "disk_cache.h"
+#include "evaluator.h"
 #include "key.h"
 #include "key_data.h"
+#include "mesh_decimate.h"
+#include "mesh_repair.h"
 #include "scad.h"
 #include "transform.h"
 
@@ -12,6 +18,9 @@ using namespace scad;
 constexpr bool kWriteTestKeys = false;
 // Add the caps into the stl for testing.
 constexpr bool kAddCaps = false;
+// Evaluate the case natively and write left.stl and right.stl directly instead of going through
+// openscad.
+constexpr bool kWriteNativeStl = false;
 
 enum class Direction { UP, DOWN, LEFT, RIGHT };
 
@@ -24,6 +33,9 @@ void AddShapes(std::vector<Shape>* shapes, std::vector<Shape> to_add) {
 Shape ConnectMainKeys(KeyData& d);
 
 int main() {
+  // The level of detail of the whole model. Draft skips the caps and the subtraction below and is
+  // much quicker to preview while iterating.
+  ScopedQuality quality(QualityProfile::Final());
   printf("generating..\n");
   TransformList key_origin;
   key_origin.Translate(-20, -40, 3);
@@ -39,7 +51,7 @@ int main() {
       key->add_side_nub = false;
       key->extra_z = 4;
       test_shapes.push_back(key->GetSwitch());
-      if (kAddCaps) {
+      if (kAddCaps && CurrentQuality().decorations) {
         test_shapes.push_back(key->GetCap().Color("red"));
       }
     }
@@ -324,7 +336,7 @@ int main() {
 
       std::vector<Shape> slice;
       slice.push_back(Hull(s1, s2));
-      slice.push_back(Hull(s2, s2.Projection().LinearExtrude(.1).TranslateZ(.05)));
+      slice.push_back(s2.ExtendToFloor());
 
       wall_slices.push_back(slice);
     }
@@ -342,7 +354,7 @@ int main() {
 
   for (Key* key : d.all_keys()) {
     shapes.push_back(key->GetSwitch());
-    if (kAddCaps) {
+    if (kAddCaps && CurrentQuality().decorations) {
       shapes.push_back(key->GetCap().Color("red"));
     }
   }
@@ -352,30 +364,29 @@ int main() {
   {
     double screw_height = 5;
     double screw_radius = 4.4 / 2.0;
-    Shape screw_hole = Cylinder(screw_height + 2, screw_radius, 30);
-    Shape screw_insert =
-        Cylinder(screw_height, screw_radius + 1.65, 30).TranslateZ(screw_height / 2);
+    Shape screw_hole = Cylinder(screw_height + 2, screw_radius);
+    Shape screw_insert = Cylinder(screw_height, screw_radius + 1.65).TranslateZ(screw_height / 2);
 
-    glm::vec3 screw_left_bottom = d.key_shift.GetBottomLeft().Apply(kOrigin);
+    glm::dvec3 screw_left_bottom = d.key_shift.GetBottomLeft().Apply(kDoubleOrigin);
     screw_left_bottom.z = 0;
     screw_left_bottom.x += 3.2;
 
-    glm::vec3 screw_left_top = d.key_plus.GetTopLeft().Apply(kOrigin);
+    glm::dvec3 screw_left_top = d.key_plus.GetTopLeft().Apply(kDoubleOrigin);
     screw_left_top.z = 0;
     screw_left_top.x += 2.8;
     screw_left_top.y += -.5;
 
-    glm::vec3 screw_right_top = d.key_5.GetTopRight().Apply(kOrigin);
+    glm::dvec3 screw_right_top = d.key_5.GetTopRight().Apply(kDoubleOrigin);
     screw_right_top.z = 0;
     screw_right_top.x += 4;
     screw_right_top.y += -15.5;
 
-    glm::vec3 screw_right_bottom = d.key_end.GetBottomLeft().Apply(kOrigin);
+    glm::dvec3 screw_right_bottom = d.key_end.GetBottomLeft().Apply(kDoubleOrigin);
     screw_right_bottom.z = 0;
     screw_right_bottom.y += 3.5;
     screw_right_bottom.x += 1.5;
 
-    glm::vec3 screw_right_mid = d.key_ctrl.GetTopLeft().Apply(kOrigin);
+    glm::dvec3 screw_right_mid = d.key_ctrl.GetTopLeft().Apply(kDoubleOrigin);
     screw_right_mid.z = 0;
     screw_right_mid.y += -.9;
 
@@ -401,16 +412,51 @@ int main() {
 
   // Cut out hole for holder.
   Shape holder_hole = Cube(29.0, 20.0, 12.5).TranslateZ(12 / 2);
-  glm::vec3 holder_location = d.key_4.GetTopLeft().Apply(kOrigin);
+  glm::dvec3 holder_location = d.key_4.GetTopLeft().Apply(kDoubleOrigin);
   holder_location.z = -0.5;
   holder_location.x += 17.5;
   negative_shapes.push_back(holder_hole.Translate(holder_location));
 
+  // With DACTYL_CACHE_DIR set each part of the case is rendered by openscad into a cache which can
+  // be shared between runs and machines. The scad files then import the stls of the parts and
+  // only the changed parts are rendered again.
+  if (const char* cache_directory = std::getenv("DACTYL_CACHE_DIR")) {
+    DiskCache cache(cache_directory);
+    for (Shape& shape : shapes) {
+      shape = RenderCached(shape, &cache);
+    }
+  }
+
   Shape result = UnionAll(shapes);
-  // Subtracting is expensive to preview and is best to disable while testing.
-  result = result.Subtract(UnionAll(negative_shapes));
+  // Subtracting is expensive to preview, draft quality skips it.
+  if (CurrentQuality().subtractions) {
+    result = result.Subtract(UnionAll(negative_shapes));
+  }
   result.WriteToFile("left.scad");
   result.MirrorX().WriteToFile("right.scad");
+  if (kWriteNativeStl) {
+    Evaluator evaluator;
+    Mesh mesh;
+    if (evaluator.EvaluateMesh(result, &mesh)) {
+      MeshRepairStats stats;
+      mesh = RepairMesh(mesh, MeshRepairOptions(), &ThreadPool::Default(), &stats);
+      fprintf(stderr,
+              "Repaired left.stl: merged %zu vertices, collapsed %zu and flipped %zu triangles, "
+              "filled %zu holes, %s\n",
+              stats.merged_vertices,
+              stats.collapsed_triangles,
+              stats.flipped_triangles,
+              stats.filled_holes,
+              stats.after.closed() ? "closed" : "not closed");
+      mesh.WriteStl("left.stl");
+      // A light mesh for quick viewing and diffing in reviews.
+      DecimateOptions preview;
+      preview.max_triangles = mesh.triangles.size() / 4;
+      DecimateMesh(mesh, preview, &ThreadPool::Default()).WriteStl("left_preview.stl");
+      // The right half is mirrored while writing.
+      mesh.WriteStl("right.stl", StlFormat::kBinary, true);
+    }
+  }
 
   // Bottom plate
   {
@@ -0,0 +1,92 @@
+#include "box_tree.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "mesh.h"
+
+namespace scad {
+namespace {
+
+const uint32_t kMaxLeafSize = 4;
+
+}  // namespace
+
+BoxTree::BoxTree(std::vector<Aabb> boxes) : boxes_(std::move(boxes)) {
+  for (uint32_t i = 0; i < boxes_.size(); ++i) {
+    if (!boxes_[i].empty()) {
+      items_.push_back(i);
+    }
+  }
+  if (!items_.empty()) {
+    Build(0, static_cast<uint32_t>(items_.size()));
+  }
+}
+
+void BoxTree::Query(const Aabb& box, std::vector<uint32_t>* out, double epsilon) const {
+  if (nodes_.empty()) {
+    return;
+  }
+  uint32_t stack[64];
+  int size = 0;
+  stack[size++] = 0;
+  while (size > 0) {
+    uint32_t index = stack[--size];
+    const Node& node = nodes_[index];
+    if (!node.box.Overlaps(box, epsilon)) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        if (boxes_[items_[i]].Overlaps(box, epsilon)) {
+          out->push_back(items_[i]);
+        }
+      }
+      continue;
+    }
+    stack[size++] = node.right;
+    stack[size++] = index + 1;
+  }
+}
+
+uint32_t BoxTree::Build(uint32_t first, uint32_t count) {
+  uint32_t index = static_cast<uint32_t>(nodes_.size());
+  nodes_.emplace_back();
+  Aabb box;
+  Aabb centers;
+  for (uint32_t i = first; i < first + count; ++i) {
+    box.Extend(boxes_[items_[i]]);
+    centers.Extend(boxes_[items_[i]].center());
+  }
+  nodes_[index].box = box;
+  if (count <= kMaxLeafSize) {
+    nodes_[index].first = first;
+    nodes_[index].count = count;
+    return index;
+  }
+
+  // Median split along the longest axis keeps the tree balanced so the stack can't overflow.
+  glm::dvec3 extent = centers.size();
+  int axis = 0;
+  if (extent.y > extent[axis]) {
+    axis = 1;
+  }
+  if (extent.z > extent[axis]) {
+    axis = 2;
+  }
+  uint32_t half = count / 2;
+  std::nth_element(items_.begin() + first,
+                   items_.begin() + first + half,
+                   items_.begin() + first + count,
+                   [&](uint32_t a, uint32_t b) {
+                     double ca = boxes_[a].center()[axis];
+                     double cb = boxes_[b].center()[axis];
+                     return ca != cb ? ca < cb : a < b;
+                   });
+  Build(first, half);
+  uint32_t right = Build(first + half, count - half);
+  nodes_[index].right = right;
+  return index;
+}
+
+}  // namespace scad
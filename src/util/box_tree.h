@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+
+namespace scad {
+
+// A bounding volume hierarchy over boxes used to find which items can overlap. Nodes are stored
+// depth first in a flat array, the left child of a node directly follows it.
+class BoxTree {
+ public:
+  explicit BoxTree(std::vector<Aabb> boxes);
+
+  // Appends the indices of all boxes overlapping box (within epsilon).
+  void Query(const Aabb& box, std::vector<uint32_t>* out, double epsilon = kGeometryEpsilon) const;
+
+  const std::vector<Aabb>& boxes() const {
+    return boxes_;
+  }
+
+ private:
+  struct Node {
+    Aabb box;
+    uint32_t first = 0;
+    // Leaf nodes have a non zero count.
+    uint32_t count = 0;
+    uint32_t right = 0;
+  };
+
+  uint32_t Build(uint32_t first, uint32_t count);
+
+  std::vector<Aabb> boxes_;
+  std::vector<uint32_t> items_;
+  std::vector<Node> nodes_;
+};
+
+}  // namespace scad
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+#include "mesh.h"
+
+namespace scad {
+
+// Parses a color the way openscad's color() does: one of the svg color names (case insensitive)
+// or a hex color "#rgb", "#rgba", "#rrggbb" or "#rrggbbaa". An alpha in the hex color overrides
+// the given alpha. Returns false for unknown colors.
+bool ParseColor(const std::string& name, double alpha, PackedColor* color);
+
+}  // namespace scad
@@ -0,0 +1,905 @@
+#include "convex.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <glm/glm.hpp>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+#include "mesh.h"
+#include "polygon.h"
+
+namespace scad {
+namespace {
+
+struct HullFace {
+  std::array<uint32_t, 3> v;
+  Plane plane;
+  bool alive = true;
+};
+
+uint64_t EdgeKey(uint32_t a, uint32_t b) {
+  return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+HullFace MakeHullFace(const std::vector<glm::dvec3>& points,
+                      uint32_t a,
+                      uint32_t b,
+                      uint32_t c,
+                      const glm::dvec3& fallback_normal) {
+  glm::dvec3 n = glm::cross(points[b] - points[a], points[c] - points[a]);
+  double length = glm::length(n);
+  // Degenerate faces can show up when a point is within tolerance of the horizon. They keep the
+  // topology closed and are merged away with their neighbors later.
+  n = length > 0 ? n / length : fallback_normal;
+  HullFace face;
+  face.v = {a, b, c};
+  face.plane = Plane(n, glm::dot(n, points[a]));
+  return face;
+}
+
+// Splits the polytope by the plane, closing both halves with a cap on the plane. Either output may
+// be null. Outputs are empty if the polytope has no volume on that side.
+void SplitPolytope(const ConvexPolytope& polytope,
+                   const Plane& plane,
+                   ConvexPolytope* front,
+                   ConvexPolytope* back) {
+  bool any_front = false;
+  bool any_back = false;
+  for (const ConvexFace& face : polytope.faces) {
+    for (const glm::dvec3& p : face.points) {
+      double d = plane.Distance(p);
+      any_front |= d > kGeometryEpsilon;
+      any_back |= d < -kGeometryEpsilon;
+    }
+  }
+  if (!any_back || !any_front) {
+    if (front) {
+      *front = any_front ? polytope : ConvexPolytope();
+    }
+    if (back) {
+      *back = any_back ? polytope : ConvexPolytope();
+    }
+    return;
+  }
+
+  ConvexPolytope front_result;
+  ConvexPolytope back_result;
+  front_result.color = polytope.color;
+  back_result.color = polytope.color;
+  std::vector<glm::dvec3> front_points;
+  std::vector<glm::dvec3> back_points;
+  VertexWelder cap_welder;
+  auto add_cap_points = [&](const std::vector<glm::dvec3>& points) {
+    for (const glm::dvec3& p : points) {
+      if (std::abs(plane.Distance(p)) <= kGeometryEpsilon) {
+        cap_welder.Add(p);
+      }
+    }
+  };
+  for (const ConvexFace& face : polytope.faces) {
+    SplitPolygon(face.points, plane, &front_points, &back_points);
+    add_cap_points(front_points);
+    add_cap_points(back_points);
+    if (front && !front_points.empty()) {
+      front_result.faces.push_back({face.plane, front_points});
+    }
+    if (back && !back_points.empty()) {
+      back_result.faces.push_back({face.plane, back_points});
+    }
+  }
+
+  // The cap points all lie on the plane so ordering them by angle around their center gives the
+  // boundary of the cap.
+  std::vector<glm::dvec3> cap = cap_welder.TakeVertices();
+  if (cap.size() >= 3) {
+    glm::dvec3 center(0);
+    for (const glm::dvec3& p : cap) {
+      center += p;
+    }
+    center /= static_cast<double>(cap.size());
+    glm::dvec3 u = glm::abs(plane.normal.x) < 0.9 ? glm::dvec3(1, 0, 0) : glm::dvec3(0, 1, 0);
+    u = glm::normalize(glm::cross(plane.normal, u));
+    glm::dvec3 v = glm::cross(plane.normal, u);
+    std::vector<std::pair<double, glm::dvec3>> sorted;
+    for (const glm::dvec3& p : cap) {
+      glm::dvec3 d = p - center;
+      sorted.push_back({std::atan2(glm::dot(d, v), glm::dot(d, u)), p});
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+      return a.first < b.first;
+    });
+    std::vector<glm::dvec3> points;
+    for (const auto& entry : sorted) {
+      points.push_back(entry.second);
+    }
+    if (back) {
+      back_result.faces.push_back({plane, points});
+    }
+    if (front) {
+      std::reverse(points.begin(), points.end());
+      front_result.faces.push_back({Plane(-plane.normal, -plane.offset), points});
+    }
+  }
+  if (front) {
+    *front = std::move(front_result);
+  }
+  if (back) {
+    *back = std::move(back_result);
+  }
+}
+
+int FindRoot(std::vector<int>& parents, int i) {
+  while (parents[i] != i) {
+    parents[i] = parents[parents[i]];
+    i = parents[i];
+  }
+  return i;
+}
+
+}  // namespace
+
+Plane Plane::FromPolygon(const std::vector<glm::dvec3>& polygon) {
+  glm::dvec3 n = NewellNormal(polygon);
+  double length = glm::length(n);
+  if (length > 0) {
+    n /= length;
+  }
+  glm::dvec3 center(0);
+  for (const glm::dvec3& p : polygon) {
+    center += p;
+  }
+  center /= static_cast<double>(polygon.size());
+  return Plane(n, glm::dot(n, center));
+}
+
+Aabb ConvexPolytope::Bounds() const {
+  Aabb box;
+  for (const ConvexFace& face : faces) {
+    for (const glm::dvec3& p : face.points) {
+      box.Extend(p);
+    }
+  }
+  return box;
+}
+
+std::vector<glm::dvec3> ConvexPolytope::Vertices() const {
+  VertexWelder welder;
+  for (const ConvexFace& face : faces) {
+    for (const glm::dvec3& p : face.points) {
+      welder.Add(p);
+    }
+  }
+  return welder.TakeVertices();
+}
+
+bool ConvexPolytope::Contains(const glm::dvec3& p, double epsilon) const {
+  if (faces.empty()) {
+    return false;
+  }
+  for (const ConvexFace& face : faces) {
+    if (face.plane.Distance(p) > epsilon) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t HashPolytope(const ConvexPolytope& polytope) {
+  uint64_t hash = HashCombine(polytope.faces.size(), polytope.color);
+  for (const ConvexFace& face : polytope.faces) {
+    hash = HashCombine(hash, face.points.size());
+    for (const glm::dvec3& p : face.points) {
+      hash = HashDouble(HashDouble(HashDouble(hash, p.x), p.y), p.z);
+    }
+  }
+  return hash;
+}
+
+bool ConvexFromMesh(const Mesh& mesh, ConvexPolytope* polytope) {
+  if (mesh.triangles.size() < 4) {
+    return false;
+  }
+  auto edge_key = [](uint32_t a, uint32_t b) { return (uint64_t{a} << 32) | b; };
+  // Directed edge to the triangle it belongs to.
+  std::unordered_map<uint64_t, uint32_t> edges;
+  edges.reserve(mesh.triangles.size() * 3);
+  for (uint32_t i = 0; i < mesh.triangles.size(); ++i) {
+    const auto& t = mesh.triangles[i];
+    for (int k = 0; k < 3; ++k) {
+      if (!edges.emplace(edge_key(t[k], t[(k + 1) % 3]), i).second) {
+        return false;
+      }
+    }
+  }
+
+  ConvexPolytope result;
+  result.faces.reserve(mesh.triangles.size());
+  for (const auto& t : mesh.triangles) {
+    ConvexFace face;
+    face.points = {mesh.vertices[t[0]], mesh.vertices[t[1]], mesh.vertices[t[2]]};
+    face.plane = Plane::FromPolygon(face.points);
+    result.faces.push_back(std::move(face));
+  }
+
+  // Every edge needs a twin whose far corner is not in front of the triangle. A connected
+  // closed surface which is convex along every edge is convex.
+  std::vector<uint32_t> component(mesh.triangles.size());
+  for (uint32_t i = 0; i < component.size(); ++i) {
+    component[i] = i;
+  }
+  auto find = [&](uint32_t i) {
+    while (component[i] != i) {
+      component[i] = component[component[i]];
+      i = component[i];
+    }
+    return i;
+  };
+  double tolerance = kGeometryEpsilon * std::fmax(1.0, glm::length(mesh.Bounds().size()));
+  for (uint32_t i = 0; i < mesh.triangles.size(); ++i) {
+    const auto& t = mesh.triangles[i];
+    for (int k = 0; k < 3; ++k) {
+      auto twin = edges.find(edge_key(t[(k + 1) % 3], t[k]));
+      if (twin == edges.end()) {
+        return false;
+      }
+      const auto& other = mesh.triangles[twin->second];
+      for (uint32_t v : other) {
+        if (result.faces[i].plane.Distance(mesh.vertices[v]) > tolerance) {
+          return false;
+        }
+      }
+      component[find(i)] = find(twin->second);
+    }
+  }
+  for (uint32_t i = 0; i < component.size(); ++i) {
+    if (find(i) != find(0)) {
+      return false;
+    }
+  }
+  result.color = mesh.colors.empty() ? 0 : mesh.colors[0];
+  *polytope = std::move(result);
+  return true;
+}
+
+ConvexPolytope ConvexHull(const std::vector<glm::dvec3>& input) {
+  std::vector<glm::dvec3> points;
+  {
+    VertexWelder welder;
+    for (const glm::dvec3& p : input) {
+      welder.Add(p);
+    }
+    points = welder.TakeVertices();
+  }
+  if (points.size() < 4) {
+    return {};
+  }
+
+  // Initial tetrahedron from the most distant pair of axis extremes.
+  std::array<uint32_t, 6> extremes = {0, 0, 0, 0, 0, 0};
+  for (uint32_t i = 0; i < points.size(); ++i) {
+    for (int axis = 0; axis < 3; ++axis) {
+      if (points[i][axis] < points[extremes[axis * 2]][axis]) {
+        extremes[axis * 2] = i;
+      }
+      if (points[i][axis] > points[extremes[axis * 2 + 1]][axis]) {
+        extremes[axis * 2 + 1] = i;
+      }
+    }
+  }
+  uint32_t i0 = 0;
+  uint32_t i1 = 0;
+  double best = -1;
+  for (uint32_t a : extremes) {
+    for (uint32_t b : extremes) {
+      double d = glm::length(points[a] - points[b]);
+      if (d > best) {
+        best = d;
+        i0 = a;
+        i1 = b;
+      }
+    }
+  }
+  if (best <= kGeometryEpsilon) {
+    return {};
+  }
+
+  glm::dvec3 line = glm::normalize(points[i1] - points[i0]);
+  uint32_t i2 = 0;
+  best = -1;
+  for (uint32_t i = 0; i < points.size(); ++i) {
+    glm::dvec3 d = points[i] - points[i0];
+    double dist = glm::length(d - line * glm::dot(d, line));
+    if (dist > best) {
+      best = dist;
+      i2 = i;
+    }
+  }
+  if (best <= kGeometryEpsilon) {
+    return {};
+  }
+
+  glm::dvec3 base_normal =
+      glm::normalize(glm::cross(points[i1] - points[i0], points[i2] - points[i0]));
+  uint32_t i3 = 0;
+  best = -1;
+  for (uint32_t i = 0; i < points.size(); ++i) {
+    double dist = std::abs(glm::dot(points[i] - points[i0], base_normal));
+    if (dist > best) {
+      best = dist;
+      i3 = i;
+    }
+  }
+  if (best <= kGeometryEpsilon) {
+    return {};
+  }
+
+  std::vector<HullFace> faces;
+  std::unordered_map<uint64_t, uint32_t> edges;
+  auto add_face = [&](const HullFace& face) {
+    uint32_t index = static_cast<uint32_t>(faces.size());
+    faces.push_back(face);
+    for (int e = 0; e < 3; ++e) {
+      edges[EdgeKey(face.v[e], face.v[(e + 1) % 3])] = index;
+    }
+  };
+
+  if (glm::dot(points[i3] - points[i0], base_normal) > 0) {
+    std::swap(i1, i2);
+    base_normal *= -1;
+  }
+  add_face(MakeHullFace(points, i0, i1, i2, base_normal));
+  add_face(MakeHullFace(points, i0, i3, i1, base_normal));
+  add_face(MakeHullFace(points, i1, i3, i2, base_normal));
+  add_face(MakeHullFace(points, i2, i3, i0, base_normal));
+
+  // Farthest points first so most interior points are rejected by a single pass over a hull that
+  // is already close to final.
+  glm::dvec3 center = (points[i0] + points[i1] + points[i2] + points[i3]) * 0.25;
+  std::vector<uint32_t> order;
+  for (uint32_t i = 0; i < points.size(); ++i) {
+    if (i != i0 && i != i1 && i != i2 && i != i3) {
+      order.push_back(i);
+    }
+  }
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    double da = glm::dot(points[a] - center, points[a] - center);
+    double db = glm::dot(points[b] - center, points[b] - center);
+    return da != db ? da > db : a < b;
+  });
+
+  // Marks the faces connected to start through faces for which include is true.
+  std::vector<uint32_t> stack;
+  auto flood = [&](uint32_t start, std::vector<char>* marks, auto include) {
+    (*marks)[start] = 1;
+    stack.assign(1, start);
+    while (!stack.empty()) {
+      const HullFace& face = faces[stack.back()];
+      stack.pop_back();
+      for (int e = 0; e < 3; ++e) {
+        auto twin = edges.find(EdgeKey(face.v[(e + 1) % 3], face.v[e]));
+        if (twin != edges.end() && !(*marks)[twin->second] && include(twin->second)) {
+          (*marks)[twin->second] = 1;
+          stack.push_back(twin->second);
+        }
+      }
+    }
+  };
+  // Whether the horizon edges form a single loop.
+  std::unordered_map<uint32_t, uint32_t> loop;
+  auto single_loop = [&](const std::vector<std::array<uint32_t, 2>>& horizon) {
+    loop.clear();
+    for (const auto& edge : horizon) {
+      if (!loop.emplace(edge[0], edge[1]).second) {
+        return false;
+      }
+    }
+    size_t length = 0;
+    uint32_t v = horizon[0][0];
+    do {
+      auto it = loop.find(v);
+      if (it == loop.end()) {
+        return false;
+      }
+      v = it->second;
+      ++length;
+    } while (v != horizon[0][0] && length <= horizon.size());
+    return length == horizon.size();
+  };
+
+  std::vector<uint32_t> visible;
+  std::vector<char> is_visible;
+  std::vector<char> is_hidden;
+  std::vector<std::array<uint32_t, 2>> horizon;
+  for (uint32_t p : order) {
+    uint32_t farthest = 0;
+    double farthest_distance = kGeometryEpsilon;
+    for (uint32_t f = 0; f < faces.size(); ++f) {
+      double distance = faces[f].alive ? faces[f].plane.Distance(points[p]) : 0;
+      if (distance > farthest_distance) {
+        farthest = f;
+        farthest_distance = distance;
+      }
+    }
+    if (farthest_distance <= kGeometryEpsilon) {
+      continue;
+    }
+    // Within the tolerance the faces seen from p can be scattered or surround faces which are
+    // not, which would leave holes in the hull. Only the ones connected to the farthest face are
+    // replaced, and if they surround others those are replaced too: everything not connected to
+    // the face p is farthest behind.
+    is_visible.assign(faces.size(), 0);
+    flood(farthest, &is_visible, [&](uint32_t f) {
+      return faces[f].plane.Distance(points[p]) > kGeometryEpsilon;
+    });
+    visible.clear();
+    for (uint32_t f = 0; f < faces.size(); ++f) {
+      if (is_visible[f]) {
+        visible.push_back(f);
+      }
+    }
+    auto find_horizon = [&] {
+      horizon.clear();
+      for (uint32_t f : visible) {
+        const HullFace& face = faces[f];
+        for (int e = 0; e < 3; ++e) {
+          uint32_t a = face.v[e];
+          uint32_t b = face.v[(e + 1) % 3];
+          auto twin = edges.find(EdgeKey(b, a));
+          if (twin == edges.end() || !is_visible[twin->second]) {
+            horizon.push_back({a, b});
+          }
+        }
+      }
+    };
+    find_horizon();
+    if (!single_loop(horizon)) {
+      uint32_t nearest = farthest;
+      for (uint32_t f = 0; f < faces.size(); ++f) {
+        if (faces[f].alive &&
+            faces[f].plane.Distance(points[p]) < faces[nearest].plane.Distance(points[p])) {
+          nearest = f;
+        }
+      }
+      is_hidden.assign(faces.size(), 0);
+      flood(nearest, &is_hidden, [&](uint32_t f) { return !is_visible[f]; });
+      visible.clear();
+      for (uint32_t f = 0; f < faces.size(); ++f) {
+        is_visible[f] = faces[f].alive && !is_hidden[f];
+        if (is_visible[f]) {
+          visible.push_back(f);
+        }
+      }
+      find_horizon();
+    }
+
+    glm::dvec3 fallback_normal(0);
+    for (uint32_t f : visible) {
+      fallback_normal += faces[f].plane.normal;
+    }
+    for (uint32_t f : visible) {
+      HullFace& face = faces[f];
+      face.alive = false;
+      for (int e = 0; e < 3; ++e) {
+        edges.erase(EdgeKey(face.v[e], face.v[(e + 1) % 3]));
+      }
+    }
+    fallback_normal = glm::normalize(fallback_normal);
+    for (const auto& edge : horizon) {
+      add_face(MakeHullFace(points, edge[0], edge[1], p, fallback_normal));
+    }
+  }
+
+  // Merge coplanar neighbors into polygon faces.
+  std::vector<int> parents(faces.size());
+  for (size_t i = 0; i < faces.size(); ++i) {
+    parents[i] = static_cast<int>(i);
+  }
+  for (uint32_t f = 0; f < faces.size(); ++f) {
+    const HullFace& face = faces[f];
+    if (!face.alive) {
+      continue;
+    }
+    for (int e = 0; e < 3; ++e) {
+      auto twin = edges.find(EdgeKey(face.v[(e + 1) % 3], face.v[e]));
+      if (twin == edges.end()) {
+        continue;
+      }
+      const HullFace& other = faces[twin->second];
+      bool coplanar = glm::dot(face.plane.normal, other.plane.normal) > 0;
+      for (int i = 0; i < 3 && coplanar; ++i) {
+        coplanar = std::abs(face.plane.Distance(points[other.v[i]])) <= kGeometryEpsilon &&
+                   std::abs(other.plane.Distance(points[face.v[i]])) <= kGeometryEpsilon;
+      }
+      if (coplanar) {
+        parents[FindRoot(parents, f)] = FindRoot(parents, twin->second);
+      }
+    }
+  }
+
+  std::unordered_map<int, std::unordered_map<uint32_t, uint32_t>> boundaries;
+  std::vector<int> group_order;
+  for (uint32_t f = 0; f < faces.size(); ++f) {
+    const HullFace& face = faces[f];
+    if (!face.alive) {
+      continue;
+    }
+    int group = FindRoot(parents, f);
+    if (boundaries.find(group) == boundaries.end()) {
+      group_order.push_back(group);
+    }
+    auto& next = boundaries[group];
+    for (int e = 0; e < 3; ++e) {
+      uint32_t a = face.v[e];
+      uint32_t b = face.v[(e + 1) % 3];
+      auto twin = edges.find(EdgeKey(b, a));
+      if (twin == edges.end() || FindRoot(parents, twin->second) != group) {
+        next[a] = b;
+      }
+    }
+  }
+
+  ConvexPolytope polytope;
+  for (int group : group_order) {
+    auto& next = boundaries[group];
+    if (next.empty()) {
+      continue;
+    }
+    ConvexFace face;
+    uint32_t start = next.begin()->first;
+    uint32_t current = start;
+    bool closed = false;
+    for (size_t steps = 0; steps <= next.size(); ++steps) {
+      face.points.push_back(points[current]);
+      auto it = next.find(current);
+      if (it == next.end()) {
+        break;
+      }
+      current = it->second;
+      if (current == start) {
+        closed = face.points.size() == next.size();
+        break;
+      }
+    }
+    if (!closed) {
+      // Should not happen with a consistent hull. Fall back to the group's triangles.
+      for (uint32_t f = 0; f < faces.size(); ++f) {
+        if (faces[f].alive && FindRoot(parents, f) == group) {
+          ConvexFace triangle;
+          triangle.points = {
+              points[faces[f].v[0]], points[faces[f].v[1]], points[faces[f].v[2]]};
+          triangle.plane = faces[f].plane;
+          polytope.faces.push_back(triangle);
+        }
+      }
+      continue;
+    }
+    face.plane = Plane::FromPolygon(face.points);
+    polytope.faces.push_back(std::move(face));
+  }
+  return polytope;
+}
+
+namespace {
+
+// Normals of the rounded hull along the edge from a to b: start rotated about the edge direction
+// axis by up to angle.
+struct EdgeArc {
+  uint32_t a = 0;
+  uint32_t b = 0;
+  glm::dvec3 start;
+  glm::dvec3 axis;
+  double angle = 0;
+};
+
+// The faces and edge arcs of points which don't span a volume: both sides of a polygon with half
+// circles around its edges, a full circle around a segment or nothing for a single point. Replaces
+// points by the corners.
+void FlatFeatures(std::vector<glm::dvec3>* points,
+                  std::vector<std::pair<glm::dvec3, std::vector<uint32_t>>>* faces,
+                  std::vector<EdgeArc>* arcs) {
+  auto farthest = [&](const std::function<double(const glm::dvec3&)>& distance) {
+    uint32_t best = 0;
+    for (uint32_t i = 0; i < points->size(); ++i) {
+      if (distance((*points)[i]) > distance((*points)[best])) {
+        best = i;
+      }
+    }
+    return best;
+  };
+  glm::dvec3 p0 = (*points)[farthest([&](const glm::dvec3& p) {
+    return glm::length(p - (*points)[0]);
+  })];
+  glm::dvec3 p1 = (*points)[farthest([&](const glm::dvec3& p) { return glm::length(p - p0); })];
+  if (glm::length(p1 - p0) <= kGeometryEpsilon) {
+    *points = {p0};
+    return;
+  }
+  glm::dvec3 u = glm::normalize(p1 - p0);
+  auto line_distance = [&](const glm::dvec3& p) {
+    return glm::length((p - p0) - u * glm::dot(p - p0, u));
+  };
+  glm::dvec3 p2 = (*points)[farthest(line_distance)];
+  if (line_distance(p2) <= kGeometryEpsilon) {
+    glm::dvec3 other = std::abs(u.x) < 0.9 ? glm::dvec3(1, 0, 0) : glm::dvec3(0, 1, 0);
+    *points = {p0, p1};
+    arcs->push_back({0, 1, glm::normalize(glm::cross(u, other)), u, 2 * M_PI});
+    return;
+  }
+  glm::dvec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+  glm::dvec3 v = glm::cross(normal, u);
+  std::vector<glm::dvec2> flat;
+  for (const glm::dvec3& p : *points) {
+    flat.push_back({glm::dot(p - p0, u), glm::dot(p - p0, v)});
+  }
+  points->clear();
+  std::vector<uint32_t> corners;
+  for (const glm::dvec2& q : ConvexHull2d(std::move(flat))) {
+    corners.push_back(static_cast<uint32_t>(points->size()));
+    points->push_back(p0 + u * q.x + v * q.y);
+  }
+  // Counterclockwise seen from the front, so the half circles start at the front.
+  for (size_t i = 0; i < corners.size(); ++i) {
+    uint32_t a = corners[i];
+    uint32_t b = corners[(i + 1) % corners.size()];
+    arcs->push_back({a, b, normal, glm::normalize((*points)[b] - (*points)[a]), M_PI});
+  }
+  faces->push_back({normal, corners});
+  std::reverse(corners.begin(), corners.end());
+  faces->push_back({-normal, corners});
+}
+
+}  // namespace
+
+ConvexPolytope RoundedConvexHull(const std::vector<glm::dvec3>& input,
+                                 double radius,
+                                 int fragments) {
+  std::vector<glm::dvec3> points;
+  {
+    VertexWelder welder;
+    for (const glm::dvec3& p : input) {
+      welder.Add(p);
+    }
+    points = welder.TakeVertices();
+  }
+  if (points.empty() || !(radius > 0)) {
+    return ConvexHull(points);
+  }
+  fragments = std::max(fragments, 3);
+  double step = 2 * M_PI / fragments;
+
+  // Every point of the surface is a corner moved by the radius along a normal of the hull at that
+  // corner. The normals of a face are its plane's, those of an edge turn from the normal of one of
+  // its faces to the other's and those of a corner fill the cone between the edges. Each is
+  // sampled on its own so no two surface points end up closer than necessary, slivers the hull
+  // below would have trouble with.
+  std::vector<std::pair<glm::dvec3, std::vector<uint32_t>>> faces;
+  std::vector<EdgeArc> arcs;
+  ConvexPolytope hull = ConvexHull(points);
+  if (hull.empty()) {
+    FlatFeatures(&points, &faces, &arcs);
+  } else {
+    VertexWelder welder;
+    std::map<std::pair<uint32_t, uint32_t>, glm::dvec3> edge_normals;
+    for (const ConvexFace& face : hull.faces) {
+      std::vector<uint32_t> corners;
+      for (const glm::dvec3& p : face.points) {
+        corners.push_back(welder.Add(p));
+      }
+      for (size_t i = 0; i < corners.size(); ++i) {
+        edge_normals[{corners[i], corners[(i + 1) % corners.size()]}] = face.plane.normal;
+      }
+      faces.push_back({face.plane.normal, std::move(corners)});
+    }
+    points = welder.TakeVertices();
+    // Counterclockwise faces turn towards the neighbor across an edge about its direction.
+    for (const auto& [edge, normal] : edge_normals) {
+      auto twin = edge_normals.find({edge.second, edge.first});
+      if (edge.first < edge.second && twin != edge_normals.end()) {
+        double angle = std::acos(std::clamp(glm::dot(normal, twin->second), -1.0, 1.0));
+        glm::dvec3 axis = glm::normalize(points[edge.second] - points[edge.first]);
+        arcs.push_back({edge.first, edge.second, normal, axis, angle});
+      }
+    }
+  }
+
+  std::vector<glm::dvec3> surface;
+  for (const auto& [normal, corners] : faces) {
+    for (uint32_t corner : corners) {
+      surface.push_back(points[corner] + normal * radius);
+    }
+  }
+  std::vector<std::vector<uint32_t>> neighbors(points.size());
+  for (const EdgeArc& arc : arcs) {
+    neighbors[arc.a].push_back(arc.b);
+    neighbors[arc.b].push_back(arc.a);
+    int segments = std::max(1, static_cast<int>(std::ceil(arc.angle / step - 1e-9)));
+    glm::dvec3 side = glm::cross(arc.axis, arc.start);
+    for (int i = 0; i <= segments; ++i) {
+      double t = arc.angle * i / segments;
+      glm::dvec3 d = arc.start * std::cos(t) + side * std::sin(t);
+      surface.push_back(points[arc.a] + d * radius);
+      surface.push_back(points[arc.b] + d * radius);
+    }
+  }
+  // The caps use the directions of openscad's sphere which are inside of a corner's cone by at
+  // least a quarter of a segment.
+  double margin = std::sin(step / 4);
+  int rings = (fragments + 1) / 2;
+  for (int i = 0; i < rings; ++i) {
+    double phi = (M_PI * (i + 0.5)) / rings;
+    for (int j = 0; j < fragments; ++j) {
+      double theta = step * j;
+      glm::dvec3 d(std::sin(phi) * std::cos(theta), std::sin(phi) * std::sin(theta), std::cos(phi));
+      uint32_t corner = 0;
+      for (uint32_t k = 1; k < points.size(); ++k) {
+        if (glm::dot(points[k], d) > glm::dot(points[corner], d)) {
+          corner = k;
+        }
+      }
+      bool inside = true;
+      for (uint32_t other : neighbors[corner]) {
+        glm::dvec3 edge = points[corner] - points[other];
+        inside = inside && glm::dot(edge, d) >= glm::length(edge) * margin;
+      }
+      if (inside) {
+        surface.push_back(points[corner] + d * radius);
+      }
+    }
+  }
+  return ConvexHull(surface);
+}
+
+void SplitPolygon(const std::vector<glm::dvec3>& polygon,
+                  const Plane& plane,
+                  std::vector<glm::dvec3>* front,
+                  std::vector<glm::dvec3>* back) {
+  if (front) {
+    front->clear();
+  }
+  if (back) {
+    back->clear();
+  }
+  size_t n = polygon.size();
+  if (n < 3) {
+    return;
+  }
+  bool any_front = false;
+  bool any_back = false;
+  // Distances are computed once per point so shared points are classified consistently.
+  std::vector<double> distances(n);
+  for (size_t i = 0; i < n; ++i) {
+    distances[i] = plane.Distance(polygon[i]);
+    any_front |= distances[i] > kGeometryEpsilon;
+    any_back |= distances[i] < -kGeometryEpsilon;
+  }
+  if (!any_back) {
+    if (front && any_front) {
+      *front = polygon;
+    }
+    return;
+  }
+  if (!any_front) {
+    if (back) {
+      *back = polygon;
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    const glm::dvec3& a = polygon[i];
+    const glm::dvec3& b = polygon[(i + 1) % n];
+    double da = distances[i];
+    double db = distances[(i + 1) % n];
+    if (da > kGeometryEpsilon) {
+      if (front) {
+        front->push_back(a);
+      }
+    } else if (da < -kGeometryEpsilon) {
+      if (back) {
+        back->push_back(a);
+      }
+    } else {
+      if (front) {
+        front->push_back(a);
+      }
+      if (back) {
+        back->push_back(a);
+      }
+    }
+    if ((da > kGeometryEpsilon && db < -kGeometryEpsilon) ||
+        (da < -kGeometryEpsilon && db > kGeometryEpsilon)) {
+      glm::dvec3 x = a + (b - a) * (da / (da - db));
+      if (front) {
+        front->push_back(x);
+      }
+      if (back) {
+        back->push_back(x);
+      }
+    }
+  }
+}
+
+ConvexPolytope TransformPolytope(const ConvexPolytope& polytope, const glm::dmat4& transform) {
+  bool flip = glm::determinant(glm::dmat3(transform)) < 0;
+  ConvexPolytope result;
+  result.color = polytope.color;
+  result.faces.reserve(polytope.faces.size());
+  for (const ConvexFace& face : polytope.faces) {
+    ConvexFace transformed;
+    transformed.points.reserve(face.points.size());
+    for (const glm::dvec3& p : face.points) {
+      transformed.points.push_back(glm::dvec3(transform * glm::dvec4(p, 1)));
+    }
+    if (flip) {
+      std::reverse(transformed.points.begin(), transformed.points.end());
+    }
+    transformed.plane = Plane::FromPolygon(transformed.points);
+    result.faces.push_back(std::move(transformed));
+  }
+  return result;
+}
+
+ConvexPolytope ClipPolytope(const ConvexPolytope& polytope, const Plane& plane) {
+  ConvexPolytope back;
+  SplitPolytope(polytope, plane, nullptr, &back);
+  return back;
+}
+
+bool ContainsPolytope(const ConvexPolytope& outer, const ConvexPolytope& inner) {
+  if (outer.empty()) {
+    return inner.empty();
+  }
+  for (const ConvexFace& face : inner.faces) {
+    for (const glm::dvec3& p : face.points) {
+      if (!outer.Contains(p)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+ConvexPolytope IntersectPolytopes(const ConvexPolytope& a, const ConvexPolytope& b) {
+  if (b.empty() || !a.Bounds().Overlaps(b.Bounds(), kGeometryEpsilon)) {
+    return {};
+  }
+  ConvexPolytope result = a;
+  for (const ConvexFace& face : b.faces) {
+    result = ClipPolytope(result, face.plane);
+    if (result.empty()) {
+      break;
+    }
+  }
+  return result;
+}
+
+void SubtractPolytope(const ConvexPolytope& a,
+                      const ConvexPolytope& b,
+                      std::vector<ConvexPolytope>* out) {
+  if (b.empty() || !a.Bounds().Overlaps(b.Bounds(), kGeometryEpsilon)) {
+    out->push_back(a);
+    return;
+  }
+  ConvexPolytope remaining = a;
+  ConvexPolytope front;
+  ConvexPolytope back;
+  for (const ConvexFace& face : b.faces) {
+    SplitPolytope(remaining, face.plane, &front, &back);
+    if (!front.empty()) {
+      out->push_back(std::move(front));
+    }
+    if (back.empty()) {
+      return;
+    }
+    remaining = std::move(back);
+  }
+  // Whatever is left is inside of b.
+}
+
+}  // namespace scad
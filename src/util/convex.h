@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "mesh.h"
+
+namespace scad {
+
+// An oriented plane. Points with a positive distance are in front of (outside) the plane.
+struct Plane {
+  glm::dvec3 normal = glm::dvec3(0, 0, 1);
+  double offset = 0;
+
+  Plane() {
+  }
+
+  Plane(const glm::dvec3& normal, double offset) : normal(normal), offset(offset) {
+  }
+
+  // Fits a plane to a planar polygon which is counter clockwise when viewed from the front.
+  static Plane FromPolygon(const std::vector<glm::dvec3>& polygon);
+
+  double Distance(const glm::dvec3& p) const {
+    return glm::dot(normal, p) - offset;
+  }
+};
+
+struct ConvexFace {
+  Plane plane;
+  // Counter clockwise when viewed from outside of the polytope.
+  std::vector<glm::dvec3> points;
+};
+
+// A closed convex solid described by its boundary faces.
+struct ConvexPolytope {
+  std::vector<ConvexFace> faces;
+  // Carried through every operation which derives pieces from this one.
+  PackedColor color = 0;
+
+  bool empty() const {
+    return faces.empty();
+  }
+
+  Aabb Bounds() const;
+
+  // The distinct corner points of the polytope.
+  std::vector<glm::dvec3> Vertices() const;
+
+  // True if p is inside or within epsilon of the boundary.
+  bool Contains(const glm::dvec3& p, double epsilon = kGeometryEpsilon) const;
+};
+
+// Hash of the faces and color of the polytope.
+uint64_t HashPolytope(const ConvexPolytope& polytope);
+
+// The convex hull of a set of points. Returns an empty polytope if the points do not span a
+// volume.
+ConvexPolytope ConvexHull(const std::vector<glm::dvec3>& points);
+
+// The hull of spheres of the given radius around the points, i.e. their convex hull grown by the
+// radius. Only the final surface is tessellated: flat faces along the faces of the hull, arcs of
+// fragments segments per full circle around its edges and caps of a sphere of fragments segments
+// around its corners. Empty if there are no points.
+ConvexPolytope RoundedConvexHull(const std::vector<glm::dvec3>& points,
+                                 double radius,
+                                 int fragments);
+
+// Converts a closed triangle mesh to a polytope if it is convex, i.e. connected and convex along
+// every edge. Returns false otherwise.
+bool ConvexFromMesh(const Mesh& mesh, ConvexPolytope* polytope);
+
+// Splits a convex polygon by the plane. Either output may be null if that side is not needed.
+// Outputs are left empty if the polygon does not have any area on that side.
+void SplitPolygon(const std::vector<glm::dvec3>& polygon,
+                  const Plane& plane,
+                  std::vector<glm::dvec3>* front,
+                  std::vector<glm::dvec3>* back);
+
+// Applies an affine transform. Mirroring transforms flip the winding so faces still point out.
+ConvexPolytope TransformPolytope(const ConvexPolytope& polytope, const glm::dmat4& transform);
+
+// The part of the polytope behind the plane.
+ConvexPolytope ClipPolytope(const ConvexPolytope& polytope, const Plane& plane);
+
+// True if every corner of inner is inside of outer.
+bool ContainsPolytope(const ConvexPolytope& outer, const ConvexPolytope& inner);
+
+ConvexPolytope IntersectPolytopes(const ConvexPolytope& a, const ConvexPolytope& b);
+
+// Appends convex pieces which together cover a minus b. A is split by each plane of b in turn, the
+// part in front of the plane is outside of b and the rest is carried on to the next plane.
+void SubtractPolytope(const ConvexPolytope& a,
+                      const ConvexPolytope& b,
+                      std::vector<ConvexPolytope>* out);
+
+}  // namespace scad
@@ -0,0 +1,384 @@
+#include "convex_union.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "box_tree.h"
+#include "convex.h"
+#include "hash.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace scad {
+namespace {
+
+// Clipping leaves slivers a few multiples of kGeometryEpsilon wide where pieces nearly touch.
+// Welding with a coarser tolerance collapses them, it is still far below the size of the .01mm
+// post connectors.
+const double kWeldTolerance = 1e-5;
+
+bool IsOnPlane(const std::vector<glm::dvec3>& polygon, const Plane& plane) {
+  for (const glm::dvec3& p : polygon) {
+    if (std::abs(plane.Distance(p)) > kGeometryEpsilon) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Appends the parts of fragment which are outside of the polytope. Parts lying on a face of the
+// polytope which faces the same way as the fragment are only kept if keep_coplanar is set so that
+// exactly one copy of a shared face survives.
+void ClipOutside(const std::vector<glm::dvec3>& fragment,
+                 const glm::dvec3& normal,
+                 const ConvexPolytope& polytope,
+                 bool keep_coplanar,
+                 std::vector<std::vector<glm::dvec3>>* out) {
+  std::vector<glm::dvec3> remaining = fragment;
+  std::vector<glm::dvec3> front;
+  std::vector<glm::dvec3> back;
+  for (const ConvexFace& face : polytope.faces) {
+    if (IsOnPlane(remaining, face.plane)) {
+      if (glm::dot(face.plane.normal, normal) > 0 && keep_coplanar) {
+        out->push_back(std::move(remaining));
+        return;
+      }
+      // Either the other piece owns this face or the two pieces touch back to back.
+      continue;
+    }
+    SplitPolygon(remaining, face.plane, &front, &back);
+    if (!front.empty()) {
+      out->push_back(front);
+    }
+    if (back.empty()) {
+      return;
+    }
+    remaining.swap(back);
+  }
+  // Whatever is left is inside of the polytope.
+}
+
+// Splits polygon edges at vertices which lie on them so that neighboring facets share edges.
+class TJunctionSplitter {
+ public:
+  explicit TJunctionSplitter(const std::vector<glm::dvec3>& vertices) : vertices_(vertices) {
+    for (int axis = 0; axis < 3; ++axis) {
+      auto& sorted = sorted_[axis];
+      sorted.resize(vertices.size());
+      for (uint32_t i = 0; i < vertices.size(); ++i) {
+        sorted[i] = i;
+      }
+      std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+        return vertices[a][axis] < vertices[b][axis];
+      });
+    }
+  }
+
+  void Split(std::vector<uint32_t>* loop) const {
+    std::vector<uint32_t> result;
+    std::vector<std::pair<double, uint32_t>> on_edge;
+    size_t n = loop->size();
+    for (size_t i = 0; i < n; ++i) {
+      uint32_t a = (*loop)[i];
+      uint32_t b = (*loop)[(i + 1) % n];
+      result.push_back(a);
+      on_edge.clear();
+      FindOnEdge(a, b, &on_edge);
+      std::sort(on_edge.begin(), on_edge.end());
+      for (const auto& entry : on_edge) {
+        if (result.back() != entry.second) {
+          result.push_back(entry.second);
+        }
+      }
+    }
+    loop->swap(result);
+  }
+
+ private:
+  void FindOnEdge(uint32_t a, uint32_t b, std::vector<std::pair<double, uint32_t>>* out) const {
+    const glm::dvec3& pa = vertices_[a];
+    const glm::dvec3& pb = vertices_[b];
+    glm::dvec3 d = pb - pa;
+    double length2 = glm::dot(d, d);
+    if (length2 <= kWeldTolerance * kWeldTolerance) {
+      return;
+    }
+    // Search the axis along which the edge is the thinnest to get the fewest candidates.
+    glm::dvec3 extent = glm::abs(d);
+    int axis = 0;
+    if (extent.y < extent[axis]) {
+      axis = 1;
+    }
+    if (extent.z < extent[axis]) {
+      axis = 2;
+    }
+    double lo = std::min(pa[axis], pb[axis]) - kWeldTolerance;
+    double hi = std::max(pa[axis], pb[axis]) + kWeldTolerance;
+    const auto& sorted = sorted_[axis];
+    auto it = std::lower_bound(sorted.begin(), sorted.end(), lo, [&](uint32_t v, double value) {
+      return vertices_[v][axis] < value;
+    });
+    for (; it != sorted.end() && vertices_[*it][axis] <= hi; ++it) {
+      uint32_t v = *it;
+      if (v == a || v == b) {
+        continue;
+      }
+      glm::dvec3 pv = vertices_[v] - pa;
+      double t = glm::dot(pv, d) / length2;
+      if (t <= 0 || t >= 1) {
+        continue;
+      }
+      glm::dvec3 offset = pv - d * t;
+      if (glm::dot(offset, offset) <= kWeldTolerance * kWeldTolerance) {
+        out->push_back({t, v});
+      }
+    }
+  }
+
+  const std::vector<glm::dvec3>& vertices_;
+  std::array<std::vector<uint32_t>, 3> sorted_;
+};
+
+bool HasCollinearCorner(const std::vector<glm::dvec3>& vertices,
+                        const std::vector<uint32_t>& loop) {
+  size_t n = loop.size();
+  for (size_t i = 0; i < n; ++i) {
+    const glm::dvec3& prev = vertices[loop[(i + n - 1) % n]];
+    const glm::dvec3& p = vertices[loop[i]];
+    const glm::dvec3& next = vertices[loop[(i + 1) % n]];
+    double area = glm::length(glm::cross(prev - p, next - p));
+    if (area <= kWeldTolerance * (glm::length(prev - p) + glm::length(next - p))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Loops which welding collapsed to (nearly) a line. Keeping them would leave zero width fins.
+bool IsSliver(const std::vector<glm::dvec3>& vertices, const std::vector<uint32_t>& loop) {
+  std::vector<glm::dvec3> points;
+  double perimeter = 0;
+  for (size_t i = 0; i < loop.size(); ++i) {
+    points.push_back(vertices[loop[i]]);
+    perimeter += glm::length(vertices[loop[(i + 1) % loop.size()]] - vertices[loop[i]]);
+  }
+  double area = glm::length(NewellNormal(points)) / 2;
+  return area <= kWeldTolerance * perimeter / 2;
+}
+
+// Removes pairs of triangles with the same corners and opposite winding. They show up where two
+// pieces are within the weld tolerance of each other and describe a surface of no thickness.
+void RemoveOpposingPairs(Mesh* mesh) {
+  std::vector<std::array<uint32_t, 3>>* triangles = &mesh->triangles;
+  std::map<std::array<uint32_t, 3>, std::vector<size_t>> by_corners;
+  for (size_t i = 0; i < triangles->size(); ++i) {
+    std::array<uint32_t, 3> key = (*triangles)[i];
+    std::sort(key.begin(), key.end());
+    by_corners[key].push_back(i);
+  }
+  std::vector<char> removed(triangles->size(), 0);
+  for (const auto& entry : by_corners) {
+    const std::vector<size_t>& list = entry.second;
+    if (list.size() < 2) {
+      continue;
+    }
+    // Rotate each triangle so its smallest index is first, the second index then tells the
+    // winding.
+    std::vector<size_t> forward;
+    std::vector<size_t> backward;
+    for (size_t i : list) {
+      const auto& t = (*triangles)[i];
+      int first = t[0] == entry.first[0] ? 0 : (t[1] == entry.first[0] ? 1 : 2);
+      (t[(first + 1) % 3] == entry.first[1] ? forward : backward).push_back(i);
+    }
+    for (size_t i = 0; i < std::min(forward.size(), backward.size()); ++i) {
+      removed[forward[i]] = 1;
+      removed[backward[i]] = 1;
+    }
+  }
+  size_t out = 0;
+  for (size_t i = 0; i < triangles->size(); ++i) {
+    if (!removed[i]) {
+      if (!mesh->colors.empty()) {
+        mesh->colors[out] = mesh->colors[i];
+      }
+      (*triangles)[out++] = (*triangles)[i];
+    }
+  }
+  triangles->resize(out);
+  if (!mesh->colors.empty()) {
+    mesh->colors.resize(out);
+  }
+}
+
+// Appends the facets of the piece which are not inside of any of the other pieces.
+void ClipPiece(const std::vector<ConvexPolytope>& pieces,
+               const BoxTree& tree,
+               uint32_t i,
+               const std::vector<uint64_t>& hashes,
+               UnionCache* cache,
+               std::vector<std::vector<glm::dvec3>>* out) {
+  const std::vector<Aabb>& boxes = tree.boxes();
+  std::vector<uint32_t> neighbors;
+  tree.Query(boxes[i], &neighbors);
+  std::sort(neighbors.begin(), neighbors.end());
+
+  uint64_t key = 0;
+  if (cache) {
+    // Which piece keeps a shared face depends on the order of the pieces so that is part of the
+    // key as well.
+    key = hashes[i];
+    for (uint32_t j : neighbors) {
+      if (j != i) {
+        key = HashCombine(HashCombine(key, hashes[j]), i < j);
+      }
+    }
+    std::shared_ptr<const std::vector<std::vector<glm::dvec3>>> cached;
+    if (cache->Lookup(key, &cached)) {
+      *out = *cached;
+      return;
+    }
+  }
+
+  std::vector<std::vector<glm::dvec3>> fragments;
+  std::vector<std::vector<glm::dvec3>> clipped;
+  for (const ConvexFace& face : pieces[i].faces) {
+    Aabb face_box;
+    for (const glm::dvec3& p : face.points) {
+      face_box.Extend(p);
+    }
+    fragments.clear();
+    fragments.push_back(face.points);
+    for (uint32_t j : neighbors) {
+      if (j == i || !face_box.Overlaps(boxes[j], kGeometryEpsilon)) {
+        continue;
+      }
+      clipped.clear();
+      for (const auto& fragment : fragments) {
+        ClipOutside(fragment, face.plane.normal, pieces[j], i < j, &clipped);
+      }
+      fragments.swap(clipped);
+      if (fragments.empty()) {
+        break;
+      }
+    }
+    for (auto& fragment : fragments) {
+      out->push_back(std::move(fragment));
+    }
+  }
+  if (cache) {
+    cache->Insert(key, std::make_shared<const std::vector<std::vector<glm::dvec3>>>(*out));
+  }
+}
+
+}  // namespace
+
+Mesh UnionConvex(const std::vector<ConvexPolytope>& pieces, ThreadPool* pool, UnionCache* cache) {
+  std::vector<Aabb> boxes;
+  boxes.reserve(pieces.size());
+  for (const ConvexPolytope& piece : pieces) {
+    boxes.push_back(piece.Bounds());
+  }
+  BoxTree tree(std::move(boxes));
+  std::vector<uint64_t> hashes;
+  if (cache) {
+    for (const ConvexPolytope& piece : pieces) {
+      hashes.push_back(HashPolytope(piece));
+    }
+  }
+
+  // Pieces are clipped independently and gathered in order so the output doesn't depend on the
+  // number of threads.
+  const uint32_t kPiecesPerTask = 16;
+  std::vector<std::vector<std::vector<glm::dvec3>>> piece_polygons(pieces.size());
+  {
+    TaskGroup group(pool);
+    for (uint32_t first = 0; first < pieces.size(); first += kPiecesPerTask) {
+      group.Run([&, first] {
+        uint32_t end = std::min<uint32_t>(first + kPiecesPerTask, pieces.size());
+        for (uint32_t i = first; i < end; ++i) {
+          ClipPiece(pieces, tree, i, hashes, cache, &piece_polygons[i]);
+        }
+      });
+    }
+    group.Wait();
+  }
+  bool colored = false;
+  for (const ConvexPolytope& piece : pieces) {
+    colored = colored || piece.color != 0;
+  }
+  std::vector<std::vector<glm::dvec3>> polygons;
+  std::vector<PackedColor> polygon_colors;
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    for (auto& polygon : piece_polygons[i]) {
+      polygons.push_back(std::move(polygon));
+      polygon_colors.push_back(pieces[i].color);
+    }
+  }
+
+  VertexWelder welder(kWeldTolerance);
+  std::vector<std::vector<uint32_t>> loops;
+  std::vector<PackedColor> loop_colors;
+  for (size_t i = 0; i < polygons.size(); ++i) {
+    const auto& polygon = polygons[i];
+    std::vector<uint32_t> loop;
+    for (const glm::dvec3& p : polygon) {
+      uint32_t index = welder.Add(p);
+      if (loop.empty() || loop.back() != index) {
+        loop.push_back(index);
+      }
+    }
+    while (loop.size() > 1 && loop.front() == loop.back()) {
+      loop.pop_back();
+    }
+    if (loop.size() >= 3) {
+      loops.push_back(std::move(loop));
+      loop_colors.push_back(polygon_colors[i]);
+    }
+  }
+
+  Mesh mesh;
+  mesh.vertices = welder.TakeVertices();
+  TJunctionSplitter splitter(mesh.vertices);
+  for (auto& loop : loops) {
+    splitter.Split(&loop);
+  }
+
+  for (size_t l = 0; l < loops.size(); ++l) {
+    const auto& loop = loops[l];
+    if (IsSliver(mesh.vertices, loop)) {
+      continue;
+    }
+    if (!HasCollinearCorner(mesh.vertices, loop)) {
+      for (size_t i = 1; i + 1 < loop.size(); ++i) {
+        mesh.triangles.push_back({loop[0], loop[i], loop[i + 1]});
+      }
+    } else {
+      // Fan from the centroid so that points inserted along an edge do not create zero area
+      // triangles.
+      glm::dvec3 center(0);
+      for (uint32_t v : loop) {
+        center += mesh.vertices[v];
+      }
+      center /= static_cast<double>(loop.size());
+      uint32_t c = static_cast<uint32_t>(mesh.vertices.size());
+      mesh.vertices.push_back(center);
+      for (size_t i = 0; i < loop.size(); ++i) {
+        mesh.triangles.push_back({c, loop[i], loop[(i + 1) % loop.size()]});
+      }
+    }
+    if (colored) {
+      mesh.colors.resize(mesh.triangles.size(), loop_colors[l]);
+    }
+  }
+  RemoveOpposingPairs(&mesh);
+  return mesh;
+}
+
+
+}  // namespace scad
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+#include "convex.h"
+#include "generation_cache.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace scad {
+
+// Computes the boundary of the union of a list of convex pieces. Most of the case (hulls, switch
+// walls, cylinders) is a union of convex pieces so this avoids a general boolean engine. Pieces are
+// indexed by a bounding volume hierarchy and the faces of each piece are only clipped against the
+// planes of the pieces which overlap it. The surviving facets are welded, T-junctions are split
+// and the result is returned as a single triangle mesh.
+//
+// Faces shared by two pieces facing the same way are kept once (from the lower indexed piece) and
+// faces where two pieces touch back to back are removed. Pieces are clipped in parallel on the pool
+// if one is given.
+//
+// The clipped facets of a piece only depend on the piece and the pieces overlapping it. With a
+// cache they are remembered under a hash of those so that after a local change (e.g. moving one
+// key) only the pieces in the changed region are clipped again.
+using UnionCache = GenerationCache<std::shared_ptr<const std::vector<std::vector<glm::dvec3>>>>;
+Mesh UnionConvex(const std::vector<ConvexPolytope>& pieces,
+                 ThreadPool* pool = nullptr,
+                 UnionCache* cache = nullptr);
+
+}  // namespace scad
@@ -0,0 +1,192 @@
+#include "disk_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "evaluator.h"
+#include "hash.h"
+#include "scad.h"
+
+namespace fs = std::filesystem;
+
+namespace scad {
+namespace {
+
+// Changing how shapes are rendered invalidates the stls in existing caches.
+const uint64_t kRenderVersion = 1;
+
+std::string KeyName(uint64_t key) {
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+  return name;
+}
+
+}  // namespace
+
+DiskCache::DiskCache(std::string directory, uint64_t max_bytes)
+    : directory_(std::move(directory)), max_bytes_(max_bytes) {
+  std::error_code error;
+  fs::create_directories(directory_, error);
+  if (error) {
+    fprintf(stderr, "Could not create cache directory %s\n", directory_.c_str());
+  }
+}
+
+std::string DiskCache::Path(uint64_t key, const std::string& extension) const {
+  // Entries are spread over 256 sub directories to keep the directories small.
+  std::string name = KeyName(key);
+  return (fs::path(directory_) / name.substr(0, 2) / (name + "." + extension)).string();
+}
+
+bool DiskCache::Touch(uint64_t key, const std::string& extension) {
+  std::error_code error;
+  fs::last_write_time(Path(key, extension), fs::file_time_type::clock::now(), error);
+  return !error;
+}
+
+bool DiskCache::Load(uint64_t key, const std::string& extension, std::string* data) {
+  std::ifstream file(Path(key, extension), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  if (!file) {
+    return false;
+  }
+  *data = contents.str();
+  Touch(key, extension);
+  return true;
+}
+
+bool DiskCache::Store(uint64_t key, const std::string& extension, const std::string& data) {
+  std::string temp = TempPath(extension);
+  {
+    std::ofstream file(temp, std::ios::binary);
+    file.write(data.data(), data.size());
+    if (!file) {
+      fprintf(stderr, "Could not write cache file %s\n", temp.c_str());
+      std::error_code error;
+      fs::remove(temp, error);
+      return false;
+    }
+  }
+  return Adopt(key, extension, temp);
+}
+
+bool DiskCache::Adopt(uint64_t key, const std::string& extension, const std::string& file_name) {
+  std::string path = Path(key, extension);
+  std::error_code error;
+  uint64_t bytes = fs::file_size(file_name, error);
+  if (!error) {
+    fs::create_directories(fs::path(path).parent_path(), error);
+  }
+  if (!error) {
+    // Atomic so readers see either no entry or the whole file.
+    fs::rename(file_name, path, error);
+  }
+  if (error) {
+    fprintf(stderr, "Could not add %s to the cache\n", file_name.c_str());
+    fs::remove(file_name, error);
+    return false;
+  }
+  Added(bytes);
+  return true;
+}
+
+std::string DiskCache::TempPath(const std::string& extension) {
+  uint64_t counter;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counter = temp_counter_++;
+  }
+  // Other processes may use the same directory.
+  static const uint64_t process_id = std::random_device()();
+  return (fs::path(directory_) /
+          ("tmp-" + KeyName(HashCombine(process_id, counter)) + "." + extension))
+      .string();
+}
+
+void DiskCache::Added(uint64_t bytes) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (total_bytes_ >= 0) {
+      total_bytes_ += bytes;
+      if (static_cast<uint64_t>(total_bytes_) <= max_bytes_) {
+        return;
+      }
+    }
+  }
+  Evict();
+}
+
+void DiskCache::Evict() {
+  struct Entry {
+    fs::file_time_type time;
+    uint64_t bytes;
+    fs::path path;
+  };
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  std::error_code error;
+  for (fs::recursive_directory_iterator it(directory_, error), end; !error && it != end;
+       it.increment(error)) {
+    if (!it->is_regular_file(error)) {
+      continue;
+    }
+    Entry entry = {it->last_write_time(error), it->file_size(error), it->path()};
+    if (!error) {
+      total += entry.bytes;
+      entries.push_back(std::move(entry));
+    }
+  }
+  if (total > max_bytes_) {
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+      return a.time < b.time;
+    });
+    uint64_t target = max_bytes_ / 4 * 3;
+    for (const Entry& entry : entries) {
+      if (total <= target) {
+        break;
+      }
+      // Another process may have removed it already.
+      if (fs::remove(entry.path, error)) {
+        total -= entry.bytes;
+      }
+    }
+  }
+  total_bytes_ = static_cast<int64_t>(total);
+}
+
+Shape RenderCached(const Shape& shape, DiskCache* cache, const std::string& openscad) {
+  uint64_t key = HashCombine(HashShape(shape), kRenderVersion);
+  if (!cache->Touch(key, "stl")) {
+    std::string scad_file = cache->TempPath("scad");
+    std::string stl_file = cache->TempPath("stl");
+    shape.WriteToFile(scad_file);
+    std::string command = openscad + " -o \"" + stl_file + "\" \"" + scad_file + "\"";
+    int status = std::system(command.c_str());
+    std::error_code error;
+    fs::remove(scad_file, error);
+    if (status != 0 || !fs::exists(stl_file, error)) {
+      fprintf(stderr, "Could not render %s with %s\n", KeyName(key).c_str(), openscad.c_str());
+      fs::remove(stl_file, error);
+      return shape;
+    }
+    if (!cache->Adopt(key, "stl", stl_file)) {
+      return shape;
+    }
+  }
+  return Import(fs::absolute(cache->Path(key, "stl")).generic_string());
+}
+
+}  // namespace scad
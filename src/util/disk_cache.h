@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "scad.h"
+
+namespace scad {
+
+// A content addressed cache of files in a directory. Entries are named by a 64 bit structural
+// hash (see HashShape) and an extension, e.g. "mesh" for meshes from the native evaluator and
+// "stl" for openscad renders. Nothing but the name identifies an entry so the directory can be
+// shared between runs, CI and developer machines, e.g. over a network drive.
+//
+// Entries are written to a temporary file and renamed into place so concurrent writers never
+// expose partial files. The modification time of an entry is its last use; when the directory
+// grows past the size cap the least recently used entries are removed until it is under
+// three quarters of the cap.
+class DiskCache {
+ public:
+  static constexpr uint64_t kDefaultMaxBytes = uint64_t{2} << 30;
+
+  explicit DiskCache(std::string directory, uint64_t max_bytes = kDefaultMaxBytes);
+
+  const std::string& directory() const {
+    return directory_;
+  }
+
+  // Path the entry is stored at, whether or not it exists.
+  std::string Path(uint64_t key, const std::string& extension) const;
+
+  // Returns whether the entry exists and marks it as used.
+  bool Touch(uint64_t key, const std::string& extension);
+
+  // Reads the entry and marks it as used. Returns false if there is no such entry.
+  bool Load(uint64_t key, const std::string& extension, std::string* data);
+
+  bool Store(uint64_t key, const std::string& extension, const std::string& data);
+
+  // Moves a file written elsewhere (e.g. by openscad) into the cache as the entry.
+  bool Adopt(uint64_t key, const std::string& extension, const std::string& file_name);
+
+  // Removes the least recently used entries until the cache is under the size cap.
+  void Evict();
+
+  // A file name next to the entries which is unique to this call, for building entries.
+  std::string TempPath(const std::string& extension);
+
+ private:
+  // Accounts for a new entry and evicts if the cache might be over the cap.
+  void Added(uint64_t bytes);
+
+  std::string directory_;
+  uint64_t max_bytes_;
+  std::mutex mutex_;
+  // Estimated size of the directory, -1 until it has been scanned. Other processes may add
+  // entries so this is only used to decide when to scan again.
+  int64_t total_bytes_ = -1;
+  uint64_t temp_counter_ = 0;
+};
+
+// Renders the shape to an stl with openscad and returns an import of it. The stl is kept in the
+// cache under the structural hash of the shape so later runs (and other machines sharing the
+// cache) skip rendering unchanged subtrees. If openscad fails the shape is returned unchanged.
+Shape SCAD_WARN_UNUSED_RESULT RenderCached(const Shape& shape,
+                                           DiskCache* cache,
+                                           const std::string& openscad = "openscad");
+
+}  // namespace scad
@@ -0,0 +1,1475 @@
+#include "evaluator.h"
+
+// Windows!
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "box_tree.h"
+#include "color.h"
+#include "convex.h"
+#include "convex_union.h"
+#include "disk_cache.h"
+#include "generation_cache.h"
+#include "hash.h"
+#include "import.h"
+#include "mesh_repair.h"
+#include "polygon.h"
+#include "scad.h"
+#include "sdf.h"
+#include "serialize.h"
+#include "thread_pool.h"
+
+namespace scad {
+namespace {
+
+// openscad's defaults for $fa and $fs.
+const double kDefaultFa = 12;
+const double kDefaultFs = 2;
+
+// Cached results which weren't used by this many calls to the evaluator are dropped. Two keeps
+// the results for both halves when they are evaluated alternately.
+const uint64_t kCacheGenerations = 2;
+
+// Only results of subtrees with at least this many nodes are kept in the disk cache. Smaller ones
+// are cheaper to evaluate again than to read back.
+const uint64_t kDiskCacheMinNodes = 64;
+
+// Changing the encoding or the way shapes are evaluated invalidates existing disk caches.
+const uint64_t kDiskCacheVersion = 8;
+const uint32_t kGeometryMagic = 0x4d4f4547;  // "GEOM"
+
+const char* OpName(ShapeOp op) {
+  switch (op) {
+    case ShapeOp::kOpaque:
+      return "opaque shape";
+    case ShapeOp::kCube:
+      return "cube";
+    case ShapeOp::kSphere:
+      return "sphere";
+    case ShapeOp::kCylinder:
+      return "cylinder";
+    case ShapeOp::kSquare:
+      return "square";
+    case ShapeOp::kCircle:
+      return "circle";
+    case ShapeOp::kPolygon:
+      return "polygon";
+    case ShapeOp::kPolyhedron:
+      return "polyhedron";
+    case ShapeOp::kImport:
+      return "import";
+    case ShapeOp::kRoundedHull:
+      return "rounded hull";
+    case ShapeOp::kTranslate:
+      return "translate";
+    case ShapeOp::kRotate:
+    case ShapeOp::kRotateAxis:
+      return "rotate";
+    case ShapeOp::kMirror:
+      return "mirror";
+    case ShapeOp::kScale:
+      return "scale";
+    case ShapeOp::kColor:
+      return "color";
+    case ShapeOp::kComment:
+      return "comment";
+    case ShapeOp::kLinearExtrude:
+      return "linear_extrude";
+    case ShapeOp::kProjection:
+      return "projection";
+    case ShapeOp::kOffsetRadius:
+    case ShapeOp::kOffsetDelta:
+      return "offset";
+    case ShapeOp::kUnion:
+      return "union";
+    case ShapeOp::kDifference:
+      return "difference";
+    case ShapeOp::kIntersection:
+      return "intersection";
+    case ShapeOp::kHull:
+      return "hull";
+    case ShapeOp::kMinkowski:
+      return "minkowski";
+    case ShapeOp::kSdf:
+      return "sdf";
+    case ShapeOp::kShell:
+      return "shell";
+    case ShapeOp::kSmoothUnion:
+      return "smooth union";
+    case ShapeOp::kSmoothDifference:
+      return "smooth difference";
+    case ShapeOp::kSmoothIntersection:
+      return "smooth intersection";
+  }
+  return "unknown";
+}
+
+double ArgOr(double value, double fallback) {
+  return std::isnan(value) ? fallback : value;
+}
+
+// The number of segments openscad uses for a circle of radius r.
+int Fragments(double r, double fn, double fa, double fs) {
+  if (r < 0.00000095367431640625) {
+    return 3;
+  }
+  if (fn > 0) {
+    return fn >= 3 ? static_cast<int>(fn) : 3;
+  }
+  return static_cast<int>(std::ceil(std::fmax(std::fmin(360.0 / fa, r * 2 * M_PI / fs), 5)));
+}
+
+void AddCircle(double r, double z, int fragments, std::vector<glm::dvec3>* points) {
+  for (int i = 0; i < fragments; ++i) {
+    double phi = (2 * M_PI * i) / fragments;
+    points->push_back({r * std::cos(phi), r * std::sin(phi), z});
+  }
+}
+
+GeometryPtr FromPolytope(ConvexPolytope polytope) {
+  auto geometry = std::make_shared<Geometry>();
+  if (!polytope.empty()) {
+    geometry->pieces.push_back(std::move(polytope));
+  }
+  return geometry;
+}
+
+GeometryPtr MakeCube(const ShapeNode& node) {
+  glm::dvec3 size(node.args[0], node.args[1], node.args[2]);
+  glm::dvec3 min = node.args[3] != 0 ? size * -0.5 : glm::dvec3(0);
+  std::vector<glm::dvec3> points;
+  for (int i = 0; i < 8; ++i) {
+    points.push_back(min + glm::dvec3(i & 1 ? size.x : 0, i & 2 ? size.y : 0, i & 4 ? size.z : 0));
+  }
+  return FromPolytope(ConvexHull(points));
+}
+
+GeometryPtr MakeSphere(const ShapeNode& node) {
+  double r = node.args[0];
+  int fragments = Fragments(r,
+                            ArgOr(node.args[1], 0),
+                            ArgOr(node.args[2], kDefaultFa),
+                            ArgOr(node.args[3], kDefaultFs));
+  int rings = (fragments + 1) / 2;
+  std::vector<glm::dvec3> points;
+  for (int i = 0; i < rings; ++i) {
+    double phi = (M_PI * (i + 0.5)) / rings;
+    AddCircle(r * std::sin(phi), r * std::cos(phi), fragments, &points);
+  }
+  return FromPolytope(ConvexHull(points));
+}
+
+GeometryPtr MakeCylinder(const ShapeNode& node) {
+  double h = node.args[0];
+  double r1 = node.args[1];
+  double r2 = node.args[2];
+  double z1 = node.args[3] != 0 ? -h / 2 : 0;
+  int fragments = Fragments(std::max(r1, r2),
+                            ArgOr(node.args[4], 0),
+                            ArgOr(node.args[5], kDefaultFa),
+                            ArgOr(node.args[6], kDefaultFs));
+  std::vector<glm::dvec3> points;
+  AddCircle(r1, z1, r1 > 0 ? fragments : 1, &points);
+  AddCircle(r2, z1 + h, r2 > 0 ? fragments : 1, &points);
+  return FromPolytope(ConvexHull(points));
+}
+
+GeometryPtr MakePolyhedron(const ShapeNode& node) {
+  std::vector<glm::dvec3> points;
+  for (const Point3d& p : node.points) {
+    points.push_back({p.x, p.y, p.z});
+  }
+  // Only convex polyhedra are supported. Every point has to be behind the plane of every face.
+  for (const auto& face : node.faces) {
+    std::vector<glm::dvec3> polygon;
+    for (int index : face) {
+      if (index < 0 || index >= static_cast<int>(points.size())) {
+        fprintf(stderr, "Polyhedron face index %d is out of range\n", index);
+        return nullptr;
+      }
+      polygon.push_back(points[index]);
+    }
+    // openscad polyhedron faces are clockwise when viewed from the outside.
+    std::reverse(polygon.begin(), polygon.end());
+    Plane plane = Plane::FromPolygon(polygon);
+    for (const glm::dvec3& p : points) {
+      if (plane.Distance(p) > kGeometryEpsilon * 100) {
+        fprintf(stderr, "Native evaluation only supports convex polyhedra\n");
+        return nullptr;
+      }
+    }
+  }
+  return FromPolytope(ConvexHull(points));
+}
+
+GeometryPtr MakeRoundedHull(const ShapeNode& node) {
+  double r = node.args[0];
+  std::vector<glm::dvec3> points;
+  for (const Point3d& p : node.points) {
+    points.push_back({p.x, p.y, p.z});
+  }
+  int fragments = Fragments(r, ArgOr(node.args[1], 0), kDefaultFa, kDefaultFs);
+  return FromPolytope(RoundedConvexHull(points, r, fragments));
+}
+
+GeometryPtr FromPolygons(Paths polygons) {
+  auto geometry = std::make_shared<Geometry>();
+  geometry->polygons = std::move(polygons);
+  return geometry;
+}
+
+GeometryPtr MakeSquare(const ShapeNode& node) {
+  glm::dvec2 size(node.args[0], node.args[1]);
+  if (size.x <= 0 || size.y <= 0) {
+    return FromPolygons({});
+  }
+  glm::dvec2 min = node.args[2] != 0 ? size * -0.5 : glm::dvec2(0);
+  glm::dvec2 max = min + size;
+  Path path = {min, glm::dvec2(max.x, min.y), max, glm::dvec2(min.x, max.y)};
+  return FromPolygons({path});
+}
+
+GeometryPtr MakeCircle(const ShapeNode& node) {
+  double r = node.args[0];
+  if (r <= 0) {
+    return FromPolygons({});
+  }
+  int fragments = Fragments(r,
+                            ArgOr(node.args[1], 0),
+                            ArgOr(node.args[2], kDefaultFa),
+                            ArgOr(node.args[3], kDefaultFs));
+  Path path;
+  for (int i = 0; i < fragments; ++i) {
+    double phi = (2 * M_PI * i) / fragments;
+    path.push_back({r * std::cos(phi), r * std::sin(phi)});
+  }
+  return FromPolygons({path});
+}
+
+GeometryPtr MakePolygon(const ShapeNode& node) {
+  Path path;
+  for (const Point3d& p : node.points) {
+    path.push_back({p.x, p.y});
+  }
+  return FromPolygons(UnionPolygons({path}));
+}
+
+GeometryPtr TransformGeometry(const Geometry& in, const glm::dmat4& transform) {
+  auto geometry = std::make_shared<Geometry>();
+  geometry->pieces.reserve(in.pieces.size());
+  for (const ConvexPolytope& piece : in.pieces) {
+    ConvexPolytope transformed = TransformPolytope(piece, transform);
+    if (!transformed.empty()) {
+      geometry->pieces.push_back(std::move(transformed));
+    }
+  }
+  // 2D shapes only see the xy part of the transform, which may flip them on its own.
+  double xy_determinant = transform[0][0] * transform[1][1] - transform[0][1] * transform[1][0];
+  if (xy_determinant != 0) {
+    geometry->polygons = in.polygons;
+  }
+  for (Path& path : geometry->polygons) {
+    for (glm::dvec2& p : path) {
+      p = glm::dvec2(transform * glm::dvec4(p, 0, 1));
+    }
+    if (xy_determinant < 0) {
+      std::reverse(path.begin(), path.end());
+    }
+  }
+  bool flip = glm::determinant(glm::dmat3(transform)) < 0;
+  geometry->meshes = in.meshes;
+  for (Mesh& mesh : geometry->meshes) {
+    for (glm::dvec3& v : mesh.vertices) {
+      v = glm::dvec3(transform * glm::dvec4(v, 1));
+    }
+    if (flip) {
+      for (auto& t : mesh.triangles) {
+        std::swap(t[1], t[2]);
+      }
+    }
+  }
+  return geometry;
+}
+
+GeometryPtr ImportGeometry(const ShapeNode& node, ThreadPool* pool) {
+  Mesh imported;
+  if (!ImportMesh(node.text, &imported)) {
+    return nullptr;
+  }
+  // Exported stls often have cracks, slivers and flipped triangles which break the convexity test
+  // and the parity of ray crossings.
+  MeshRepairStats stats;
+  Mesh mesh = RepairMesh(imported, MeshRepairOptions(), pool, &stats);
+  if (!mesh.empty() && !stats.after.closed()) {
+    fprintf(stderr,
+            "Imported mesh %s is not closed: %zu boundary, %zu non manifold and %zu misoriented "
+            "edges\n",
+            node.text.c_str(),
+            stats.after.boundary_edges,
+            stats.after.non_manifold_edges,
+            stats.after.misoriented_edges);
+  }
+  // Convex parts, e.g. simple blocks, can take part in every operation.
+  auto geometry = std::make_shared<Geometry>();
+  ConvexPolytope piece;
+  if (ConvexFromMesh(mesh, &piece)) {
+    geometry->pieces.push_back(std::move(piece));
+  } else if (!mesh.empty()) {
+    geometry->meshes.push_back(std::move(mesh));
+  }
+  return geometry;
+}
+
+void ReportMeshes(const ShapeNode& node) {
+  fprintf(stderr,
+          "Native evaluation does not support %s with non convex imports\n",
+          OpName(node.op));
+}
+
+// Reports shapes which would need a general boolean with an imported mesh.
+bool CheckNoMeshes(const ShapeNode& node, const std::vector<GeometryPtr>& children) {
+  for (const GeometryPtr& child : children) {
+    if (!child->meshes.empty()) {
+      ReportMeshes(node);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Like openscad, 2D and 3D shapes can't be combined. Sets flat if the children are 2D.
+bool CheckDimensions(const ShapeNode& node, const std::vector<GeometryPtr>& children, bool* flat) {
+  bool solid = false;
+  *flat = false;
+  for (const GeometryPtr& child : children) {
+    solid = solid || !child->pieces.empty() || !child->meshes.empty();
+    *flat = *flat || !child->polygons.empty();
+  }
+  if (solid && *flat) {
+    fprintf(stderr, "Native evaluation does not support %s of 2D and 3D shapes\n", OpName(node.op));
+    return false;
+  }
+  return true;
+}
+
+GeometryPtr PolygonGeometry(PolygonOp op, const std::vector<GeometryPtr>& children) {
+  std::vector<Paths> operands;
+  for (const GeometryPtr& child : children) {
+    operands.push_back(child->polygons);
+  }
+  return FromPolygons(PolygonBoolean(op, operands));
+}
+
+GeometryPtr PolygonHull(const std::vector<GeometryPtr>& children) {
+  std::vector<glm::dvec2> points;
+  for (const GeometryPtr& child : children) {
+    for (const Path& path : child->polygons) {
+      points.insert(points.end(), path.begin(), path.end());
+    }
+  }
+  Path hull = ConvexHull2d(std::move(points));
+  return FromPolygons(hull.empty() ? Paths() : Paths{hull});
+}
+
+// offset(r) rounds the corners with as many segments as a circle of the same radius would have.
+GeometryPtr OffsetGeometry(const ShapeNode& node, const Geometry& child) {
+  if (!child.pieces.empty() || !child.meshes.empty()) {
+    fprintf(stderr, "Native evaluation does not support %s of 3D shapes\n", OpName(node.op));
+    return nullptr;
+  }
+  double amount = node.args[0];
+  if (node.op == ShapeOp::kOffsetRadius) {
+    int fragments = Fragments(std::abs(amount), 0, kDefaultFa, kDefaultFs);
+    return FromPolygons(OffsetPolygons(child.polygons, amount, JoinType::kRound, fragments));
+  }
+  JoinType join = node.args[1] != 0 ? JoinType::kSquare : JoinType::kMiter;
+  return FromPolygons(OffsetPolygons(child.polygons, amount, join));
+}
+
+// The outline of a convex piece seen from above, or its section by the xy plane with cut.
+Path ProjectPolytope(const ConvexPolytope& piece, bool cut) {
+  std::vector<glm::dvec2> points;
+  if (!cut) {
+    for (const glm::dvec3& v : piece.Vertices()) {
+      points.push_back(glm::dvec2(v));
+    }
+    return ConvexHull2d(std::move(points));
+  }
+  for (const ConvexFace& face : piece.faces) {
+    for (size_t i = 0; i < face.points.size(); ++i) {
+      const glm::dvec3& a = face.points[i];
+      const glm::dvec3& b = face.points[(i + 1) % face.points.size()];
+      if (a.z == 0) {
+        points.push_back(glm::dvec2(a));
+      } else if ((a.z < 0) != (b.z < 0) && b.z != 0) {
+        double t = a.z / (a.z - b.z);
+        points.push_back(glm::dvec2(a + (b - a) * t));
+      }
+    }
+  }
+  return ConvexHull2d(std::move(points));
+}
+
+// projection() is the union of the outlines of the pieces and the triangles of the meshes. A
+// single convex piece, e.g. a plate built as one hull, is just the hull of its projected corners.
+GeometryPtr ProjectGeometry(const ShapeNode& node, const Geometry& child) {
+  if (!child.polygons.empty()) {
+    fprintf(stderr, "Native evaluation does not support %s of 2D shapes\n", OpName(node.op));
+    return nullptr;
+  }
+  bool cut = node.args[0] != 0;
+  if (cut && !child.meshes.empty()) {
+    ReportMeshes(node);
+    return nullptr;
+  }
+  std::vector<Paths> operands;
+  for (const ConvexPolytope& piece : child.pieces) {
+    Path outline = ProjectPolytope(piece, cut);
+    if (outline.size() >= 3) {
+      operands.push_back({std::move(outline)});
+    }
+  }
+  if (operands.size() == 1 && child.meshes.empty()) {
+    return FromPolygons(std::move(operands[0]));
+  }
+  for (const Mesh& mesh : child.meshes) {
+    for (const auto& t : mesh.triangles) {
+      Path triangle = {glm::dvec2(mesh.vertices[t[0]]),
+                       glm::dvec2(mesh.vertices[t[1]]),
+                       glm::dvec2(mesh.vertices[t[2]])};
+      double area = SignedArea(triangle);
+      if (area < 0) {
+        std::reverse(triangle.begin(), triangle.end());
+      }
+      if (area != 0) {
+        operands.push_back({std::move(triangle)});
+      }
+    }
+  }
+  return FromPolygons(PolygonBoolean(PolygonOp::kUnion, operands));
+}
+
+// linear_extrude() builds a piece for each convex part of the polygon and each slice, the hull of
+// the part at the bottom and at the top of the slice. Without twist that is exact, scaled or not,
+// and one slice is enough. Twisted slices are hulls where openscad splits the sides into
+// triangles, which bulge out a little between the corners of the slice.
+GeometryPtr ExtrudeGeometry(const ShapeNode& node, const Geometry& child) {
+  if (!child.pieces.empty() || !child.meshes.empty()) {
+    fprintf(stderr, "Native evaluation does not support %s of 3D shapes\n", OpName(node.op));
+    return nullptr;
+  }
+  double height = node.args[0];
+  if (height <= 0 || child.polygons.empty()) {
+    return std::make_shared<Geometry>();
+  }
+  double bottom = node.args[1] != 0 ? -height / 2 : 0;
+  double twist = node.args[3];
+  int slices = twist == 0 ? 1 : std::max(1, static_cast<int>(node.args[4]));
+  double scale = node.args[5];
+  Paths parts = ConvexPartition(child.polygons);
+  // Openscad twists clockwise seen from above.
+  auto ring = [&](const Path& part, int slice, std::vector<glm::dvec3>* points) {
+    double t = static_cast<double>(slice) / slices;
+    double factor = 1 + (scale - 1) * t;
+    double angle = glm::radians(-twist * t);
+    double c = std::cos(angle);
+    double s = std::sin(angle);
+    for (const glm::dvec2& p : part) {
+      glm::dvec2 q = p * factor;
+      points->push_back({q.x * c - q.y * s, q.x * s + q.y * c, bottom + height * t});
+    }
+  };
+  auto geometry = std::make_shared<Geometry>();
+  for (const Path& part : parts) {
+    for (int slice = 0; slice < slices; ++slice) {
+      std::vector<glm::dvec3> points;
+      ring(part, slice, &points);
+      ring(part, slice + 1, &points);
+      ConvexPolytope piece = ConvexHull(points);
+      if (!piece.empty()) {
+        geometry->pieces.push_back(std::move(piece));
+      }
+    }
+  }
+  return geometry;
+}
+
+GeometryPtr HullGeometry(const std::vector<GeometryPtr>& children) {
+  std::vector<glm::dvec3> points;
+  for (const GeometryPtr& child : children) {
+    for (const ConvexPolytope& piece : child->pieces) {
+      for (const ConvexFace& face : piece.faces) {
+        points.insert(points.end(), face.points.begin(), face.points.end());
+      }
+    }
+    for (const Mesh& mesh : child->meshes) {
+      points.insert(points.end(), mesh.vertices.begin(), mesh.vertices.end());
+    }
+  }
+  ConvexPolytope hull = ConvexHull(points);
+  // The hull takes the first color among its children.
+  for (const GeometryPtr& child : children) {
+    for (const ConvexPolytope& piece : child->pieces) {
+      if (hull.color == 0) {
+        hull.color = piece.color;
+      }
+    }
+  }
+  return FromPolytope(std::move(hull));
+}
+
+// Colors every piece. Like openscad an alpha on its own only changes the alpha of colors already
+// given.
+// The sum of two convex shapes is the hull of the sums of their corners. The sums are written
+// into one flat array by a loop without branches, which the compiler vectorizes.
+std::vector<glm::dvec3> SumCorners(const std::vector<glm::dvec3>& a,
+                                   const std::vector<glm::dvec3>& b) {
+  std::vector<glm::dvec3> sums(a.size() * b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    glm::dvec3* out = sums.data() + i * b.size();
+    for (size_t j = 0; j < b.size(); ++j) {
+      out[j] = a[i] + b[j];
+    }
+  }
+  return sums;
+}
+
+// Minkowski sums distribute over unions so the sum of two shapes is the union of the sums of every
+// pair of their convex pieces, or of the convex parts of their polygons.
+GeometryPtr PolygonMinkowski(const std::vector<GeometryPtr>& children) {
+  Paths sum = children[0]->polygons;
+  for (size_t c = 1; c < children.size(); ++c) {
+    std::vector<Paths> operands;
+    Paths parts = ConvexPartition(sum);
+    for (const Path& other : ConvexPartition(children[c]->polygons)) {
+      for (const Path& part : parts) {
+        std::vector<glm::dvec2> points;
+        for (const glm::dvec2& p : part) {
+          for (const glm::dvec2& q : other) {
+            points.push_back(p + q);
+          }
+        }
+        operands.push_back({ConvexHull2d(std::move(points))});
+      }
+    }
+    sum = PolygonBoolean(PolygonOp::kUnion, operands);
+  }
+  return FromPolygons(std::move(sum));
+}
+
+GeometryPtr MinkowskiGeometry(const ShapeNode& node,
+                              const std::vector<GeometryPtr>& children,
+                              ThreadPool* pool) {
+  if (!CheckNoMeshes(node, children)) {
+    return nullptr;
+  }
+  std::vector<ConvexPolytope> sum = children[0]->pieces;
+  for (size_t c = 1; c < children.size(); ++c) {
+    const std::vector<ConvexPolytope>& pieces = children[c]->pieces;
+    std::vector<std::vector<glm::dvec3>> corners;
+    for (const ConvexPolytope& piece : pieces) {
+      corners.push_back(piece.Vertices());
+    }
+    std::vector<ConvexPolytope> next(sum.size() * pieces.size());
+    {
+      TaskGroup group(pool);
+      for (size_t i = 0; i < sum.size(); ++i) {
+        group.Run([&, i] {
+          std::vector<glm::dvec3> vertices = sum[i].Vertices();
+          for (size_t j = 0; j < pieces.size(); ++j) {
+            ConvexPolytope& out = next[i * pieces.size() + j];
+            out = ConvexHull(SumCorners(vertices, corners[j]));
+            // Like a hull, the sum takes the first color of its operands.
+            out.color = sum[i].color != 0 ? sum[i].color : pieces[j].color;
+          }
+        });
+      }
+      group.Wait();
+    }
+    sum.clear();
+    for (ConvexPolytope& piece : next) {
+      if (!piece.empty()) {
+        sum.push_back(std::move(piece));
+      }
+    }
+  }
+  auto geometry = std::make_shared<Geometry>();
+  geometry->pieces = std::move(sum);
+  return geometry;
+}
+
+GeometryPtr ColorGeometry(const ShapeNode& node, const Geometry& child) {
+  double alpha = ArgOr(node.args[3], 1);
+  PackedColor color = 0;
+  if (!std::isnan(node.args[0])) {
+    color = PackColor(node.args[0], node.args[1], node.args[2], alpha);
+  } else if (!node.text.empty() && !ParseColor(node.text, alpha, &color)) {
+    fprintf(stderr, "Unknown color %s\n", node.text.c_str());
+    return std::make_shared<Geometry>(child);
+  }
+  auto geometry = std::make_shared<Geometry>(child);
+  auto recolor = [&](PackedColor old_color) {
+    if (color != 0) {
+      return color;
+    }
+    return old_color == 0 ? 0 : (old_color & 0xffffff00) | (PackColor(0, 0, 0, alpha) & 0xff);
+  };
+  for (ConvexPolytope& piece : geometry->pieces) {
+    piece.color = recolor(piece.color);
+  }
+  for (Mesh& mesh : geometry->meshes) {
+    mesh.colors.resize(mesh.triangles.size(), 0);
+    for (PackedColor& triangle_color : mesh.colors) {
+      triangle_color = recolor(triangle_color);
+    }
+  }
+  return geometry;
+}
+
+GeometryPtr DifferenceGeometry(const ShapeNode& node, const std::vector<GeometryPtr>& children) {
+  std::vector<GeometryPtr> subtrahends(children.begin() + 1, children.end());
+  if (!CheckNoMeshes(node, subtrahends)) {
+    return nullptr;
+  }
+  // Imported meshes in the minuend are fine as long as nothing is cut out of them.
+  for (const Mesh& mesh : children[0]->meshes) {
+    for (const GeometryPtr& child : subtrahends) {
+      if (mesh.Bounds().Overlaps(child->Bounds(), kGeometryEpsilon)) {
+        ReportMeshes(node);
+        return nullptr;
+      }
+    }
+  }
+  std::vector<ConvexPolytope> pieces = children[0]->pieces;
+  std::vector<ConvexPolytope> next;
+  for (size_t i = 1; i < children.size(); ++i) {
+    for (const ConvexPolytope& b : children[i]->pieces) {
+      next.clear();
+      for (const ConvexPolytope& a : pieces) {
+        SubtractPolytope(a, b, &next);
+      }
+      pieces.swap(next);
+    }
+  }
+  auto geometry = std::make_shared<Geometry>();
+  geometry->pieces = std::move(pieces);
+  geometry->meshes = children[0]->meshes;
+  return geometry;
+}
+
+GeometryPtr IntersectionGeometry(const ShapeNode& node, const std::vector<GeometryPtr>& children) {
+  if (!CheckNoMeshes(node, children)) {
+    return nullptr;
+  }
+  std::vector<ConvexPolytope> pieces = children[0]->pieces;
+  std::vector<ConvexPolytope> next;
+  for (size_t i = 1; i < children.size(); ++i) {
+    next.clear();
+    for (const ConvexPolytope& a : pieces) {
+      for (const ConvexPolytope& b : children[i]->pieces) {
+        ConvexPolytope piece = IntersectPolytopes(a, b);
+        if (!piece.empty()) {
+          next.push_back(std::move(piece));
+        }
+      }
+    }
+    pieces.swap(next);
+  }
+  auto geometry = std::make_shared<Geometry>();
+  geometry->pieces = std::move(pieces);
+  return geometry;
+}
+
+// Interleaves the low 10 bits of x, y and z.
+uint32_t MortonCode(uint32_t x, uint32_t y, uint32_t z) {
+  auto spread = [](uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+  };
+  return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+}
+
+std::vector<size_t> MortonOrder(const std::vector<GeometryPtr>& children) {
+  std::vector<glm::dvec3> centers;
+  Aabb range;
+  for (const GeometryPtr& child : children) {
+    Aabb box = child->Bounds();
+    centers.push_back(box.empty() ? glm::dvec3(0) : box.center());
+    range.Extend(centers.back());
+  }
+  glm::dvec3 extent = glm::max(range.size(), glm::dvec3(kGeometryEpsilon));
+  std::vector<std::pair<uint32_t, size_t>> codes;
+  for (size_t i = 0; i < centers.size(); ++i) {
+    glm::dvec3 t = (centers[i] - range.min) / extent * 1023.0;
+    codes.push_back({MortonCode(static_cast<uint32_t>(t.x),
+                                static_cast<uint32_t>(t.y),
+                                static_cast<uint32_t>(t.z)),
+                     i});
+  }
+  std::sort(codes.begin(), codes.end());
+  std::vector<size_t> order;
+  for (const auto& code : codes) {
+    order.push_back(code.second);
+  }
+  return order;
+}
+
+// Concatenates the pieces of both sides, dropping pieces which are entirely inside of a piece of
+// the other side. Identical pieces keep the copy from the left.
+GeometryPtr MergeUnion(const Geometry& left, const Geometry& right) {
+  auto geometry = std::make_shared<Geometry>();
+  geometry->meshes = left.meshes;
+  geometry->meshes.insert(geometry->meshes.end(), right.meshes.begin(), right.meshes.end());
+  if (left.pieces.empty() || right.pieces.empty()) {
+    geometry->pieces = left.pieces.empty() ? right.pieces : left.pieces;
+    return geometry;
+  }
+  auto bounds = [](const std::vector<ConvexPolytope>& pieces) {
+    std::vector<Aabb> boxes;
+    for (const ConvexPolytope& piece : pieces) {
+      boxes.push_back(piece.Bounds());
+    }
+    return boxes;
+  };
+  auto covered = [](const BoxTree& tree,
+                    const std::vector<ConvexPolytope>& pieces,
+                    const std::vector<char>& dropped,
+                    const ConvexPolytope& piece,
+                    const Aabb& box) {
+    std::vector<uint32_t> candidates;
+    tree.Query(box, &candidates);
+    for (uint32_t c : candidates) {
+      const Aabb& other = tree.boxes()[c];
+      if (!dropped[c] && other.Contains(box.min, kGeometryEpsilon) &&
+          other.Contains(box.max, kGeometryEpsilon) && ContainsPolytope(pieces[c], piece)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  BoxTree left_tree(bounds(left.pieces));
+  BoxTree right_tree(bounds(right.pieces));
+  std::vector<char> left_dropped(left.pieces.size(), 0);
+  std::vector<char> right_dropped(right.pieces.size(), 0);
+  for (size_t i = 0; i < right.pieces.size(); ++i) {
+    right_dropped[i] =
+        covered(left_tree, left.pieces, left_dropped, right.pieces[i], right_tree.boxes()[i]);
+  }
+  for (size_t i = 0; i < left.pieces.size(); ++i) {
+    left_dropped[i] =
+        covered(right_tree, right.pieces, right_dropped, left.pieces[i], left_tree.boxes()[i]);
+  }
+  for (size_t i = 0; i < left.pieces.size(); ++i) {
+    if (!left_dropped[i]) {
+      geometry->pieces.push_back(left.pieces[i]);
+    }
+  }
+  for (size_t i = 0; i < right.pieces.size(); ++i) {
+    if (!right_dropped[i]) {
+      geometry->pieces.push_back(right.pieces[i]);
+    }
+  }
+  return geometry;
+}
+
+GeometryPtr ReduceUnion(const std::vector<GeometryPtr>& children,
+                        const std::vector<size_t>& order,
+                        size_t begin,
+                        size_t end,
+                        ThreadPool* pool) {
+  if (end - begin == 1) {
+    return children[order[begin]];
+  }
+  size_t middle = begin + (end - begin) / 2;
+  GeometryPtr left;
+  GeometryPtr right;
+  {
+    TaskGroup group(pool);
+    group.Run([&] { left = ReduceUnion(children, order, begin, middle, pool); });
+    right = ReduceUnion(children, order, middle, end, pool);
+    group.Wait();
+  }
+  return MergeUnion(*left, *right);
+}
+
+// The children are merged by a balanced reduction tree over the children sorted along a Morton
+// curve of their centers. The shape of the tree only depends on the geometry so the result is the
+// same for any number of threads.
+GeometryPtr UnionGeometry(const std::vector<GeometryPtr>& children, ThreadPool* pool) {
+  return ReduceUnion(children, MortonOrder(children), 0, children.size(), pool);
+}
+
+void EncodeGeometry(const Geometry& geometry, std::string* out) {
+  PutU32(kGeometryMagic, out);
+  PutU32(static_cast<uint32_t>(geometry.pieces.size()), out);
+  for (const ConvexPolytope& piece : geometry.pieces) {
+    PutU32(piece.color, out);
+    PutU32(static_cast<uint32_t>(piece.faces.size()), out);
+    for (const ConvexFace& face : piece.faces) {
+      PutDouble(face.plane.normal.x, out);
+      PutDouble(face.plane.normal.y, out);
+      PutDouble(face.plane.normal.z, out);
+      PutDouble(face.plane.offset, out);
+      PutU32(static_cast<uint32_t>(face.points.size()), out);
+      for (const glm::dvec3& p : face.points) {
+        PutDouble(p.x, out);
+        PutDouble(p.y, out);
+        PutDouble(p.z, out);
+      }
+    }
+  }
+  PutU32(static_cast<uint32_t>(geometry.meshes.size()), out);
+  std::string encoded;
+  for (const Mesh& mesh : geometry.meshes) {
+    encoded.clear();
+    EncodeMesh(mesh, &encoded);
+    PutU64(encoded.size(), out);
+    out->append(encoded);
+  }
+  PutU32(static_cast<uint32_t>(geometry.polygons.size()), out);
+  for (const Path& path : geometry.polygons) {
+    PutU32(static_cast<uint32_t>(path.size()), out);
+    for (const glm::dvec2& p : path) {
+      PutDouble(p.x, out);
+      PutDouble(p.y, out);
+    }
+  }
+}
+
+GeometryPtr DecodeGeometry(const std::string& data) {
+  ByteReader reader(data);
+  if (reader.U32() != kGeometryMagic) {
+    return nullptr;
+  }
+  auto geometry = std::make_shared<Geometry>();
+  // Counts are checked against the remaining bytes so corrupt files can't cause huge allocations.
+  uint32_t num_pieces = reader.U32();
+  if (num_pieces > reader.remaining() / 8) {
+    return nullptr;
+  }
+  geometry->pieces.resize(num_pieces);
+  for (ConvexPolytope& piece : geometry->pieces) {
+    piece.color = reader.U32();
+    uint32_t num_faces = reader.U32();
+    if (num_faces > reader.remaining() / 36) {
+      return nullptr;
+    }
+    piece.faces.resize(num_faces);
+    for (ConvexFace& face : piece.faces) {
+      face.plane.normal.x = reader.Double();
+      face.plane.normal.y = reader.Double();
+      face.plane.normal.z = reader.Double();
+      face.plane.offset = reader.Double();
+      uint32_t num_points = reader.U32();
+      if (num_points > reader.remaining() / 24) {
+        return nullptr;
+      }
+      face.points.resize(num_points);
+      for (glm::dvec3& p : face.points) {
+        p.x = reader.Double();
+        p.y = reader.Double();
+        p.z = reader.Double();
+      }
+    }
+  }
+  uint32_t num_meshes = reader.U32();
+  for (uint32_t i = 0; i < num_meshes && reader.ok(); ++i) {
+    Mesh mesh;
+    if (!DecodeMesh(reader.Bytes(reader.U64()), &mesh)) {
+      return nullptr;
+    }
+    geometry->meshes.push_back(std::move(mesh));
+  }
+  uint32_t num_paths = reader.U32();
+  if (num_paths > reader.remaining() / 4) {
+    return nullptr;
+  }
+  geometry->polygons.resize(num_paths);
+  for (Path& path : geometry->polygons) {
+    uint32_t num_points = reader.U32();
+    if (num_points > reader.remaining() / 16) {
+      return nullptr;
+    }
+    path.resize(num_points);
+    for (glm::dvec2& p : path) {
+      p.x = reader.Double();
+      p.y = reader.Double();
+    }
+  }
+  if (!reader.ok() || reader.remaining() != 0) {
+    return nullptr;
+  }
+  return geometry;
+}
+
+// Hash of everything that determines the geometry of a node. Children contribute their own
+// hashes so equal subtrees built separately hash the same.
+uint64_t HashNode(const ShapeNode& node, const std::vector<uint64_t>& child_hashes) {
+  uint64_t hash = HashCombine(static_cast<uint64_t>(node.op), node.args.size());
+  for (double arg : node.args) {
+    hash = HashDouble(hash, arg);
+  }
+  hash = HashCombine(hash, node.points.size());
+  for (const Point3d& p : node.points) {
+    hash = HashDouble(HashDouble(HashDouble(hash, p.x), p.y), p.z);
+  }
+  hash = HashCombine(hash, node.faces.size());
+  for (const std::vector<int>& face : node.faces) {
+    hash = HashCombine(hash, face.size());
+    for (int index : face) {
+      hash = HashCombine(hash, static_cast<uint64_t>(index));
+    }
+  }
+  hash = HashString(hash, node.text);
+  if (node.op == ShapeOp::kImport) {
+    // The same file name may hold different geometry on another run or machine.
+    hash = HashCombine(hash, HashFile(node.text));
+  }
+  hash = HashCombine(hash, child_hashes.size());
+  for (uint64_t child_hash : child_hashes) {
+    hash = HashCombine(hash, child_hash);
+  }
+  return hash;
+}
+
+// Opaque shapes have no structure to hash. They can't be evaluated either so any fixed value
+// works.
+const uint64_t kOpaqueHash = HashMix(static_cast<uint64_t>(ShapeOp::kOpaque) + 1);
+
+uint64_t HashShapeNode(const ShapeNode* node,
+                       std::unordered_map<const ShapeNode*, uint64_t>* memo) {
+  if (!node) {
+    return kOpaqueHash;
+  }
+  auto it = memo->find(node);
+  if (it != memo->end()) {
+    return it->second;
+  }
+  std::vector<uint64_t> child_hashes;
+  for (const Shape& child : node->children) {
+    child_hashes.push_back(HashShapeNode(child.node(), memo));
+  }
+  uint64_t hash = HashNode(*node, child_hashes);
+  (*memo)[node] = hash;
+  return hash;
+}
+
+// Sdf nodes read their subtree themselves. Pieces are evaluated with a separate evaluator as they
+// are compiled, nodes below the blends don't exist in the graph of the outer one.
+GeometryPtr SdfGeometry(const ShapeNode& node, ThreadPool* pool) {
+  double cell_size = node.args[0];
+  if (!(cell_size > 0)) {
+    fprintf(stderr, "Distance fields need a positive cell size\n");
+    return nullptr;
+  }
+  Evaluator evaluator(pool);
+  auto evaluate_pieces = [&](const Shape& shape, std::vector<ConvexPolytope>* pieces) {
+    GeometryPtr geometry = evaluator.Evaluate(shape);
+    if (!geometry) {
+      return false;
+    }
+    if (!geometry->meshes.empty() || !geometry->polygons.empty()) {
+      fprintf(stderr, "Distance fields only support convex pieces and 3D primitives\n");
+      return false;
+    }
+    *pieces = geometry->pieces;
+    return true;
+  };
+  // The mesher evaluates corners and normals within two cell diagonals of the surface.
+  SdfProgram program;
+  if (!program.Compile(node.children[0], evaluate_pieces, 4 * cell_size, pool)) {
+    return nullptr;
+  }
+  auto geometry = std::make_shared<Geometry>();
+  Mesh mesh = MeshSdf(program, node.children[0].Bounds(), cell_size, pool);
+  if (!mesh.empty()) {
+    geometry->meshes.push_back(std::move(mesh));
+  }
+  return geometry;
+}
+
+// The wall is meshed from its distance field, which is exact near the surface for meshes as well as
+// for pieces.
+GeometryPtr ShellGeometry(const ShapeNode& node, const Geometry& child, ThreadPool* pool) {
+  double thickness = node.args[0];
+  double cell_size = node.args[1];
+  if (!(thickness > 0) || !(cell_size > 0)) {
+    fprintf(stderr, "Shells need a positive thickness and cell size\n");
+    return nullptr;
+  }
+  if (!child.polygons.empty()) {
+    fprintf(stderr, "Native evaluation does not support %s of 2D shapes\n", OpName(node.op));
+    return nullptr;
+  }
+  SdfProgram program;
+  program.CompileShell(child.pieces, child.meshes, thickness, 4 * cell_size, pool);
+  auto geometry = std::make_shared<Geometry>();
+  Mesh mesh = MeshSdf(program, node.children[0].Bounds(), cell_size, pool);
+  if (!mesh.empty()) {
+    geometry->meshes.push_back(std::move(mesh));
+  }
+  return geometry;
+}
+
+// Evaluates a node from the geometry of its children.
+GeometryPtr ComputeNode(const ShapeNode& node,
+                        const std::vector<GeometryPtr>& children,
+                        ThreadPool* pool) {
+  for (const GeometryPtr& child : children) {
+    if (!child) {
+      // Already reported.
+      return nullptr;
+    }
+  }
+  switch (node.op) {
+    case ShapeOp::kCube:
+      return MakeCube(node);
+    case ShapeOp::kSphere:
+      return MakeSphere(node);
+    case ShapeOp::kCylinder:
+      return MakeCylinder(node);
+    case ShapeOp::kPolyhedron:
+      return MakePolyhedron(node);
+    case ShapeOp::kSquare:
+      return MakeSquare(node);
+    case ShapeOp::kCircle:
+      return MakeCircle(node);
+    case ShapeOp::kPolygon:
+      return MakePolygon(node);
+    case ShapeOp::kImport:
+      return ImportGeometry(node, pool);
+    case ShapeOp::kRoundedHull:
+      return MakeRoundedHull(node);
+    case ShapeOp::kSdf:
+      return SdfGeometry(node, pool);
+    case ShapeOp::kTranslate:
+    case ShapeOp::kRotate:
+    case ShapeOp::kRotateAxis:
+    case ShapeOp::kMirror:
+    case ShapeOp::kScale:
+    case ShapeOp::kColor:
+    case ShapeOp::kComment:
+    case ShapeOp::kShell:
+    case ShapeOp::kUnion:
+    case ShapeOp::kDifference:
+    case ShapeOp::kIntersection:
+    case ShapeOp::kHull:
+    case ShapeOp::kOffsetRadius:
+    case ShapeOp::kOffsetDelta:
+    case ShapeOp::kLinearExtrude:
+    case ShapeOp::kProjection:
+    case ShapeOp::kMinkowski:
+    case ShapeOp::kSmoothUnion:
+    case ShapeOp::kSmoothDifference:
+    case ShapeOp::kSmoothIntersection:
+      break;
+    default:
+      fprintf(stderr, "Native evaluation does not support %s\n", OpName(node.op));
+      return nullptr;
+  }
+
+  if (children.empty()) {
+    return std::make_shared<Geometry>();
+  }
+  bool flat = false;
+  if (!CheckDimensions(node, children, &flat)) {
+    return nullptr;
+  }
+  if (flat) {
+    switch (node.op) {
+      case ShapeOp::kUnion:
+      case ShapeOp::kSmoothUnion:
+        return PolygonGeometry(PolygonOp::kUnion, children);
+      case ShapeOp::kDifference:
+      case ShapeOp::kSmoothDifference:
+        return PolygonGeometry(PolygonOp::kDifference, children);
+      case ShapeOp::kIntersection:
+      case ShapeOp::kSmoothIntersection:
+        return PolygonGeometry(PolygonOp::kIntersection, children);
+      case ShapeOp::kHull:
+        return PolygonHull(children);
+      case ShapeOp::kMinkowski:
+        return PolygonMinkowski(children);
+      default:
+        break;
+    }
+  }
+  switch (node.op) {
+    case ShapeOp::kOffsetRadius:
+    case ShapeOp::kOffsetDelta:
+      return OffsetGeometry(node, *children[0]);
+    case ShapeOp::kLinearExtrude:
+      return ExtrudeGeometry(node, *children[0]);
+    case ShapeOp::kProjection:
+      return ProjectGeometry(node, *children[0]);
+    case ShapeOp::kColor:
+      return ColorGeometry(node, *children[0]);
+    case ShapeOp::kComment:
+      return children[0];
+    case ShapeOp::kShell:
+      return ShellGeometry(node, *children[0], pool);
+    // Blends are only evaluated inside of sdf nodes, elsewhere they are sharp like in openscad.
+    case ShapeOp::kUnion:
+    case ShapeOp::kSmoothUnion:
+      return UnionGeometry(children, pool);
+    case ShapeOp::kDifference:
+    case ShapeOp::kSmoothDifference:
+      return DifferenceGeometry(node, children);
+    case ShapeOp::kIntersection:
+    case ShapeOp::kSmoothIntersection:
+      return IntersectionGeometry(node, children);
+    case ShapeOp::kHull:
+      return HullGeometry(children);
+    case ShapeOp::kMinkowski:
+      return MinkowskiGeometry(node, children, pool);
+    default:
+      return TransformGeometry(*children[0], node.AffineTransform());
+  }
+}
+
+// Evaluates every node reachable from a root exactly once. Each node counts the children it is
+// still waiting on and is run by whichever thread finishes its last child.
+//
+// Nodes are identified by their structural hash so equal subtrees built separately are evaluated
+// once. With a cache, nodes whose result is cached are not evaluated and neither is anything
+// below them. Results of large subtrees are also looked up in and added to the disk cache.
+class DagEvaluation {
+ public:
+  DagEvaluation(const ShapeNode& root,
+                ThreadPool* pool,
+                GenerationCache<GeometryPtr>* cache,
+                DiskCache* disk_cache)
+      : pool_(pool), cache_(cache), disk_cache_(disk_cache) {
+    Add(&root);
+  }
+
+  GeometryPtr Run() {
+    uint32_t pending = FindPending();
+    if (pending == 0) {
+      return entries_.back()->result;
+    }
+    if (!pool_) {
+      // Entries are added children first so this order is topological.
+      for (uint32_t i = 0; i < entries_.size(); ++i) {
+        if (entries_[i]->pending) {
+          Compute(i);
+        }
+      }
+      return entries_.back()->result;
+    }
+    // Collected first since submitted entries already start counting down their parents.
+    std::vector<uint32_t> ready;
+    for (uint32_t i = 0; i < entries_.size(); ++i) {
+      if (entries_[i]->pending && entries_[i]->remaining == 0) {
+        ready.push_back(i);
+      }
+    }
+    for (uint32_t i : ready) {
+      pool_->Submit([this, i] { RunFrom(i); });
+    }
+    while (!done_) {
+      if (!pool_->RunPendingTask()) {
+        std::this_thread::yield();
+      }
+    }
+    return entries_.back()->result;
+  }
+
+ private:
+  struct Entry {
+    const ShapeNode* node = nullptr;
+    uint64_t hash = 0;
+    // Number of nodes in the subtree, counting shared nodes once per use.
+    uint64_t size = 1;
+    std::vector<uint32_t> children;
+    // One entry per edge so a node used twice by the same parent is counted twice.
+    std::vector<uint32_t> parents;
+    // Whether the entry has to be computed in this run.
+    bool pending = false;
+    std::atomic<int> remaining{0};
+    GeometryPtr result;
+  };
+
+  uint32_t Add(const ShapeNode* node) {
+    auto it = index_.find(node);
+    if (it != index_.end()) {
+      return it->second;
+    }
+    std::vector<uint32_t> children;
+    std::vector<uint64_t> child_hashes;
+    if (node && node->op == ShapeOp::kSdf) {
+      for (const Shape& child : node->children) {
+        child_hashes.push_back(HashShapeNode(child.node(), &sdf_hashes_));
+      }
+    } else if (node) {
+      for (const Shape& child : node->children) {
+        uint32_t child_index = Add(child.node());
+        children.push_back(child_index);
+        child_hashes.push_back(entries_[child_index]->hash);
+      }
+    }
+    uint64_t hash = node ? HashNode(*node, child_hashes) : kOpaqueHash;
+    auto hash_it = hash_index_.find(hash);
+    if (hash_it != hash_index_.end()) {
+      index_[node] = hash_it->second;
+      return hash_it->second;
+    }
+
+    auto entry = std::make_unique<Entry>();
+    entry->node = node;
+    entry->hash = hash;
+    for (uint32_t child : children) {
+      entry->size += entries_[child]->size;
+    }
+    if (node && node->op == ShapeOp::kDifference) {
+      CullSubtrahends(*node, &children);
+    }
+    entry->children = std::move(children);
+    uint32_t index = static_cast<uint32_t>(entries_.size());
+    entries_.push_back(std::move(entry));
+    index_[node] = index;
+    hash_index_[hash] = index;
+    return index;
+  }
+
+  // Drops the children of a difference which can't reach the first one so they aren't evaluated.
+  // They still count towards the hash above since moving one may make it overlap.
+  static void CullSubtrahends(const ShapeNode& node, std::vector<uint32_t>* children) {
+    if (node.children.empty()) {
+      return;
+    }
+    Aabb bounds = node.children[0].Bounds();
+    std::vector<uint32_t> kept = {(*children)[0]};
+    for (size_t i = 1; i < node.children.size(); ++i) {
+      if (node.children[i].Bounds().Overlaps(bounds, kGeometryEpsilon)) {
+        kept.push_back((*children)[i]);
+      }
+    }
+    children->swap(kept);
+  }
+
+  // Marks the entries which have to be computed, starting from the root and stopping at cached
+  // results, and counts the pending children of each. Returns the number of pending entries.
+  uint32_t FindPending() {
+    std::vector<char> needed(entries_.size(), 0);
+    needed.back() = 1;
+    uint32_t count = 0;
+    // Parents come after their children so walking backwards visits parents first.
+    for (size_t i = entries_.size(); i-- > 0;) {
+      Entry& entry = *entries_[i];
+      if (!needed[i] || (cache_ && cache_->Lookup(entry.hash, &entry.result)) ||
+          LoadFromDisk(&entry)) {
+        continue;
+      }
+      entry.pending = true;
+      ++count;
+      for (uint32_t child : entry.children) {
+        needed[child] = 1;
+      }
+    }
+    for (uint32_t i = 0; i < entries_.size(); ++i) {
+      Entry& entry = *entries_[i];
+      if (!entry.pending) {
+        continue;
+      }
+      int remaining = 0;
+      for (uint32_t child : entry.children) {
+        if (entries_[child]->pending) {
+          entries_[child]->parents.push_back(i);
+          ++remaining;
+        }
+      }
+      entry.remaining = remaining;
+    }
+    return count;
+  }
+
+  void Compute(uint32_t index) {
+    Entry& entry = *entries_[index];
+    if (!entry.node) {
+      fprintf(stderr, "Native evaluation does not support %s\n", OpName(ShapeOp::kOpaque));
+      return;
+    }
+    std::vector<GeometryPtr> children;
+    children.reserve(entry.children.size());
+    for (uint32_t child : entry.children) {
+      children.push_back(entries_[child]->result);
+    }
+    entry.result = ComputeNode(*entry.node, children, pool_);
+    if (cache_ && entry.result) {
+      cache_->Insert(entry.hash, entry.result);
+    }
+    if (UseDisk(entry) && entry.result) {
+      std::string data;
+      EncodeGeometry(*entry.result, &data);
+      disk_cache_->Store(DiskKey(entry), "geom", data);
+    }
+  }
+
+  bool UseDisk(const Entry& entry) const {
+    return disk_cache_ && entry.node && entry.size >= kDiskCacheMinNodes;
+  }
+
+  static uint64_t DiskKey(const Entry& entry) {
+    return HashCombine(entry.hash, kDiskCacheVersion);
+  }
+
+  bool LoadFromDisk(Entry* entry) {
+    std::string data;
+    if (!UseDisk(*entry) || !disk_cache_->Load(DiskKey(*entry), "geom", &data)) {
+      return false;
+    }
+    entry->result = DecodeGeometry(data);
+    if (!entry->result) {
+      fprintf(stderr, "Ignoring corrupt cache entry %s\n",
+              disk_cache_->Path(DiskKey(*entry), "geom").c_str());
+      return false;
+    }
+    if (cache_) {
+      cache_->Insert(entry->hash, entry->result);
+    }
+    return true;
+  }
+
+  // Computes the entry and then keeps going with a parent it made ready, submitting the others.
+  void RunFrom(uint32_t index) {
+    while (true) {
+      Compute(index);
+      if (index == entries_.size() - 1) {
+        done_ = true;
+        return;
+      }
+      int next = -1;
+      for (uint32_t parent : entries_[index]->parents) {
+        if (--entries_[parent]->remaining != 0) {
+          continue;
+        }
+        if (next < 0) {
+          next = static_cast<int>(parent);
+        } else {
+          pool_->Submit([this, parent] { RunFrom(parent); });
+        }
+      }
+      if (next < 0) {
+        return;
+      }
+      index = static_cast<uint32_t>(next);
+    }
+  }
+
+  ThreadPool* pool_;
+  GenerationCache<GeometryPtr>* cache_;
+  DiskCache* disk_cache_;
+  std::vector<std::unique_ptr<Entry>> entries_;
+  std::unordered_map<const ShapeNode*, uint32_t> index_;
+  std::unordered_map<uint64_t, uint32_t> hash_index_;
+  // Hashes of the subtrees of sdf nodes, which are not evaluated as part of the graph.
+  std::unordered_map<const ShapeNode*, uint64_t> sdf_hashes_;
+  std::atomic<bool> done_{false};
+};
+
+}  // namespace
+
+Aabb Geometry::Bounds() const {
+  Aabb box;
+  for (const ConvexPolytope& piece : pieces) {
+    box.Extend(piece.Bounds());
+  }
+  for (const Mesh& mesh : meshes) {
+    box.Extend(mesh.Bounds());
+  }
+  for (const Path& path : polygons) {
+    for (const glm::dvec2& p : path) {
+      box.Extend(glm::dvec3(p, 0));
+    }
+  }
+  return box;
+}
+
+Mesh Geometry::ToMesh(ThreadPool* pool) const {
+  Mesh mesh = UnionConvex(pieces, pool);
+  for (const Mesh& imported : meshes) {
+    mesh.Append(imported);
+  }
+  return mesh;
+}
+
+uint64_t HashShape(const Shape& shape) {
+  std::unordered_map<const ShapeNode*, uint64_t> memo;
+  return HashShapeNode(shape.node(), &memo);
+}
+
+Evaluator::Evaluator(ThreadPool* pool)
+    : pool_(pool), node_cache_(kCacheGenerations), union_cache_(kCacheGenerations) {
+}
+
+GeometryPtr Evaluator::Evaluate(const Shape& shape) {
+  const ShapeNode* node = shape.node();
+  if (!node) {
+    fprintf(stderr, "Native evaluation does not support %s\n", OpName(ShapeOp::kOpaque));
+    return nullptr;
+  }
+  node_cache_.NextGeneration();
+  DagEvaluation evaluation(*node, pool_, &node_cache_, disk_cache_);
+  GeometryPtr result = evaluation.Run();
+  stats_.node_hits = node_cache_.hits();
+  stats_.node_misses = node_cache_.misses();
+  return result;
+}
+
+bool Evaluator::EvaluateMesh(const Shape& shape, Mesh* mesh) {
+  uint64_t disk_key = 0;
+  if (disk_cache_) {
+    disk_key = HashCombine(HashShape(shape), kDiskCacheVersion);
+    std::string data;
+    if (disk_cache_->Load(disk_key, "mesh", &data) && DecodeMesh(data, mesh)) {
+      stats_ = Stats();
+      return true;
+    }
+  }
+  GeometryPtr geometry = Evaluate(shape);
+  if (!geometry) {
+    return false;
+  }
+  if (!geometry->polygons.empty()) {
+    fprintf(stderr, "Native evaluation only makes meshes of 3D shapes\n");
+    return false;
+  }
+  union_cache_.NextGeneration();
+  *mesh = UnionConvex(geometry->pieces, pool_, &union_cache_);
+  for (const Mesh& imported : geometry->meshes) {
+    mesh->Append(imported);
+  }
+  stats_.clip_hits = union_cache_.hits();
+  stats_.clip_misses = union_cache_.misses();
+  if (disk_cache_) {
+    std::string data;
+    EncodeMesh(*mesh, &data);
+    disk_cache_->Store(disk_key, "mesh", data);
+  }
+  return true;
+}
+
+void Evaluator::ClearCache() {
+  node_cache_.Clear();
+  union_cache_.Clear();
+}
+
+}  // namespace scad
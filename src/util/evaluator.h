@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "convex.h"
+#include "convex_union.h"
+#include "disk_cache.h"
+#include "generation_cache.h"
+#include "mesh.h"
+#include "polygon.h"
+#include "scad.h"
+#include "thread_pool.h"
+
+namespace scad {
+
+// The result of evaluating a shape natively. Solids are kept as a list of possibly overlapping
+// convex pieces. Every operation the case uses is closed over that representation: transforms map
+// the pieces, unions concatenate them, hulls and intersections produce convex pieces and
+// differences split the pieces of the minuend by the planes of the subtrahend. The boundary is only
+// computed once at the end by ToMesh.
+struct Geometry {
+  std::vector<ConvexPolytope> pieces;
+  // Imported solids which aren't convex. They are transformed, hulled and unioned as they are but
+  // can't take part in differences or intersections.
+  std::vector<Mesh> meshes;
+  // 2D shapes in the xy plane, normalized as described in polygon.h. Like in openscad they can't
+  // be combined with solids.
+  Paths polygons;
+
+  Aabb Bounds() const;
+  Mesh ToMesh(ThreadPool* pool = nullptr) const;
+};
+
+using GeometryPtr = std::shared_ptr<const Geometry>;
+
+// Structural hash of a shape. Shapes built the same way hash the same even if they don't share
+// nodes.
+uint64_t HashShape(const Shape& shape);
+
+// Evaluates shapes without going through openscad. Operations which can't be evaluated natively
+// are reported on stderr and evaluate to null, as does every shape containing them.
+//
+// Shape trees are really DAGs, e.g. the switch walls, the screw inserts and the whole case which is
+// reused for the bottom plate. Every distinct node is evaluated exactly once per call. Nodes are
+// evaluated as tasks on a work stealing pool, a node is submitted as soon as the last of its
+// children is done so tasks never wait on each other and independent branches run in parallel.
+//
+// Results are cached across calls by the structural hash of each node. After changing one key only
+// the nodes above it (the switch walls around it, the unions and differences containing them) are
+// evaluated again, and EvaluateMesh only clips the pieces near the change again. With a disk
+// cache, results of large subtrees and final meshes are also kept on disk for later runs.
+class Evaluator {
+ public:
+  // Cache statistics of the last call.
+  struct Stats {
+    uint64_t node_hits = 0;
+    uint64_t node_misses = 0;
+    uint64_t clip_hits = 0;
+    uint64_t clip_misses = 0;
+  };
+
+  // A null pool evaluates everything on the calling thread.
+  explicit Evaluator(ThreadPool* pool = &ThreadPool::Default());
+
+  GeometryPtr Evaluate(const Shape& shape);
+
+  // Evaluates the shape and computes its boundary. Returns false if the shape couldn't be
+  // evaluated.
+  bool EvaluateMesh(const Shape& shape, Mesh* mesh);
+
+  void ClearCache();
+
+  // The disk cache is not owned and may be null.
+  void set_disk_cache(DiskCache* disk_cache) {
+    disk_cache_ = disk_cache;
+  }
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  ThreadPool* pool_;
+  GenerationCache<GeometryPtr> node_cache_;
+  UnionCache union_cache_;
+  DiskCache* disk_cache_ = nullptr;
+  Stats stats_;
+};
+
+}  // namespace scad
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace scad {
+
+// A thread safe map from content hashes to values which forgets entries that haven't been used
+// for a number of generations. Callers start a new generation for each pass over a model (e.g.
+// each evaluation) so entries for parts of the model which no longer exist are dropped.
+template <typename Value>
+class GenerationCache {
+ public:
+  explicit GenerationCache(uint64_t max_age = 1) : max_age_(max_age) {
+  }
+
+  bool Lookup(uint64_t key, Value* value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      ++misses_;
+      return false;
+    }
+    ++hits_;
+    it->second.generation = generation_;
+    *value = it->second.value;
+    return true;
+  }
+
+  void Insert(uint64_t key, Value value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[key] = {std::move(value), generation_};
+  }
+
+  // Drops entries which weren't used in the last max_age generations and starts a new one.
+  void NextGeneration() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      if (generation_ - it->second.generation >= max_age_) {
+        it = entries_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    ++generation_;
+    hits_ = 0;
+    misses_ = 0;
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  // Lookups in the current generation.
+  uint64_t hits() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+  }
+
+  uint64_t misses() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+  }
+
+ private:
+  struct Entry {
+    Value value;
+    uint64_t generation = 0;
+  };
+
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, Entry> entries_;
+  uint64_t max_age_;
+  uint64_t generation_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+}  // namespace scad
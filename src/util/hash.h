@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace scad {
+
+// 64 bit hashing helpers for structural hashes of shapes and geometry.
+
+inline uint64_t HashMix(uint64_t h) {
+  // splitmix64 finalizer.
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return h;
+}
+
+inline uint64_t HashCombine(uint64_t seed, uint64_t value) {
+  return HashMix(seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)));
+}
+
+inline uint64_t HashDouble(uint64_t seed, double value) {
+  // -0 and 0 describe the same geometry.
+  if (value == 0) {
+    value = 0;
+  }
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return HashCombine(seed, bits);
+}
+
+inline uint64_t HashString(uint64_t seed, const std::string& value) {
+  // FNV-1a over the bytes.
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (unsigned char c : value) {
+    h = (h ^ c) * 0x100000001b3ull;
+  }
+  return HashCombine(seed, h);
+}
+
+}  // namespace scad
@@ -0,0 +1,459 @@
+#include "import.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCAD_IMPORT_SSE2 1
+#endif
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "hash.h"
+#include "mesh.h"
+
+namespace scad {
+namespace {
+
+// Read only view of a whole file. The file is mapped where possible and read into memory
+// otherwise.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& file_name) {
+#ifdef _WIN32
+    std::ifstream file(file_name, std::ios::binary);
+    if (file) {
+      std::ostringstream contents;
+      contents << file.rdbuf();
+      buffer_ = contents.str();
+      data_ = buffer_.data();
+      size_ = buffer_.size();
+      ok_ = true;
+    }
+#else
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0) {
+      size_ = static_cast<size_t>(info.st_size);
+      if (size_ == 0) {
+        ok_ = true;
+      } else {
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+          mapping_ = mapping;
+          data_ = static_cast<const char*>(mapping);
+          ok_ = true;
+        }
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~MappedFile() {
+#ifndef _WIN32
+    if (mapping_) {
+      munmap(mapping_, size_);
+    }
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool ok() const {
+    return ok_;
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  const char* end() const {
+    return data_ + size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  const char* data_ = "";
+  size_t size_ = 0;
+  bool ok_ = false;
+#ifdef _WIN32
+  std::string buffer_;
+#else
+  void* mapping_ = nullptr;
+#endif
+};
+
+#ifdef SCAD_IMPORT_SSE2
+int FirstSetBit(int mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// Skips whitespace and control characters. Ascii stls are mostly indentation so this checks 16
+// bytes at a time.
+const char* SkipSpace(const char* p, const char* end) {
+#ifdef SCAD_IMPORT_SSE2
+  const __m128i first_visible = _mm_set1_epi8('!');
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    // Unsigned chunk >= '!'.
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(chunk, first_visible), chunk));
+    if (mask != 0) {
+      return p + FirstSetBit(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p < end && static_cast<unsigned char>(*p) <= ' ') {
+    ++p;
+  }
+  return p;
+}
+
+// Returns the position after the next newline.
+const char* SkipLine(const char* p, const char* end) {
+#ifdef SCAD_IMPORT_SSE2
+  const __m128i newline = _mm_set1_epi8('\n');
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+    if (mask != 0) {
+      return p + FirstSetBit(mask) + 1;
+    }
+    p += 16;
+  }
+#endif
+  while (p < end && *p != '\n') {
+    ++p;
+  }
+  return p < end ? p + 1 : end;
+}
+
+const char* SkipToken(const char* p, const char* end) {
+  while (p < end && static_cast<unsigned char>(*p) > ' ') {
+    ++p;
+  }
+  return p;
+}
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Parses a decimal number starting at p. Numbers with at most 19 significant digits and a small
+// exponent, i.e. everything exporters write, are converted exactly with one multiplication or
+// division by a power of ten. Anything else goes through strtod. Returns nullptr if there is no
+// number at p.
+const char* ParseNumber(const char* p, const char* end, double* value) {
+  static const double kPowersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char* start = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool any_digits = false;
+  for (; p < end && IsDigit(*p); ++p) {
+    any_digits = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa != 0;
+    } else {
+      ++exponent;
+      ++digits;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && IsDigit(*p); ++p) {
+      any_digits = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0;
+        --exponent;
+      } else {
+        ++digits;
+      }
+    }
+  }
+  if (!any_digits) {
+    return nullptr;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool negative_exponent = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      negative_exponent = *q == '-';
+      ++q;
+    }
+    if (q < end && IsDigit(*q)) {
+      int e = 0;
+      for (; q < end && IsDigit(*q); ++q) {
+        e = std::min(e * 10 + (*q - '0'), 100000);
+      }
+      exponent += negative_exponent ? -e : e;
+      p = q;
+    }
+  }
+  if (digits <= 19 && mantissa <= (uint64_t{1} << 53) && exponent >= -22 && exponent <= 22) {
+    double result = static_cast<double>(mantissa);
+    result = exponent < 0 ? result / kPowersOfTen[-exponent] : result * kPowersOfTen[exponent];
+    *value = negative ? -result : result;
+    return p;
+  }
+  // The file isn't null terminated so the token is copied for strtod.
+  std::string token(start, p);
+  *value = std::strtod(token.c_str(), nullptr);
+  return p;
+}
+
+// Parses count numbers separated by whitespace.
+const char* ParseNumbers(const char* p, const char* end, int count, double* values) {
+  for (int i = 0; i < count; ++i) {
+    p = SkipSpace(p, end);
+    p = ParseNumber(p, end, &values[i]);
+    if (!p) {
+      return nullptr;
+    }
+  }
+  return p;
+}
+
+bool StartsWith(const char* p, const char* end, const char* prefix) {
+  size_t length = std::strlen(prefix);
+  return static_cast<size_t>(end - p) >= length && std::memcmp(p, prefix, length) == 0;
+}
+
+// Adds the corners of a triangle soup to the mesh, welding shared corners.
+void AddWeldedTriangle(const glm::dvec3 (&corners)[3], VertexWelder* welder, Mesh* mesh) {
+  std::array<uint32_t, 3> t;
+  for (int i = 0; i < 3; ++i) {
+    t[i] = welder->Add(corners[i]);
+  }
+  if (t[0] != t[1] && t[1] != t[2] && t[2] != t[0]) {
+    mesh->triangles.push_back(t);
+  }
+}
+
+bool IsBinaryStl(const MappedFile& file) {
+  if (file.size() < 84) {
+    return false;
+  }
+  uint32_t count;
+  std::memcpy(&count, file.data() + 80, sizeof(count));
+  // Some binary files start with "solid" too so the size is what decides.
+  return file.size() == 84 + uint64_t{count} * 50;
+}
+
+bool ParseBinaryStl(const MappedFile& file, Mesh* mesh) {
+  uint32_t count;
+  std::memcpy(&count, file.data() + 80, sizeof(count));
+  VertexWelder welder;
+  mesh->triangles.reserve(count);
+  const char* p = file.data() + 84;
+  for (uint32_t i = 0; i < count; ++i, p += 50) {
+    // Skip the normal, it is recomputed from the winding where needed.
+    float values[9];
+    std::memcpy(values, p + 12, sizeof(values));
+    glm::dvec3 corners[3];
+    for (int c = 0; c < 3; ++c) {
+      corners[c] = glm::dvec3(values[c * 3], values[c * 3 + 1], values[c * 3 + 2]);
+    }
+    AddWeldedTriangle(corners, &welder, mesh);
+  }
+  mesh->vertices = welder.TakeVertices();
+  return true;
+}
+
+bool ParseAsciiStl(const MappedFile& file, Mesh* mesh) {
+  VertexWelder welder;
+  glm::dvec3 corners[3];
+  int corner = 0;
+  const char* p = file.data();
+  const char* end = file.end();
+  while (true) {
+    p = SkipSpace(p, end);
+    if (p == end) {
+      break;
+    }
+    if (!StartsWith(p, end, "vertex")) {
+      p = SkipToken(p, end);
+      continue;
+    }
+    double values[3];
+    p = ParseNumbers(p + 6, end, 3, values);
+    if (!p) {
+      return false;
+    }
+    corners[corner++] = glm::dvec3(values[0], values[1], values[2]);
+    if (corner == 3) {
+      AddWeldedTriangle(corners, &welder, mesh);
+      corner = 0;
+    }
+  }
+  mesh->vertices = welder.TakeVertices();
+  return corner == 0;
+}
+
+bool ParseObj(const MappedFile& file, Mesh* mesh) {
+  std::vector<glm::dvec3> positions;
+  const char* p = file.data();
+  const char* end = file.end();
+  std::vector<int64_t> face;
+  // Faces refer to positions by index, the positions are welded once all are known.
+  std::vector<std::array<int64_t, 3>> triangles;
+  while (p < end) {
+    p = SkipSpace(p, end);
+    if (p + 1 < end && p[0] == 'v' && p[1] == ' ') {
+      double values[3];
+      const char* next = ParseNumbers(p + 1, end, 3, values);
+      if (!next) {
+        return false;
+      }
+      positions.push_back({values[0], values[1], values[2]});
+      p = next;
+    } else if (p + 1 < end && p[0] == 'f' && p[1] == ' ') {
+      face.clear();
+      const char* q = p + 1;
+      while (true) {
+        // Stop at the end of the line.
+        while (q < end && (*q == ' ' || *q == '\t')) {
+          ++q;
+        }
+        double value;
+        const char* next = q < end && *q != '\r' && *q != '\n' ? ParseNumber(q, end, &value)
+                                                              : nullptr;
+        if (!next) {
+          break;
+        }
+        // Negative indices count back from the last position. Texture and normal indices after
+        // a slash are ignored.
+        int64_t index = static_cast<int64_t>(value);
+        face.push_back(index < 0 ? static_cast<int64_t>(positions.size()) + index : index - 1);
+        q = SkipToken(next, end);
+      }
+      for (size_t i = 1; i + 1 < face.size(); ++i) {
+        triangles.push_back({face[0], face[i], face[i + 1]});
+      }
+      p = q;
+    }
+    p = SkipLine(p, end);
+  }
+
+  VertexWelder welder;
+  std::vector<uint32_t> remap;
+  remap.reserve(positions.size());
+  for (const glm::dvec3& position : positions) {
+    remap.push_back(welder.Add(position));
+  }
+  for (const auto& t : triangles) {
+    std::array<uint32_t, 3> welded;
+    for (int i = 0; i < 3; ++i) {
+      if (t[i] < 0 || t[i] >= static_cast<int64_t>(positions.size())) {
+        return false;
+      }
+      welded[i] = remap[t[i]];
+    }
+    if (welded[0] != welded[1] && welded[1] != welded[2] && welded[2] != welded[0]) {
+      mesh->triangles.push_back(welded);
+    }
+  }
+  mesh->vertices = welder.TakeVertices();
+  return true;
+}
+
+std::string Extension(const std::string& file_name) {
+  size_t dot = file_name.find_last_of('.');
+  if (dot == std::string::npos) {
+    return "";
+  }
+  std::string extension = file_name.substr(dot + 1);
+  for (char& c : extension) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return extension;
+}
+
+}  // namespace
+
+bool ImportMesh(const std::string& file_name, Mesh* mesh) {
+  std::string extension = Extension(file_name);
+  if (extension != "stl" && extension != "obj") {
+    fprintf(stderr, "Can not import %s, only stl and obj files are supported\n",
+            file_name.c_str());
+    return false;
+  }
+  MappedFile file(file_name);
+  if (!file.ok()) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  Mesh result;
+  bool ok;
+  if (extension == "obj") {
+    ok = ParseObj(file, &result);
+  } else if (IsBinaryStl(file)) {
+    ok = ParseBinaryStl(file, &result);
+  } else {
+    ok = ParseAsciiStl(file, &result);
+  }
+  if (!ok) {
+    fprintf(stderr, "Could not parse %s\n", file_name.c_str());
+    return false;
+  }
+  *mesh = std::move(result);
+  return true;
+}
+
+uint64_t HashFile(const std::string& file_name) {
+  MappedFile file(file_name);
+  if (!file.ok()) {
+    return 0;
+  }
+  uint64_t hash = HashMix(file.size() + 1);
+  const char* p = file.data();
+  size_t words = file.size() / 8;
+  for (size_t i = 0; i < words; ++i, p += 8) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    hash = HashCombine(hash, word);
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, p, file.size() % 8);
+  return HashCombine(hash, tail);
+}
+
+}  // namespace scad
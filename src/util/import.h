@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "mesh.h"
+
+namespace scad {
+
+// Reads a binary or ascii stl or an obj file, chosen by the extension, into a mesh with welded
+// vertices. The file is memory mapped and numbers are parsed in place. Returns false and reports
+// on stderr if the file can't be read.
+bool ImportMesh(const std::string& file_name, Mesh* mesh);
+
+// Hash of the contents of a file so imports are cached by content rather than by name. Returns 0
+// if the file can't be read.
+uint64_t HashFile(const std::string& file_name);
+
+}  // namespace scad
@@ -68,7 +68,7 @@ Shape MakeSwitch(bool add_side_nub) {
     Shape side_nub =
         Hull(Cube(kWallWidth, 2.75, kSwitchThickness)
                  .Translate(kWallWidth / 2 + kSwitchWidth / 2, 0, kSwitchThickness / 2),
-             Cylinder(2.75, 1, 30).RotateX(90).Translate(kSwitchWidth / 2, 0, 1));
+             Cylinder(2.75, 1).RotateX(90).Translate(kSwitchWidth / 2, 0, 1));
     shapes.push_back(side_nub);
     shapes.push_back(side_nub.RotateZ(180));
   }
@@ -147,9 +147,8 @@ Key& Key::SetParent(const TransformList& transforms) {
 }
 
 TransformList Key::GetTransforms() const {
-  TransformList transforms;
-  transforms.Append(local_transforms);
-  transforms.Append(parent_transforms);
+  TransformList transforms = parent_transforms;
+  transforms.AppendFront(local_transforms);
   return transforms;
 }
 
@@ -158,9 +157,9 @@ TransformList Key::GetSwitchTransforms() const {
   if (disable_switch_z_offset) {
     switch_z_offset = 0;
   }
-  TransformList transforms;
-  transforms.AddTransform().z = -1 * switch_z_offset - extra_z;
-  return transforms.Append(GetTransforms());
+  TransformList transforms = GetTransforms();
+  transforms.AppendFront(Transform(0, 0, -1 * switch_z_offset - extra_z));
+  return transforms;
 }
 
 Shape Key::GetInverseSwitch() const {
@@ -255,52 +254,53 @@ Shape Key::GetCap(bool fill_in_cap_path) const {
 }
 
 TransformList Key::GetTopRight(double offset) const {
-  TransformList transforms;
-  transforms.AddTransform({extra_width_right + offset, extra_width_top + offset, 0});
-  return transforms.Append(GetTopRightInternal());
+  TransformList transforms = GetTopRightInternal();
+  transforms.AppendFront(Transform(extra_width_right + offset, extra_width_top + offset, 0));
+  return transforms;
 }
 
 TransformList Key::GetTopRightInternal() const {
-  TransformList transforms;
-  transforms.AddTransform({kSwitchHorizontalOffset, kSwitchHorizontalOffset, 0});
-  return transforms.Append(GetSwitchTransforms());
+  TransformList transforms = GetSwitchTransforms();
+  transforms.AppendFront(Transform(kSwitchHorizontalOffset, kSwitchHorizontalOffset, 0));
+  return transforms;
 }
 
 TransformList Key::GetTopLeft(double offset) const {
-  TransformList transforms;
-  transforms.AddTransform({-1 * (extra_width_left + offset), extra_width_top + offset, 0});
-  return transforms.Append(GetTopLeftInternal());
+  TransformList transforms = GetTopLeftInternal();
+  transforms.AppendFront(Transform(-1 * (extra_width_left + offset), extra_width_top + offset, 0));
+  return transforms;
 }
 
 TransformList Key::GetTopLeftInternal() const {
-  TransformList transforms;
-  transforms.AddTransform({-1 * kSwitchHorizontalOffset, kSwitchHorizontalOffset, 0});
-  return transforms.Append(GetSwitchTransforms());
+  TransformList transforms = GetSwitchTransforms();
+  transforms.AppendFront(Transform(-1 * kSwitchHorizontalOffset, kSwitchHorizontalOffset, 0));
+  return transforms;
 }
 
 TransformList Key::GetBottomRight(double offset) const {
-  TransformList transforms;
-  transforms.AddTransform({extra_width_right + offset, -1 * (extra_width_bottom + offset), 0});
-  return transforms.Append(GetBottomRightInternal());
+  TransformList transforms = GetBottomRightInternal();
+  transforms.AppendFront(
+      Transform(extra_width_right + offset, -1 * (extra_width_bottom + offset), 0));
+  return transforms;
 }
 
 TransformList Key::GetBottomRightInternal() const {
-  TransformList transforms;
-  transforms.AddTransform({kSwitchHorizontalOffset, -1 * kSwitchHorizontalOffset, 0});
-  return transforms.Append(GetSwitchTransforms());
+  TransformList transforms = GetSwitchTransforms();
+  transforms.AppendFront(Transform(kSwitchHorizontalOffset, -1 * kSwitchHorizontalOffset, 0));
+  return transforms;
 }
 
 TransformList Key::GetBottomLeft(double offset) const {
-  TransformList transforms;
-  transforms.AddTransform(
-      {-1 * (extra_width_left + offset), -1 * (extra_width_bottom + offset), 0});
-  return transforms.Append(GetBottomLeftInternal());
+  TransformList transforms = GetBottomLeftInternal();
+  transforms.AppendFront(
+      Transform(-1 * (extra_width_left + offset), -1 * (extra_width_bottom + offset), 0));
+  return transforms;
 }
 
 TransformList Key::GetBottomLeftInternal() const {
-  TransformList transforms;
-  transforms.AddTransform({-1 * kSwitchHorizontalOffset, -1 * kSwitchHorizontalOffset, 0});
-  return transforms.Append(GetSwitchTransforms());
+  TransformList transforms = GetSwitchTransforms();
+  transforms.AppendFront(Transform(-1 * kSwitchHorizontalOffset, -1 * kSwitchHorizontalOffset, 0));
+  return transforms;
 }
 
 TransformList Key::GetMiddle() const {
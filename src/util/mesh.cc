@@ -0,0 +1,402 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCAD_MESH_SSE2 1
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "serialize.h"
+
+namespace scad {
+
+Aabb Mesh::Bounds() const {
+  Aabb box;
+  for (const glm::dvec3& v : vertices) {
+    box.Extend(v);
+  }
+  return box;
+}
+
+void Mesh::Append(const Mesh& other) {
+  uint32_t offset = static_cast<uint32_t>(vertices.size());
+  vertices.insert(vertices.end(), other.vertices.begin(), other.vertices.end());
+  if (!other.colors.empty() || !colors.empty()) {
+    colors.resize(triangles.size(), 0);
+    for (size_t i = 0; i < other.triangles.size(); ++i) {
+      colors.push_back(other.color(i));
+    }
+  }
+  for (const auto& t : other.triangles) {
+    triangles.push_back({t[0] + offset, t[1] + offset, t[2] + offset});
+  }
+}
+
+Mesh WeldMesh(const Mesh& mesh, double tolerance) {
+  VertexWelder welder(tolerance);
+  std::vector<uint32_t> remap;
+  remap.reserve(mesh.vertices.size());
+  for (const glm::dvec3& v : mesh.vertices) {
+    remap.push_back(welder.Add(v));
+  }
+  Mesh result;
+  result.vertices = welder.TakeVertices();
+  for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+    const auto& t = mesh.triangles[i];
+    std::array<uint32_t, 3> welded = {remap[t[0]], remap[t[1]], remap[t[2]]};
+    if (welded[0] == welded[1] || welded[1] == welded[2] || welded[2] == welded[0]) {
+      continue;
+    }
+    result.triangles.push_back(welded);
+    if (!mesh.colors.empty()) {
+      result.colors.push_back(mesh.colors[i]);
+    }
+  }
+  return result;
+}
+
+namespace {
+
+const uint32_t kMeshMagic = 0x4853454d;  // "MESH"
+const uint32_t kMeshVersion = 2;
+
+// Size of a triangle in a binary stl: normal, three vertices and an attribute word.
+const size_t kStlTriangleBytes = 50;
+const size_t kStlHeaderBytes = 84;
+
+// Triangles are converted to floats and their normals computed four at a time, with the
+// coordinates laid out as one array per component so the normals can use SIMD.
+struct StlBlock {
+  static const int kSize = 4;
+
+  int count = 0;
+  // Corner, component, triangle.
+  alignas(16) float v[3][3][kSize];
+  alignas(16) float n[3][kSize];
+
+  // Loads triangles [begin, begin + count) of the mesh.
+  void Load(const Mesh& mesh, size_t begin, bool mirror_x) {
+    count = static_cast<int>(std::min<size_t>(kSize, mesh.triangles.size() - begin));
+    for (int t = 0; t < kSize; ++t) {
+      // Unused lanes repeat the last triangle.
+      const auto& triangle = mesh.triangles[begin + std::min(t, count - 1)];
+      for (int corner = 0; corner < 3; ++corner) {
+        // Mirroring flips the orientation so the last two corners are swapped.
+        int source = mirror_x && corner != 0 ? 3 - corner : corner;
+        const glm::dvec3& p = mesh.vertices[triangle[source]];
+        v[corner][0][t] = static_cast<float>(mirror_x ? -p.x : p.x);
+        v[corner][1][t] = static_cast<float>(p.y);
+        v[corner][2][t] = static_cast<float>(p.z);
+      }
+    }
+    ComputeNormals();
+  }
+
+#ifdef SCAD_MESH_SSE2
+  void ComputeNormals() {
+    __m128 e1[3];
+    __m128 e2[3];
+    for (int c = 0; c < 3; ++c) {
+      __m128 a = _mm_load_ps(v[0][c]);
+      e1[c] = _mm_sub_ps(_mm_load_ps(v[1][c]), a);
+      e2[c] = _mm_sub_ps(_mm_load_ps(v[2][c]), a);
+    }
+    __m128 nx = _mm_sub_ps(_mm_mul_ps(e1[1], e2[2]), _mm_mul_ps(e1[2], e2[1]));
+    __m128 ny = _mm_sub_ps(_mm_mul_ps(e1[2], e2[0]), _mm_mul_ps(e1[0], e2[2]));
+    __m128 nz = _mm_sub_ps(_mm_mul_ps(e1[0], e2[1]), _mm_mul_ps(e1[1], e2[0]));
+    __m128 length = _mm_sqrt_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+    // Degenerate triangles get a zero normal.
+    __m128 valid = _mm_cmpgt_ps(length, _mm_setzero_ps());
+    __m128 inverse = _mm_and_ps(valid, _mm_div_ps(_mm_set1_ps(1), length));
+    _mm_store_ps(n[0], _mm_mul_ps(nx, inverse));
+    _mm_store_ps(n[1], _mm_mul_ps(ny, inverse));
+    _mm_store_ps(n[2], _mm_mul_ps(nz, inverse));
+  }
+#else
+  void ComputeNormals() {
+    for (int t = 0; t < kSize; ++t) {
+      glm::vec3 a(v[0][0][t], v[0][1][t], v[0][2][t]);
+      glm::vec3 b(v[1][0][t], v[1][1][t], v[1][2][t]);
+      glm::vec3 c(v[2][0][t], v[2][1][t], v[2][2][t]);
+      glm::vec3 normal = glm::cross(b - a, c - a);
+      float length = glm::length(normal);
+      normal = length > 0 ? normal / length : glm::vec3(0);
+      n[0][t] = normal.x;
+      n[1][t] = normal.y;
+      n[2][t] = normal.z;
+    }
+  }
+#endif
+
+  // Writes the triangles in binary stl layout. Stl is little endian like every host we build on.
+  char* WriteBinary(char* out) const {
+    for (int t = 0; t < count; ++t) {
+      float values[12] = {n[0][t], n[1][t], n[2][t]};
+      for (int corner = 0; corner < 3; ++corner) {
+        for (int c = 0; c < 3; ++c) {
+          values[3 + corner * 3 + c] = v[corner][c][t];
+        }
+      }
+      std::memcpy(out, values, sizeof(values));
+      out[48] = 0;
+      out[49] = 0;
+      out += kStlTriangleBytes;
+    }
+    return out;
+  }
+
+  void WriteAscii(std::FILE* file) const {
+    for (int t = 0; t < count; ++t) {
+      fprintf(file, "  facet normal %.9g %.9g %.9g\n    outer loop\n", n[0][t], n[1][t], n[2][t]);
+      for (int corner = 0; corner < 3; ++corner) {
+        fprintf(file,
+                "      vertex %.9g %.9g %.9g\n",
+                v[corner][0][t],
+                v[corner][1][t],
+                v[corner][2][t]);
+      }
+      fprintf(file, "    endloop\n  endfacet\n");
+    }
+  }
+};
+
+void WriteStlHeader(uint32_t num_triangles, char* out) {
+  std::memset(out, 0, kStlHeaderBytes);
+  std::memcpy(out, "dactyl-cc", 9);
+  std::string count;
+  PutU32(num_triangles, &count);
+  std::memcpy(out + 80, count.data(), 4);
+}
+
+// Writes triangles [begin, end) in binary stl layout.
+void WriteStlTriangles(const Mesh& mesh, size_t begin, size_t end, bool mirror_x, char* out) {
+  StlBlock block;
+  for (size_t i = begin; i < end; i += StlBlock::kSize) {
+    block.Load(mesh, i, mirror_x);
+    block.count = static_cast<int>(std::min<size_t>(block.count, end - i));
+    out = block.WriteBinary(out);
+  }
+}
+
+std::FILE* OpenForWriting(const std::string& file_name, const char* mode) {
+  std::FILE* file = nullptr;
+#ifdef _WIN32
+  if (fopen_s(&file, file_name.c_str(), mode) != 0) {
+    file = nullptr;
+  }
+#else
+  file = std::fopen(file_name.c_str(), mode);
+#endif
+  return file;
+}
+
+#ifndef _WIN32
+// Writes the binary stl straight into a mapping of the file. Returns false if the file can't be
+// mapped, in which case the caller falls back to buffered writes.
+bool WriteBinaryStlMapped(const Mesh& mesh, const std::string& file_name, bool mirror_x) {
+  size_t size = kStlHeaderBytes + mesh.triangles.size() * kStlTriangleBytes;
+  int fd = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    close(fd);
+    return false;
+  }
+  void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  char* out = static_cast<char*>(mapping);
+  WriteStlHeader(static_cast<uint32_t>(mesh.triangles.size()), out);
+  WriteStlTriangles(mesh, 0, mesh.triangles.size(), mirror_x, out + kStlHeaderBytes);
+  bool ok = munmap(mapping, size) == 0;
+  return close(fd) == 0 && ok;
+}
+#endif
+
+bool WriteBinaryStl(const Mesh& mesh, const std::string& file_name, bool mirror_x) {
+#ifndef _WIN32
+  if (WriteBinaryStlMapped(mesh, file_name, mirror_x)) {
+    return true;
+  }
+#endif
+  std::FILE* file = OpenForWriting(file_name, "wb");
+  if (!file) {
+    return false;
+  }
+  // Triangles are encoded into a buffer which is written in large chunks.
+  const size_t kChunk = 1 << 14;
+  std::vector<char> buffer(std::max(kStlHeaderBytes, kChunk * kStlTriangleBytes));
+  WriteStlHeader(static_cast<uint32_t>(mesh.triangles.size()), buffer.data());
+  bool ok = std::fwrite(buffer.data(), 1, kStlHeaderBytes, file) == kStlHeaderBytes;
+  for (size_t begin = 0; ok && begin < mesh.triangles.size(); begin += kChunk) {
+    size_t end = std::min(mesh.triangles.size(), begin + kChunk);
+    WriteStlTriangles(mesh, begin, end, mirror_x, buffer.data());
+    size_t bytes = (end - begin) * kStlTriangleBytes;
+    ok = std::fwrite(buffer.data(), 1, bytes, file) == bytes;
+  }
+  return std::fclose(file) == 0 && ok;
+}
+
+bool WriteAsciiStl(const Mesh& mesh, const std::string& file_name, bool mirror_x) {
+  std::FILE* file = OpenForWriting(file_name, "w");
+  if (!file) {
+    return false;
+  }
+  std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+  fprintf(file, "solid dactyl-cc\n");
+  StlBlock block;
+  for (size_t i = 0; i < mesh.triangles.size(); i += StlBlock::kSize) {
+    block.Load(mesh, i, mirror_x);
+    block.WriteAscii(file);
+  }
+  fprintf(file, "endsolid dactyl-cc\n");
+  bool ok = !std::ferror(file);
+  return std::fclose(file) == 0 && ok;
+}
+
+}  // namespace
+
+bool Mesh::WriteStl(const std::string& file_name, StlFormat format, bool mirror_x) const {
+  bool ok = format == StlFormat::kBinary ? WriteBinaryStl(*this, file_name, mirror_x)
+                                         : WriteAsciiStl(*this, file_name, mirror_x);
+  if (!ok) {
+    fprintf(stderr, "Could not write %s\n", file_name.c_str());
+  }
+  return ok;
+}
+
+void EncodeMesh(const Mesh& mesh, std::string* out) {
+  out->reserve(out->size() + 16 + mesh.vertices.size() * 24 + mesh.triangles.size() * 12);
+  PutU32(kMeshMagic, out);
+  PutU32(kMeshVersion, out);
+  PutU32(static_cast<uint32_t>(mesh.vertices.size()), out);
+  PutU32(static_cast<uint32_t>(mesh.triangles.size()), out);
+  for (const glm::dvec3& v : mesh.vertices) {
+    PutDouble(v.x, out);
+    PutDouble(v.y, out);
+    PutDouble(v.z, out);
+  }
+  for (const auto& t : mesh.triangles) {
+    PutU32(t[0], out);
+    PutU32(t[1], out);
+    PutU32(t[2], out);
+  }
+  PutU32(mesh.colors.empty() ? 0 : 1, out);
+  for (PackedColor color : mesh.colors) {
+    PutU32(color, out);
+  }
+}
+
+bool DecodeMesh(const std::string& data, Mesh* mesh) {
+  ByteReader reader(data);
+  if (reader.U32() != kMeshMagic || reader.U32() != kMeshVersion) {
+    return false;
+  }
+  uint32_t num_vertices = reader.U32();
+  uint32_t num_triangles = reader.U32();
+  if (!reader.ok() ||
+      reader.remaining() < uint64_t{num_vertices} * 24 + uint64_t{num_triangles} * 12 + 4) {
+    return false;
+  }
+  Mesh result;
+  result.vertices.resize(num_vertices);
+  for (glm::dvec3& v : result.vertices) {
+    v.x = reader.Double();
+    v.y = reader.Double();
+    v.z = reader.Double();
+  }
+  result.triangles.resize(num_triangles);
+  for (auto& t : result.triangles) {
+    for (uint32_t& index : t) {
+      index = reader.U32();
+      if (index >= num_vertices) {
+        return false;
+      }
+    }
+  }
+  if (reader.U32() != 0) {
+    if (reader.remaining() != uint64_t{num_triangles} * 4) {
+      return false;
+    }
+    result.colors.resize(num_triangles);
+    for (PackedColor& color : result.colors) {
+      color = reader.U32();
+    }
+  }
+  if (reader.remaining() != 0) {
+    return false;
+  }
+  *mesh = std::move(result);
+  return true;
+}
+
+VertexWelder::VertexWelder(double tolerance)
+    : tolerance_(tolerance), cell_size_(tolerance * 4) {
+}
+
+std::array<int64_t, 3> VertexWelder::Cell(const glm::dvec3& p) const {
+  return {static_cast<int64_t>(std::floor(p.x / cell_size_)),
+          static_cast<int64_t>(std::floor(p.y / cell_size_)),
+          static_cast<int64_t>(std::floor(p.z / cell_size_))};
+}
+
+uint32_t VertexWelder::Add(const glm::dvec3& p) {
+  std::array<int64_t, 3> cell = Cell(p);
+  double tolerance2 = tolerance_ * tolerance_;
+  // The cell is larger than the tolerance so at most the direct neighbors need to be searched,
+  // and only those the tolerance box around p reaches into.
+  std::array<int64_t, 3> low = Cell(p - glm::dvec3(tolerance_));
+  std::array<int64_t, 3> high = Cell(p + glm::dvec3(tolerance_));
+  for (int64_t dx = low[0] - cell[0]; dx <= high[0] - cell[0]; ++dx) {
+    for (int64_t dy = low[1] - cell[1]; dy <= high[1] - cell[1]; ++dy) {
+      for (int64_t dz = low[2] - cell[2]; dz <= high[2] - cell[2]; ++dz) {
+        auto it = cells_.find({cell[0] + dx, cell[1] + dy, cell[2] + dz});
+        if (it == cells_.end()) {
+          continue;
+        }
+        for (uint32_t index : it->second) {
+          glm::dvec3 d = vertices_[index] - p;
+          if (glm::dot(d, d) <= tolerance2) {
+            return index;
+          }
+        }
+      }
+    }
+  }
+  uint32_t index = static_cast<uint32_t>(vertices_.size());
+  vertices_.push_back(p);
+  cells_[cell].push_back(index);
+  return index;
+}
+
+glm::dvec3 NewellNormal(const std::vector<glm::dvec3>& polygon) {
+  glm::dvec3 normal(0);
+  size_t n = polygon.size();
+  for (size_t i = 0; i < n; ++i) {
+    const glm::dvec3& a = polygon[i];
+    const glm::dvec3& b = polygon[(i + 1) % n];
+    normal.x += (a.y - b.y) * (a.z + b.z);
+    normal.y += (a.z - b.z) * (a.x + b.x);
+    normal.z += (a.x - b.x) * (a.y + b.y);
+  }
+  return normal;
+}
+
+}  // namespace scad
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace scad {
+
+// Tolerance in mm used by the native geometry code when classifying points against planes and
+// when welding vertices. The post connectors are only .01mm thick so this needs to be well below
+// that.
+const double kGeometryEpsilon = 1e-7;
+
+// Axis aligned bounding box. A default constructed box is empty.
+struct Aabb {
+  glm::dvec3 min = glm::dvec3(std::numeric_limits<double>::max());
+  glm::dvec3 max = glm::dvec3(std::numeric_limits<double>::lowest());
+
+  Aabb() {
+  }
+
+  Aabb(const glm::dvec3& min, const glm::dvec3& max) : min(min), max(max) {
+  }
+
+  bool empty() const {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+  }
+
+  glm::dvec3 center() const {
+    return (min + max) * 0.5;
+  }
+
+  glm::dvec3 size() const {
+    return empty() ? glm::dvec3(0) : max - min;
+  }
+
+  void Extend(const glm::dvec3& p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+
+  void Extend(const Aabb& box) {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+  }
+
+  bool Overlaps(const Aabb& box, double epsilon = 0) const {
+    return min.x <= box.max.x + epsilon && box.min.x <= max.x + epsilon &&
+           min.y <= box.max.y + epsilon && box.min.y <= max.y + epsilon &&
+           min.z <= box.max.z + epsilon && box.min.z <= max.z + epsilon;
+  }
+
+  bool Contains(const glm::dvec3& p, double epsilon = 0) const {
+    return p.x >= min.x - epsilon && p.x <= max.x + epsilon && p.y >= min.y - epsilon &&
+           p.y <= max.y + epsilon && p.z >= min.z - epsilon && p.z <= max.z + epsilon;
+  }
+};
+
+enum class StlFormat { kBinary, kAscii };
+
+// Colors are packed as 0xRRGGBBAA. Zero means no color was given.
+using PackedColor = uint32_t;
+
+inline PackedColor PackColor(double r, double g, double b, double a = 1) {
+  auto channel = [](double value) {
+    return static_cast<uint32_t>(std::fmin(std::fmax(value, 0.0), 1.0) * 255 + 0.5);
+  };
+  PackedColor color = channel(r) << 24 | channel(g) << 16 | channel(b) << 8 | channel(a);
+  // Fully transparent black still counts as a color.
+  return color == 0 ? 1 : color;
+}
+
+// An indexed triangle mesh. Triangles are counter clockwise when viewed from the outside.
+struct Mesh {
+  std::vector<glm::dvec3> vertices;
+  std::vector<std::array<uint32_t, 3>> triangles;
+  // Color of each triangle, from Shape::Color. Empty if nothing in the mesh has a color.
+  std::vector<PackedColor> colors;
+
+  bool empty() const {
+    return triangles.empty();
+  }
+
+  Aabb Bounds() const;
+
+  // Appends the other mesh, offsetting its indices.
+  void Append(const Mesh& other);
+
+  // The color of triangle i, zero if it has none.
+  PackedColor color(size_t i) const {
+    return colors.empty() ? 0 : colors[i];
+  }
+
+  // Writes the mesh as an stl file. Binary files are written through a memory mapping where
+  // available. With mirror_x the mesh is mirrored across the yz plane while it is written, which
+  // gives the right half from the left one without building a second mesh. Returns false if the
+  // file could not be written.
+  bool WriteStl(const std::string& file_name,
+                StlFormat format = StlFormat::kBinary,
+                bool mirror_x = false) const;
+
+  // Indexed formats which write every vertex once, see mesh_export.cc. The mesh is welded first.
+  // Ply files are binary and have per face colors if the mesh has colors. 3mf files keep colors as
+  // base materials so multi material slicers can assign them.
+  bool WriteObj(const std::string& file_name, bool mirror_x = false) const;
+  bool WritePly(const std::string& file_name, bool mirror_x = false) const;
+  bool Write3mf(const std::string& file_name, bool mirror_x = false) const;
+};
+
+// Compact binary encoding of a mesh used by the disk cache.
+void EncodeMesh(const Mesh& mesh, std::string* out);
+// Returns false if the data is not a valid encoding.
+bool DecodeMesh(const std::string& data, Mesh* mesh);
+
+// Merges vertices within tolerance of each other and drops triangles which collapse. Exporters of
+// indexed formats run this so every vertex is written once.
+Mesh WeldMesh(const Mesh& mesh, double tolerance = kGeometryEpsilon);
+
+// Merges points which are within tolerance of each other using a spatial hash grid.
+class VertexWelder {
+ public:
+  explicit VertexWelder(double tolerance = kGeometryEpsilon);
+
+  // Returns the index of an existing vertex within tolerance of p or adds p as a new vertex.
+  uint32_t Add(const glm::dvec3& p);
+
+  const std::vector<glm::dvec3>& vertices() const {
+    return vertices_;
+  }
+
+  std::vector<glm::dvec3> TakeVertices() {
+    return std::move(vertices_);
+  }
+
+ private:
+  struct CellHash {
+    size_t operator()(const std::array<int64_t, 3>& c) const {
+      return static_cast<size_t>(static_cast<uint64_t>(c[0]) * 73856093u ^
+                                 static_cast<uint64_t>(c[1]) * 19349663u ^
+                                 static_cast<uint64_t>(c[2]) * 83492791u);
+    }
+  };
+
+  std::array<int64_t, 3> Cell(const glm::dvec3& p) const;
+
+  double tolerance_;
+  double cell_size_;
+  std::vector<glm::dvec3> vertices_;
+  std::unordered_map<std::array<int64_t, 3>, std::vector<uint32_t>, CellHash> cells_;
+};
+
+// Normal of a planar polygon using Newell's method. The length is twice the polygon's area.
+glm::dvec3 NewellNormal(const std::vector<glm::dvec3>& polygon);
+
+}  // namespace scad
@@ -0,0 +1,552 @@
+#include "mesh_decimate.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <iterator>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace scad {
+namespace {
+
+using Triangle = std::array<uint32_t, 3>;
+
+constexpr size_t kChunkSize = 4096;
+// Cells of the first pass are split until they have at most this many vertices.
+constexpr size_t kCellVertices = 2048;
+// Collapses may turn a triangle by at most about 75 degrees.
+constexpr double kMinNormalCosine = 0.25;
+
+// Runs f(begin, end) over chunks of [0, count) on the pool.
+template <typename F>
+void ParallelChunks(ThreadPool* pool, size_t count, size_t chunk, const F& f) {
+  TaskGroup group(pool);
+  for (size_t begin = 0; begin < count; begin += chunk) {
+    size_t end = std::min(count, begin + chunk);
+    group.Run([&f, begin, end] { f(begin, end); });
+  }
+  group.Wait();
+}
+
+// A weighted sum of squared distances from planes, the matrix [a b; b^T c] applied to (p, 1).
+struct Quadric {
+  glm::dmat3 a = glm::dmat3(0);
+  glm::dvec3 b = glm::dvec3(0);
+  double c = 0;
+  // Area of the triangles whose planes were added, which turns the sum into a mean.
+  double area = 0;
+
+  // The plane dot(normal, p) = offset, normal being a unit vector.
+  static Quadric FromPlane(const glm::dvec3& normal, double offset, double weight) {
+    Quadric q;
+    q.a = weight * glm::outerProduct(normal, normal);
+    q.b = -weight * offset * normal;
+    q.c = weight * offset * offset;
+    return q;
+  }
+
+  Quadric& operator+=(const Quadric& other) {
+    a += other.a;
+    b += other.b;
+    c += other.c;
+    area += other.area;
+    return *this;
+  }
+
+  // The mean squared distance of p from the planes.
+  double Error(const glm::dvec3& p) const {
+    double sum = std::max(0.0, glm::dot(p, a * p) + 2 * glm::dot(b, p) + c);
+    return area > 0 ? sum / area : sum;
+  }
+
+  // The point of least error. Returns false if it isn't well defined, e.g. for flat areas.
+  bool Minimum(glm::dvec3* p) const {
+    double scale = a[0][0] + a[1][1] + a[2][2];
+    if (!(std::abs(glm::determinant(a)) > 1e-9 * scale * scale * scale)) {
+      return false;
+    }
+    *p = -(glm::inverse(a) * b);
+    return true;
+  }
+};
+
+// The planes of the triangles, weighted by area, summed at their corners. Boundary edges add a
+// plane through the edge perpendicular to its triangle.
+std::vector<Quadric> VertexQuadrics(const Mesh& mesh, double boundary_weight, ThreadPool* pool) {
+  const auto& vertices = mesh.vertices;
+  std::vector<Quadric> faces(mesh.triangles.size());
+  std::vector<glm::dvec3> normals(mesh.triangles.size());
+  ParallelChunks(pool, mesh.triangles.size(), kChunkSize, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const Triangle& t = mesh.triangles[i];
+      glm::dvec3 normal =
+          glm::cross(vertices[t[1]] - vertices[t[0]], vertices[t[2]] - vertices[t[0]]);
+      double length = glm::length(normal);
+      if (length == 0) {
+        continue;
+      }
+      normals[i] = normal / length;
+      faces[i] = Quadric::FromPlane(normals[i], glm::dot(normals[i], vertices[t[0]]), length / 2);
+      faces[i].area = length / 2;
+    }
+  });
+  std::vector<Quadric> quadrics(vertices.size());
+  // Edges with the lower corner in the high bits, and the triangle and edge index.
+  std::vector<std::pair<uint64_t, uint32_t>> edges;
+  edges.reserve(mesh.triangles.size() * 3);
+  for (uint32_t i = 0; i < mesh.triangles.size(); ++i) {
+    for (int e = 0; e < 3; ++e) {
+      uint32_t a = mesh.triangles[i][e];
+      uint32_t b = mesh.triangles[i][(e + 1) % 3];
+      quadrics[a] += faces[i];
+      uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+      edges.push_back({key, i * 3 + e});
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  for (size_t i = 0; i < edges.size(); ++i) {
+    bool single = (i == 0 || edges[i - 1].first != edges[i].first) &&
+                  (i + 1 == edges.size() || edges[i + 1].first != edges[i].first);
+    uint32_t triangle = edges[i].second / 3;
+    if (!single || normals[triangle] == glm::dvec3(0)) {
+      continue;
+    }
+    int e = edges[i].second % 3;
+    uint32_t a = mesh.triangles[triangle][e];
+    uint32_t b = mesh.triangles[triangle][(e + 1) % 3];
+    glm::dvec3 edge = vertices[b] - vertices[a];
+    glm::dvec3 normal = glm::cross(edge, normals[triangle]);
+    double length = glm::length(normal);
+    if (length == 0) {
+      continue;
+    }
+    normal /= length;
+    Quadric plane = Quadric::FromPlane(
+        normal, glm::dot(normal, vertices[a]), boundary_weight * glm::dot(edge, edge));
+    quadrics[a] += plane;
+    quadrics[b] += plane;
+  }
+  return quadrics;
+}
+
+// A part of the mesh to decimate. Locked vertices are neither moved nor removed.
+struct Part {
+  std::vector<glm::dvec3> vertices;
+  std::vector<Quadric> quadrics;
+  std::vector<char> locked;
+  std::vector<Triangle> triangles;
+  // Set for the triangles collapses removed.
+  std::vector<char> removed;
+};
+
+class Decimator {
+ public:
+  explicit Decimator(Part* part)
+      : part_(*part),
+        faces_(part->vertices.size()),
+        versions_(part->vertices.size(), 0),
+        dead_(part->vertices.size(), 0),
+        live_(part->triangles.size()) {
+    part_.removed.assign(part_.triangles.size(), 0);
+    for (uint32_t t = 0; t < part_.triangles.size(); ++t) {
+      for (uint32_t v : part_.triangles[t]) {
+        faces_[v].push_back(t);
+      }
+    }
+  }
+
+  // Collapses edges until at most target triangles are left or the next collapse would have an
+  // error above max_error. Returns the largest error of a collapse.
+  double Run(size_t target, double max_error) {
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    for (const Triangle& t : part_.triangles) {
+      for (int e = 0; e < 3; ++e) {
+        edges.push_back(std::minmax(t[e], t[(e + 1) % 3]));
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    for (const auto& [u, v] : edges) {
+      Push(u, v);
+    }
+    double limit = max_error * max_error;
+    double worst = 0;
+    while (live_ > target && !queue_.empty()) {
+      Candidate candidate = queue_.top();
+      queue_.pop();
+      if (dead_[candidate.u] || dead_[candidate.v] ||
+          versions_[candidate.u] != candidate.version_u ||
+          versions_[candidate.v] != candidate.version_v) {
+        continue;
+      }
+      if (candidate.error > limit) {
+        break;
+      }
+      if (Collapse(candidate)) {
+        worst = std::max(worst, candidate.error);
+      }
+    }
+    return std::sqrt(worst);
+  }
+
+ private:
+  struct Candidate {
+    double error = 0;
+    uint32_t u = 0;
+    uint32_t v = 0;
+    uint32_t version_u = 0;
+    uint32_t version_v = 0;
+    glm::dvec3 position = glm::dvec3(0);
+
+    // Orders the queue by least error, ties by the vertices so the order is deterministic.
+    bool operator<(const Candidate& other) const {
+      if (error != other.error) {
+        return error > other.error;
+      }
+      return u != other.u ? u > other.u : v > other.v;
+    }
+  };
+
+  void Push(uint32_t u, uint32_t v) {
+    if (part_.locked[u] && part_.locked[v]) {
+      return;
+    }
+    Quadric q = part_.quadrics[u];
+    q += part_.quadrics[v];
+    Candidate candidate;
+    candidate.u = u;
+    candidate.v = v;
+    candidate.version_u = versions_[u];
+    candidate.version_v = versions_[v];
+    if (part_.locked[u] || part_.locked[v]) {
+      candidate.position = part_.vertices[part_.locked[u] ? u : v];
+    } else if (!q.Minimum(&candidate.position)) {
+      // Flat or straight neighborhoods have a line or plane of minima, take the best of the ends
+      // and the middle.
+      const glm::dvec3& a = part_.vertices[u];
+      const glm::dvec3& b = part_.vertices[v];
+      candidate.position = (a + b) * 0.5;
+      for (const glm::dvec3& p : {a, b}) {
+        if (q.Error(p) < q.Error(candidate.position)) {
+          candidate.position = p;
+        }
+      }
+    }
+    candidate.error = q.Error(candidate.position);
+    queue_.push(candidate);
+  }
+
+  // The other corners of the triangles around v, with repeats.
+  void Neighbors(uint32_t v, std::vector<uint32_t>* out) const {
+    out->clear();
+    for (uint32_t t : faces_[v]) {
+      for (uint32_t w : part_.triangles[t]) {
+        if (w != v) {
+          out->push_back(w);
+        }
+      }
+    }
+    std::sort(out->begin(), out->end());
+  }
+
+  // Whether an edge from v is used by a single triangle, given its sorted neighbors.
+  static bool OnBoundary(const std::vector<uint32_t>& neighbors) {
+    for (size_t i = 0; i < neighbors.size();) {
+      size_t j = i + 1;
+      while (j < neighbors.size() && neighbors[j] == neighbors[i]) {
+        ++j;
+      }
+      if (j - i == 1) {
+        return true;
+      }
+      i = j;
+    }
+    return false;
+  }
+
+  // Whether the triangles around from keep their orientation when from moves to p.
+  bool KeepsOrientation(uint32_t from, uint32_t other, const glm::dvec3& p) const {
+    for (uint32_t t : faces_[from]) {
+      const Triangle& tri = part_.triangles[t];
+      if (tri[0] == other || tri[1] == other || tri[2] == other) {
+        continue;
+      }
+      std::array<glm::dvec3, 3> corners;
+      for (int i = 0; i < 3; ++i) {
+        corners[i] = part_.vertices[tri[i]];
+      }
+      glm::dvec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+      for (int i = 0; i < 3; ++i) {
+        if (tri[i] == from) {
+          corners[i] = p;
+        }
+      }
+      glm::dvec3 after = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+      double length = glm::length(after);
+      if (length == 0 ||
+          glm::dot(before, after) < kMinNormalCosine * glm::length(before) * length) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Collapse(const Candidate& candidate) {
+    uint32_t keep = part_.locked[candidate.u] ? candidate.u : candidate.v;
+    uint32_t remove = keep == candidate.u ? candidate.v : candidate.u;
+    size_t shared = 0;
+    for (uint32_t t : faces_[remove]) {
+      const Triangle& tri = part_.triangles[t];
+      shared += tri[0] == keep || tri[1] == keep || tri[2] == keep;
+    }
+    if (shared == 0 || shared > 2) {
+      return false;
+    }
+    // The link condition: the corners next to both ends are exactly the third corners of the
+    // triangles on the edge, otherwise the collapse pinches the surface.
+    Neighbors(keep, &keep_neighbors_);
+    Neighbors(remove, &remove_neighbors_);
+    if (shared == 2 && OnBoundary(keep_neighbors_) && OnBoundary(remove_neighbors_)) {
+      return false;
+    }
+    common_.clear();
+    std::set_intersection(keep_neighbors_.begin(),
+                          keep_neighbors_.end(),
+                          remove_neighbors_.begin(),
+                          remove_neighbors_.end(),
+                          std::back_inserter(common_));
+    common_.erase(std::unique(common_.begin(), common_.end()), common_.end());
+    if (common_.size() != shared) {
+      return false;
+    }
+    // Don't collapse tetrahedra and lone triangles to nothing.
+    common_.clear();
+    std::set_union(keep_neighbors_.begin(),
+                   keep_neighbors_.end(),
+                   remove_neighbors_.begin(),
+                   remove_neighbors_.end(),
+                   std::back_inserter(common_));
+    common_.erase(std::unique(common_.begin(), common_.end()), common_.end());
+    if (common_.size() - 2 <= shared) {
+      return false;
+    }
+    if (!KeepsOrientation(remove, keep, candidate.position) ||
+        !KeepsOrientation(keep, remove, candidate.position)) {
+      return false;
+    }
+
+    for (uint32_t t : faces_[remove]) {
+      Triangle& tri = part_.triangles[t];
+      if (tri[0] == keep || tri[1] == keep || tri[2] == keep) {
+        part_.removed[t] = 1;
+        --live_;
+        for (uint32_t w : tri) {
+          if (w != remove) {
+            auto& faces = faces_[w];
+            faces.erase(std::find(faces.begin(), faces.end(), t));
+          }
+        }
+      } else {
+        *std::find(tri.begin(), tri.end(), remove) = keep;
+        faces_[keep].push_back(t);
+      }
+    }
+    faces_[remove].clear();
+    dead_[remove] = 1;
+    part_.vertices[keep] = candidate.position;
+    part_.quadrics[keep] += part_.quadrics[remove];
+    ++versions_[keep];
+    // The errors of the edges around the merged vertex changed.
+    Neighbors(keep, &keep_neighbors_);
+    keep_neighbors_.erase(std::unique(keep_neighbors_.begin(), keep_neighbors_.end()),
+                          keep_neighbors_.end());
+    for (uint32_t w : keep_neighbors_) {
+      Push(keep, w);
+    }
+    return true;
+  }
+
+  Part& part_;
+  // The live triangles around each vertex.
+  std::vector<std::vector<uint32_t>> faces_;
+  // Bumped when a vertex moves, which invalidates the candidates queued for its edges.
+  std::vector<uint32_t> versions_;
+  std::vector<char> dead_;
+  size_t live_;
+  std::priority_queue<Candidate> queue_;
+  std::vector<uint32_t> keep_neighbors_;
+  std::vector<uint32_t> remove_neighbors_;
+  std::vector<uint32_t> common_;
+};
+
+// Sorts the vertices in order[begin, end) into cells of at most kCellVertices by median cuts
+// along the longest axis of their bounds.
+void SplitCells(const std::vector<glm::dvec3>& vertices,
+                std::vector<uint32_t>* order,
+                size_t begin,
+                size_t end,
+                std::vector<std::pair<size_t, size_t>>* cells) {
+  if (end - begin <= kCellVertices) {
+    cells->push_back({begin, end});
+    return;
+  }
+  Aabb bounds;
+  for (size_t i = begin; i < end; ++i) {
+    bounds.Extend(vertices[(*order)[i]]);
+  }
+  glm::dvec3 size = bounds.size();
+  int axis = size.x >= size.y && size.x >= size.z ? 0 : size.y >= size.z ? 1 : 2;
+  size_t middle = begin + (end - begin) / 2;
+  std::nth_element(order->begin() + begin,
+                   order->begin() + middle,
+                   order->begin() + end,
+                   [&](uint32_t a, uint32_t b) {
+                     double x = vertices[a][axis];
+                     double y = vertices[b][axis];
+                     return x != y ? x < y : a < b;
+                   });
+  SplitCells(vertices, order, begin, middle, cells);
+  SplitCells(vertices, order, middle, end, cells);
+}
+
+}  // namespace
+
+Mesh DecimateMesh(const Mesh& mesh,
+                  const DecimateOptions& options,
+                  ThreadPool* pool,
+                  DecimateStats* stats) {
+  DecimateStats local_stats;
+  if (!stats) {
+    stats = &local_stats;
+  }
+  *stats = DecimateStats();
+  stats->triangles_before = mesh.triangles.size();
+  std::vector<Quadric> quadrics = VertexQuadrics(mesh, options.boundary_weight, pool);
+  std::vector<glm::dvec3> vertices = mesh.vertices;
+  std::vector<Triangle> triangles = mesh.triangles;
+  std::vector<char> removed(triangles.size(), 0);
+  size_t count = vertices.size();
+
+  std::vector<uint32_t> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  std::vector<std::pair<size_t, size_t>> cells;
+  SplitCells(vertices, &order, 0, count, &cells);
+  if (cells.size() > 1) {
+    std::vector<uint32_t> cell_of(count);
+    for (uint32_t c = 0; c < cells.size(); ++c) {
+      for (size_t i = cells[c].first; i < cells[c].second; ++i) {
+        cell_of[order[i]] = c;
+      }
+    }
+    // Triangles within one cell and the ones crossing into others, whose corners are locked.
+    std::vector<std::vector<uint32_t>> inner(cells.size());
+    std::vector<std::vector<uint32_t>> crossing(cells.size());
+    std::vector<char> border(count, 0);
+    for (uint32_t t = 0; t < triangles.size(); ++t) {
+      const Triangle& tri = triangles[t];
+      uint32_t c = cell_of[tri[0]];
+      if (cell_of[tri[1]] == c && cell_of[tri[2]] == c) {
+        inner[c].push_back(t);
+        continue;
+      }
+      for (int i = 0; i < 3; ++i) {
+        border[tri[i]] = 1;
+        uint32_t corner_cell = cell_of[tri[i]];
+        if (crossing[corner_cell].empty() || crossing[corner_cell].back() != t) {
+          crossing[corner_cell].push_back(t);
+        }
+      }
+    }
+    std::vector<double> errors(cells.size(), 0);
+    TaskGroup group(pool);
+    for (uint32_t c = 0; c < cells.size(); ++c) {
+      group.Run([&, c] {
+        // Only this cell writes its inner triangles and its vertices which aren't on the border,
+        // the crossing triangles and everything of other cells is only read.
+        Part part;
+        std::vector<uint32_t> globals;
+        std::unordered_map<uint32_t, uint32_t> locals;
+        auto local = [&](uint32_t v) {
+          auto [it, inserted] = locals.emplace(v, static_cast<uint32_t>(globals.size()));
+          if (inserted) {
+            globals.push_back(v);
+            part.vertices.push_back(vertices[v]);
+            part.quadrics.push_back(quadrics[v]);
+            part.locked.push_back(cell_of[v] != c || border[v]);
+          }
+          return it->second;
+        };
+        for (const auto* list : {&inner[c], &crossing[c]}) {
+          for (uint32_t t : *list) {
+            part.triangles.push_back(
+                {local(triangles[t][0]), local(triangles[t][1]), local(triangles[t][2])});
+          }
+        }
+        size_t target = 0;
+        if (options.max_triangles > 0) {
+          target = inner[c].size() * options.max_triangles / triangles.size() + crossing[c].size();
+        }
+        errors[c] = Decimator(&part).Run(target, options.max_error);
+        for (size_t i = 0; i < inner[c].size(); ++i) {
+          const Triangle& tri = part.triangles[i];
+          triangles[inner[c][i]] = {globals[tri[0]], globals[tri[1]], globals[tri[2]]};
+          removed[inner[c][i]] = part.removed[i];
+        }
+        for (uint32_t i = 0; i < globals.size(); ++i) {
+          if (!part.locked[i]) {
+            vertices[globals[i]] = part.vertices[i];
+            quadrics[globals[i]] = part.quadrics[i];
+          }
+        }
+      });
+    }
+    group.Wait();
+    stats->max_error = *std::max_element(errors.begin(), errors.end());
+  }
+
+  // The final pass over everything that is left, which also collapses across the cuts.
+  Part part;
+  part.vertices = std::move(vertices);
+  part.quadrics = std::move(quadrics);
+  part.locked.assign(count, 0);
+  std::vector<uint32_t> sources;
+  for (uint32_t t = 0; t < triangles.size(); ++t) {
+    if (!removed[t]) {
+      part.triangles.push_back(triangles[t]);
+      sources.push_back(t);
+    }
+  }
+  stats->max_error =
+      std::max(stats->max_error, Decimator(&part).Run(options.max_triangles, options.max_error));
+
+  Mesh result;
+  const uint32_t kUnused = ~0u;
+  std::vector<uint32_t> remap(count, kUnused);
+  for (size_t i = 0; i < part.triangles.size(); ++i) {
+    if (part.removed[i]) {
+      continue;
+    }
+    Triangle tri = part.triangles[i];
+    for (uint32_t& v : tri) {
+      if (remap[v] == kUnused) {
+        remap[v] = static_cast<uint32_t>(result.vertices.size());
+        result.vertices.push_back(part.vertices[v]);
+      }
+      v = remap[v];
+    }
+    result.triangles.push_back(tri);
+    if (!mesh.colors.empty()) {
+      result.colors.push_back(mesh.colors[sources[i]]);
+    }
+  }
+  stats->triangles_after = result.triangles.size();
+  return result;
+}
+
+}  // namespace scad
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace scad {
+
+// Quadric error decimation (Garland and Heckbert) for light preview and review meshes.
+
+struct DecimateOptions {
+  // Collapses edges until at most this many triangles are left. Zero for no budget, in which case
+  // max_error should be set.
+  size_t max_triangles = 0;
+  // Never collapses an edge whose error is larger than this. The error of a vertex is the root
+  // mean square distance, weighted by area, from the planes of the original triangles merged into
+  // it.
+  double max_error = std::numeric_limits<double>::infinity();
+  // Weight of the planes through boundary edges, perpendicular to their triangle, relative to the
+  // planes of the triangles. High values keep holes and open edges in place.
+  double boundary_weight = 100;
+};
+
+struct DecimateStats {
+  size_t triangles_before = 0;
+  size_t triangles_after = 0;
+  // The largest error of a collapse which was made.
+  double max_error = 0;
+};
+
+// Collapses the edges of least error one after another from a priority queue, moving the merged
+// vertex to the point which minimizes the sum of the quadrics of both ends. Collapses which would
+// make the mesh non manifold or turn a triangle over are skipped. The mesh should be welded, see
+// RepairMesh.
+//
+// The vertices are split into cells by median cuts along the longest axis and each cell is first
+// decimated on the pool, up to its share of the budget, without touching the triangles which cross
+// into other cells. A final pass over the whole mesh then collapses across the cuts. Colors are
+// kept and the result doesn't depend on the number of threads. Stats may be null.
+Mesh DecimateMesh(const Mesh& mesh,
+                  const DecimateOptions& options,
+                  ThreadPool* pool = nullptr,
+                  DecimateStats* stats = nullptr);
+
+}  // namespace scad
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+#include "serialize.h"
+
+namespace scad {
+namespace {
+
+// Vertices and triangles as they are written: welded, and mirrored if asked for.
+struct ExportMesh {
+  Mesh mesh;
+
+  ExportMesh(const Mesh& source, bool mirror_x) : mesh(WeldMesh(source)) {
+    if (mirror_x) {
+      for (glm::dvec3& v : mesh.vertices) {
+        v.x = -v.x;
+      }
+      for (auto& t : mesh.triangles) {
+        std::swap(t[1], t[2]);
+      }
+    }
+  }
+};
+
+void AppendFormat(std::string* out, const char* format, double a, double b, double c) {
+  char buffer[128];
+  int length = snprintf(buffer, sizeof(buffer), format, a, b, c);
+  out->append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+void AppendFormat(std::string* out, const char* format, uint32_t a, uint32_t b, uint32_t c) {
+  char buffer[128];
+  int length = snprintf(buffer, sizeof(buffer), format, a, b, c);
+  out->append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+bool WriteFile(const std::string& file_name, const std::string& data) {
+  std::FILE* file = nullptr;
+#ifdef _WIN32
+  if (fopen_s(&file, file_name.c_str(), "wb") != 0) {
+    file = nullptr;
+  }
+#else
+  file = std::fopen(file_name.c_str(), "wb");
+#endif
+  if (!file) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "Could not write %s\n", file_name.c_str());
+  }
+  return ok;
+}
+
+uint32_t Crc32(const std::string& data) {
+  static const std::vector<uint32_t> table = [] {
+    std::vector<uint32_t> table(256);
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+    return table;
+  }();
+  uint32_t crc = 0xffffffffu;
+  for (unsigned char c : data) {
+    crc = table[(crc ^ c) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffffu;
+}
+
+void PutU16(uint16_t value, std::string* out) {
+  out->push_back(static_cast<char>(value & 0xff));
+  out->push_back(static_cast<char>(value >> 8));
+}
+
+// Builds a zip archive with uncompressed entries, which is all a 3mf container needs. Timestamps
+// are fixed so the same model always gives the same file.
+class ZipWriter {
+ public:
+  bool Add(const std::string& name, const std::string& data) {
+    if (data.size() >= 0xffffffffu || archive_.size() >= 0xffffffffu - data.size()) {
+      // Would need zip64.
+      return false;
+    }
+    Entry entry = {name, Crc32(data), static_cast<uint32_t>(data.size()),
+                   static_cast<uint32_t>(archive_.size())};
+    PutU32(0x04034b50, &archive_);
+    PutHeaderFields(entry, &archive_);
+    archive_ += name;
+    archive_ += data;
+    entries_.push_back(entry);
+    return true;
+  }
+
+  std::string Finish() {
+    uint32_t directory_offset = static_cast<uint32_t>(archive_.size());
+    for (const Entry& entry : entries_) {
+      PutU32(0x02014b50, &archive_);
+      PutU16(20, &archive_);  // Version made by.
+      PutHeaderFields(entry, &archive_);
+      PutU16(0, &archive_);  // Comment length.
+      PutU16(0, &archive_);  // Disk number.
+      PutU16(0, &archive_);  // Internal attributes.
+      PutU32(0, &archive_);  // External attributes.
+      PutU32(entry.offset, &archive_);
+      archive_ += entry.name;
+    }
+    uint32_t directory_size = static_cast<uint32_t>(archive_.size()) - directory_offset;
+    PutU32(0x06054b50, &archive_);
+    PutU16(0, &archive_);
+    PutU16(0, &archive_);
+    PutU16(static_cast<uint16_t>(entries_.size()), &archive_);
+    PutU16(static_cast<uint16_t>(entries_.size()), &archive_);
+    PutU32(directory_size, &archive_);
+    PutU32(directory_offset, &archive_);
+    PutU16(0, &archive_);
+    return std::move(archive_);
+  }
+
+ private:
+  struct Entry {
+    std::string name;
+    uint32_t crc;
+    uint32_t size;
+    uint32_t offset;
+  };
+
+  // The fields shared by local headers and central directory entries.
+  static void PutHeaderFields(const Entry& entry, std::string* out) {
+    PutU16(20, out);    // Version needed.
+    PutU16(0, out);     // Flags.
+    PutU16(0, out);     // Stored.
+    PutU16(0, out);     // Time.
+    PutU16(0x21, out);  // Date, 1980-01-01.
+    PutU32(entry.crc, out);
+    PutU32(entry.size, out);  // Compressed size.
+    PutU32(entry.size, out);
+    PutU16(static_cast<uint16_t>(entry.name.size()), out);
+    PutU16(0, out);  // Extra length.
+  }
+
+  std::string archive_;
+  std::vector<Entry> entries_;
+};
+
+const char k3mfContentTypes[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n"
+    "  <Default Extension=\"rels\" "
+    "ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n"
+    "  <Default Extension=\"model\" "
+    "ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>\n"
+    "</Types>\n";
+
+const char k3mfRelationships[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n"
+    "  <Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" "
+    "Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>\n"
+    "</Relationships>\n";
+
+}  // namespace
+
+bool Mesh::WriteObj(const std::string& file_name, bool mirror_x) const {
+  ExportMesh out(*this, mirror_x);
+  std::string data;
+  data.reserve(out.mesh.vertices.size() * 40 + out.mesh.triangles.size() * 24);
+  for (const glm::dvec3& v : out.mesh.vertices) {
+    AppendFormat(&data, "v %.9g %.9g %.9g\n", v.x, v.y, v.z);
+  }
+  // Obj indices start at one.
+  for (const auto& t : out.mesh.triangles) {
+    AppendFormat(&data, "f %u %u %u\n", t[0] + 1, t[1] + 1, t[2] + 1);
+  }
+  return WriteFile(file_name, data);
+}
+
+bool Mesh::WritePly(const std::string& file_name, bool mirror_x) const {
+  ExportMesh out(*this, mirror_x);
+  const Mesh& mesh = out.mesh;
+  bool colored = !mesh.colors.empty();
+  std::string data =
+      "ply\n"
+      "format binary_little_endian 1.0\n"
+      "element vertex " +
+      std::to_string(mesh.vertices.size()) +
+      "\n"
+      "property float x\n"
+      "property float y\n"
+      "property float z\n"
+      "element face " +
+      std::to_string(mesh.triangles.size()) +
+      "\n"
+      "property list uchar uint vertex_indices\n";
+  if (colored) {
+    data +=
+        "property uchar red\n"
+        "property uchar green\n"
+        "property uchar blue\n"
+        "property uchar alpha\n";
+  }
+  data += "end_header\n";
+  data.reserve(data.size() + mesh.vertices.size() * 12 + mesh.triangles.size() * 17);
+  for (const glm::dvec3& v : mesh.vertices) {
+    float values[3] = {static_cast<float>(v.x), static_cast<float>(v.y), static_cast<float>(v.z)};
+    uint32_t bits;
+    for (float value : values) {
+      std::memcpy(&bits, &value, sizeof(bits));
+      PutU32(bits, &data);
+    }
+  }
+  for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+    data.push_back(3);
+    for (uint32_t index : mesh.triangles[i]) {
+      PutU32(index, &data);
+    }
+    if (colored) {
+      // Uncolored faces are written white.
+      PackedColor color = mesh.colors[i] == 0 ? 0xffffffffu : mesh.colors[i];
+      for (int shift = 24; shift >= 0; shift -= 8) {
+        data.push_back(static_cast<char>((color >> shift) & 0xff));
+      }
+    }
+  }
+  return WriteFile(file_name, data);
+}
+
+bool Mesh::Write3mf(const std::string& file_name, bool mirror_x) const {
+  ExportMesh out(*this, mirror_x);
+  const Mesh& mesh = out.mesh;
+
+  // Every distinct color becomes a base material. Uncolored triangles use a default material so
+  // the object level property applies to them.
+  std::map<PackedColor, uint32_t> materials;
+  for (PackedColor color : mesh.colors) {
+    materials.emplace(color == 0 ? 0xffffffffu : color, 0);
+  }
+  uint32_t next_material = 0;
+  for (auto& entry : materials) {
+    entry.second = next_material++;
+  }
+
+  std::string model;
+  model.reserve(mesh.vertices.size() * 60 + mesh.triangles.size() * 60 + 1024);
+  model +=
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<model unit=\"millimeter\" xml:lang=\"en-US\" "
+      "xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+      "  <resources>\n";
+  if (!materials.empty()) {
+    model += "    <basematerials id=\"1\">\n";
+    for (const auto& entry : materials) {
+      char color[16];
+      snprintf(color, sizeof(color), "#%08X", entry.first);
+      model += "      <base name=\"" + std::string(color + 1) + "\" displaycolor=\"" + color +
+               "\"/>\n";
+    }
+    model += "    </basematerials>\n";
+    model += "    <object id=\"2\" type=\"model\" pid=\"1\" pindex=\"0\">\n";
+  } else {
+    model += "    <object id=\"2\" type=\"model\">\n";
+  }
+  model += "      <mesh>\n        <vertices>\n";
+  for (const glm::dvec3& v : mesh.vertices) {
+    AppendFormat(&model, "          <vertex x=\"%.9g\" y=\"%.9g\" z=\"%.9g\"/>\n", v.x, v.y, v.z);
+  }
+  model += "        </vertices>\n        <triangles>\n";
+  for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+    const auto& t = mesh.triangles[i];
+    AppendFormat(&model, "          <triangle v1=\"%u\" v2=\"%u\" v3=\"%u\"", t[0], t[1], t[2]);
+    if (!materials.empty()) {
+      PackedColor color = mesh.colors[i] == 0 ? 0xffffffffu : mesh.colors[i];
+      model += " pid=\"1\" p1=\"" + std::to_string(materials[color]) + "\"";
+    }
+    model += "/>\n";
+  }
+  model +=
+      "        </triangles>\n"
+      "      </mesh>\n"
+      "    </object>\n"
+      "  </resources>\n"
+      "  <build>\n"
+      "    <item objectid=\"2\"/>\n"
+      "  </build>\n"
+      "</model>\n";
+
+  ZipWriter zip;
+  if (!zip.Add("[Content_Types].xml", k3mfContentTypes) ||
+      !zip.Add("_rels/.rels", k3mfRelationships) || !zip.Add("3D/3dmodel.model", model)) {
+    fprintf(stderr, "%s is too large for a 3mf file\n", file_name.c_str());
+    return false;
+  }
+  return WriteFile(file_name, zip.Finish());
+}
+
+}  // namespace scad
@@ -0,0 +1,584 @@
+#include "mesh_repair.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace scad {
+namespace {
+
+using Triangle = std::array<uint32_t, 3>;
+
+constexpr size_t kChunkSize = 4096;
+
+// Runs f(begin, end) over chunks of [0, count) on the pool.
+template <typename F>
+void ParallelChunks(ThreadPool* pool, size_t count, size_t chunk, const F& f) {
+  TaskGroup group(pool);
+  for (size_t begin = 0; begin < count; begin += chunk) {
+    size_t end = std::min(count, begin + chunk);
+    group.Run([&f, begin, end] { f(begin, end); });
+  }
+  group.Wait();
+}
+
+size_t NumChunks(size_t count) {
+  return (count + kChunkSize - 1) / kChunkSize;
+}
+
+uint64_t EdgeKey(uint32_t a, uint32_t b) {
+  return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+// The height of the triangle over its longest edge, which starts at corner *longest. Zero for
+// repeated corners.
+double Height(const std::vector<glm::dvec3>& vertices, const Triangle& t, int* longest) {
+  *longest = 0;
+  if (t[0] == t[1] || t[1] == t[2] || t[2] == t[0]) {
+    return 0;
+  }
+  double longest_squared = -1;
+  for (int e = 0; e < 3; ++e) {
+    glm::dvec3 edge = vertices[t[(e + 1) % 3]] - vertices[t[e]];
+    double squared = glm::dot(edge, edge);
+    if (squared > longest_squared) {
+      longest_squared = squared;
+      *longest = e;
+    }
+  }
+  if (longest_squared <= 0) {
+    return 0;
+  }
+  const glm::dvec3& a = vertices[t[0]];
+  return glm::length(glm::cross(vertices[t[1]] - a, vertices[t[2]] - a)) /
+         std::sqrt(longest_squared);
+}
+
+// A use of an edge by a triangle, keyed by the corners of the edge in increasing order.
+struct EdgeUse {
+  uint64_t key = 0;
+  uint32_t triangle = 0;
+  // Whether the triangle runs along the edge from the lower to the higher corner.
+  bool forward = false;
+
+  uint32_t from() const {
+    return forward ? static_cast<uint32_t>(key >> 32) : static_cast<uint32_t>(key);
+  }
+  uint32_t to() const {
+    return forward ? static_cast<uint32_t>(key) : static_cast<uint32_t>(key >> 32);
+  }
+  bool operator<(const EdgeUse& other) const {
+    return key != other.key ? key < other.key : triangle < other.triangle;
+  }
+};
+
+// The uses of every edge, sorted by edge. Edges of repeated corners are left out.
+std::vector<EdgeUse> EdgeUses(const std::vector<Triangle>& triangles, ThreadPool* pool) {
+  std::vector<EdgeUse> uses(triangles.size() * 3);
+  ParallelChunks(pool, triangles.size(), kChunkSize, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      for (int e = 0; e < 3; ++e) {
+        uint32_t a = triangles[i][e];
+        uint32_t b = triangles[i][(e + 1) % 3];
+        uses[i * 3 + e] = {
+            EdgeKey(std::min(a, b), std::max(a, b)), static_cast<uint32_t>(i), a < b};
+      }
+    }
+  });
+  uses.erase(std::remove_if(uses.begin(),
+                            uses.end(),
+                            [](const EdgeUse& use) { return use.from() == use.to(); }),
+             uses.end());
+  std::sort(uses.begin(), uses.end());
+  return uses;
+}
+
+// Calls f(first, count) for the uses of each edge.
+template <typename F>
+void ForEachEdge(const std::vector<EdgeUse>& uses, const F& f) {
+  for (size_t i = 0; i < uses.size();) {
+    size_t j = i + 1;
+    while (j < uses.size() && uses[j].key == uses[i].key) {
+      ++j;
+    }
+    f(i, j - i);
+    i = j;
+  }
+}
+
+class MeshRepairer {
+ public:
+  MeshRepairer(const Mesh& mesh,
+               const MeshRepairOptions& options,
+               ThreadPool* pool,
+               MeshRepairStats* stats)
+      : vertices_(mesh.vertices),
+        triangles_(mesh.triangles),
+        colors_(mesh.colors),
+        options_(options),
+        pool_(pool),
+        stats_(stats) {
+  }
+
+  Mesh Run() {
+    Weld();
+    CollapseShortEdges();
+    SplitCaps();
+    RemoveDuplicates();
+    Orient();
+    FillHoles();
+    Mesh mesh;
+    Compact(&mesh);
+    return mesh;
+  }
+
+ private:
+  // Each chunk of vertices is first welded on a grid of its own, in parallel, which catches most
+  // duplicates since the corners of neighboring triangles are mostly close together in the list.
+  // The survivors are then welded on one grid, in chunk order.
+  void Weld() {
+    size_t count = vertices_.size();
+    std::vector<uint32_t> local(count);
+    std::vector<std::vector<glm::dvec3>> chunk_vertices(NumChunks(count));
+    ParallelChunks(pool_, count, kChunkSize, [&](size_t begin, size_t end) {
+      VertexWelder welder(options_.weld_tolerance);
+      for (size_t i = begin; i < end; ++i) {
+        local[i] = welder.Add(vertices_[i]);
+      }
+      chunk_vertices[begin / kChunkSize] = welder.TakeVertices();
+    });
+    VertexWelder welder(options_.weld_tolerance);
+    std::vector<std::vector<uint32_t>> chunk_remap(chunk_vertices.size());
+    for (size_t c = 0; c < chunk_vertices.size(); ++c) {
+      for (const glm::dvec3& p : chunk_vertices[c]) {
+        chunk_remap[c].push_back(welder.Add(p));
+      }
+    }
+    std::vector<uint32_t> remap(count);
+    ParallelChunks(pool_, count, kChunkSize, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        remap[i] = chunk_remap[i / kChunkSize][local[i]];
+      }
+    });
+    vertices_ = welder.TakeVertices();
+    stats_->merged_vertices += count - vertices_.size();
+    Remap(remap);
+  }
+
+  // Replaces the corners of the triangles and removes the ones which lose their area.
+  void Remap(const std::vector<uint32_t>& remap) {
+    std::vector<char> removed(triangles_.size(), 0);
+    ParallelChunks(pool_, triangles_.size(), kChunkSize, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        Triangle& t = triangles_[i];
+        t = {remap[t[0]], remap[t[1]], remap[t[2]]};
+        removed[i] = t[0] == t[1] || t[1] == t[2] || t[2] == t[0];
+      }
+    });
+    stats_->collapsed_triangles += Remove(removed);
+  }
+
+  // Removes the marked triangles and returns how many there were.
+  size_t Remove(const std::vector<char>& removed) {
+    size_t kept = 0;
+    for (size_t i = 0; i < triangles_.size(); ++i) {
+      if (!removed[i]) {
+        triangles_[kept] = triangles_[i];
+        if (!colors_.empty()) {
+          colors_[kept] = colors_[i];
+        }
+        ++kept;
+      }
+    }
+    size_t count = triangles_.size() - kept;
+    triangles_.resize(kept);
+    if (!colors_.empty()) {
+      colors_.resize(kept);
+    }
+    return count;
+  }
+
+  // Merges the corners of edges shorter than the sliver tolerance, which removes needles and the
+  // triangles of zero area around them. Every group of corners joined by short edges becomes the
+  // corner with the lowest index.
+  void CollapseShortEdges() {
+    double limit = options_.sliver_tolerance * options_.sliver_tolerance;
+    for (int round = 0; round < 16; ++round) {
+      std::vector<std::vector<std::pair<uint32_t, uint32_t>>> chunk_edges(
+          NumChunks(triangles_.size()));
+      ParallelChunks(pool_, triangles_.size(), kChunkSize, [&](size_t begin, size_t end) {
+        auto& edges = chunk_edges[begin / kChunkSize];
+        for (size_t i = begin; i < end; ++i) {
+          for (int e = 0; e < 3; ++e) {
+            uint32_t a = triangles_[i][e];
+            uint32_t b = triangles_[i][(e + 1) % 3];
+            glm::dvec3 edge = vertices_[b] - vertices_[a];
+            if (glm::dot(edge, edge) < limit) {
+              edges.push_back({a, b});
+            }
+          }
+        }
+      });
+      std::vector<uint32_t> parents(vertices_.size());
+      std::iota(parents.begin(), parents.end(), 0);
+      auto find = [&](uint32_t i) {
+        while (parents[i] != i) {
+          parents[i] = parents[parents[i]];
+          i = parents[i];
+        }
+        return i;
+      };
+      size_t merged = 0;
+      for (const auto& edges : chunk_edges) {
+        for (const auto& [a, b] : edges) {
+          uint32_t root_a = find(a);
+          uint32_t root_b = find(b);
+          if (root_a != root_b) {
+            parents[std::max(root_a, root_b)] = std::min(root_a, root_b);
+            ++merged;
+          }
+        }
+      }
+      if (merged == 0) {
+        return;
+      }
+      for (uint32_t i = 0; i < parents.size(); ++i) {
+        parents[i] = find(i);
+      }
+      stats_->merged_vertices += merged;
+      Remap(parents);
+    }
+  }
+
+  // A thin triangle without a short edge has a corner lying on its longest edge. The triangle
+  // across that edge is split at the corner, which takes over the two short edges of the sliver,
+  // and the sliver is removed. This also resolves the T-junctions such corners often are.
+  void SplitCaps() {
+    std::unordered_map<uint64_t, uint32_t> half_edges;
+    auto link = [&](uint32_t t, bool add) {
+      for (int e = 0; e < 3; ++e) {
+        uint64_t key = EdgeKey(triangles_[t][e], triangles_[t][(e + 1) % 3]);
+        if (add) {
+          half_edges[key] = t;
+        } else {
+          auto it = half_edges.find(key);
+          if (it != half_edges.end() && it->second == t) {
+            half_edges.erase(it);
+          }
+        }
+      }
+    };
+    for (uint32_t t = 0; t < triangles_.size(); ++t) {
+      link(t, true);
+    }
+    std::vector<char> removed(triangles_.size(), 0);
+    // Splits can make new slivers, the limit keeps pathological cases finite.
+    size_t budget = triangles_.size() * 4;
+    for (uint32_t t = 0; t < triangles_.size() && budget > 0; ++t) {
+      int longest = 0;
+      if (removed[t] ||
+          Height(vertices_, triangles_[t], &longest) >= options_.sliver_tolerance) {
+        continue;
+      }
+      uint32_t a = triangles_[t][longest];
+      uint32_t b = triangles_[t][(longest + 1) % 3];
+      uint32_t c = triangles_[t][(longest + 2) % 3];
+      auto it = half_edges.find(EdgeKey(b, a));
+      if (it == half_edges.end() || it->second == t || removed[it->second]) {
+        continue;
+      }
+      uint32_t n = it->second;
+      Triangle across = triangles_[n];
+      uint32_t d = across[0] != a && across[0] != b   ? across[0]
+                   : across[1] != a && across[1] != b ? across[1]
+                                                      : across[2];
+      if (d == c) {
+        continue;
+      }
+      link(t, false);
+      link(n, false);
+      removed[t] = 1;
+      triangles_[n] = {b, c, d};
+      triangles_.push_back({c, a, d});
+      removed.push_back(0);
+      if (!colors_.empty()) {
+        colors_.push_back(colors_[n]);
+      }
+      link(n, true);
+      link(static_cast<uint32_t>(triangles_.size() - 1), true);
+      --budget;
+    }
+    stats_->collapsed_triangles += Remove(removed);
+  }
+
+  // Copies of a triangle facing the same way are removed, and pairs facing opposite ways are
+  // removed entirely.
+  void RemoveDuplicates() {
+    // Corners in increasing order, whether that order turns the same way as the triangle and the
+    // index of the triangle.
+    struct Entry {
+      Triangle sorted;
+      bool even;
+      uint32_t triangle;
+    };
+    std::vector<Entry> entries(triangles_.size());
+    ParallelChunks(pool_, triangles_.size(), kChunkSize, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        const Triangle& t = triangles_[i];
+        Triangle sorted = t;
+        std::sort(sorted.begin(), sorted.end());
+        // Rotations of the sorted order keep the direction.
+        bool even = (t[0] == sorted[0] && t[1] == sorted[1]) ||
+                    (t[1] == sorted[0] && t[2] == sorted[1]) ||
+                    (t[2] == sorted[0] && t[0] == sorted[1]);
+        entries[i] = {sorted, even, static_cast<uint32_t>(i)};
+      }
+    });
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+      return a.sorted != b.sorted ? a.sorted < b.sorted : a.triangle < b.triangle;
+    });
+    std::vector<char> removed(triangles_.size(), 0);
+    for (size_t i = 0; i < entries.size();) {
+      size_t j = i + 1;
+      while (j < entries.size() && entries[j].sorted == entries[i].sorted) {
+        ++j;
+      }
+      if (j - i > 1) {
+        std::vector<uint32_t> sides[2];
+        for (size_t k = i; k < j; ++k) {
+          sides[entries[k].even].push_back(entries[k].triangle);
+        }
+        // Opposite copies cancel, one of the rest is kept.
+        size_t cancelled = std::min(sides[0].size(), sides[1].size());
+        for (int side = 0; side < 2; ++side) {
+          size_t keep = sides[side].size() > cancelled ? 1 : 0;
+          for (size_t k = 0; k + keep < sides[side].size(); ++k) {
+            removed[sides[side][sides[side].size() - 1 - k]] = 1;
+          }
+        }
+      }
+      i = j;
+    }
+    stats_->duplicate_triangles += Remove(removed);
+  }
+
+  // Turns triangles so that neighbors across manifold edges agree. Each connected part is then
+  // turned as a whole so that it faces outwards if it is closed, or so that the fewest triangles
+  // change if it isn't.
+  void Orient() {
+    std::vector<EdgeUse> uses = EdgeUses(triangles_, pool_);
+    size_t count = triangles_.size();
+    // Neighbors across manifold edges and whether they run along the edge the same way.
+    std::vector<std::vector<std::pair<uint32_t, bool>>> neighbors(count);
+    std::vector<char> open(count, 0);
+    ForEachEdge(uses, [&](size_t first, size_t edge_uses) {
+      if (edge_uses != 2) {
+        for (size_t k = first; k < first + edge_uses; ++k) {
+          open[uses[k].triangle] = 1;
+        }
+        return;
+      }
+      const EdgeUse& a = uses[first];
+      const EdgeUse& b = uses[first + 1];
+      bool same = a.forward == b.forward;
+      neighbors[a.triangle].push_back({b.triangle, same});
+      neighbors[b.triangle].push_back({a.triangle, same});
+    });
+
+    std::vector<char> flip(count, 0);
+    std::vector<char> visited(count, 0);
+    std::vector<uint32_t> part;
+    std::vector<uint32_t> stack;
+    for (uint32_t seed = 0; seed < count; ++seed) {
+      if (visited[seed]) {
+        continue;
+      }
+      part.clear();
+      visited[seed] = 1;
+      stack.assign(1, seed);
+      bool closed = true;
+      while (!stack.empty()) {
+        uint32_t t = stack.back();
+        stack.pop_back();
+        part.push_back(t);
+        closed = closed && !open[t];
+        for (const auto& [n, same] : neighbors[t]) {
+          if (!visited[n]) {
+            visited[n] = 1;
+            flip[n] = flip[t] ^ same;
+            stack.push_back(n);
+          }
+        }
+      }
+      size_t flipped = 0;
+      double volume = 0;
+      for (uint32_t t : part) {
+        flipped += flip[t];
+        const Triangle& tri = triangles_[t];
+        double signed_volume = glm::dot(vertices_[tri[0]],
+                                        glm::cross(vertices_[tri[1]], vertices_[tri[2]]));
+        volume += flip[t] ? -signed_volume : signed_volume;
+      }
+      if (closed ? volume < 0 : flipped * 2 > part.size()) {
+        for (uint32_t t : part) {
+          flip[t] ^= 1;
+        }
+      }
+    }
+    size_t flipped = 0;
+    for (size_t t = 0; t < count; ++t) {
+      if (flip[t]) {
+        std::swap(triangles_[t][1], triangles_[t][2]);
+        ++flipped;
+      }
+    }
+    stats_->flipped_triangles += flipped;
+  }
+
+  // Follows the edges used by a single triangle around each hole. Holes whose boundary passes a
+  // corner more than once, or which are too long, are left open.
+  void FillHoles() {
+    std::vector<EdgeUse> boundary;
+    std::vector<EdgeUse> uses = EdgeUses(triangles_, pool_);
+    ForEachEdge(uses, [&](size_t first, size_t edge_uses) {
+      if (edge_uses == 1) {
+        boundary.push_back(uses[first]);
+      }
+    });
+    std::unordered_map<uint32_t, std::vector<uint32_t>> outgoing;
+    for (uint32_t i = 0; i < boundary.size(); ++i) {
+      outgoing[boundary[i].from()].push_back(i);
+    }
+    std::vector<char> visited(boundary.size(), 0);
+    std::vector<uint32_t> loop;
+    for (uint32_t start = 0; start < boundary.size(); ++start) {
+      if (visited[start]) {
+        continue;
+      }
+      loop.assign(1, start);
+      visited[start] = 1;
+      bool closed = false;
+      while (loop.size() <= options_.max_hole_edges) {
+        const std::vector<uint32_t>& next = outgoing[boundary[loop.back()].to()];
+        if (next.size() != 1 || (visited[next[0]] && next[0] != start)) {
+          break;
+        }
+        if (next[0] == start) {
+          closed = true;
+          break;
+        }
+        visited[next[0]] = 1;
+        loop.push_back(next[0]);
+      }
+      if (!closed || loop.size() < 3) {
+        continue;
+      }
+      PackedColor color = colors_.empty() ? 0 : colors_[boundary[start].triangle];
+      auto add = [&](const Triangle& t) {
+        triangles_.push_back(t);
+        if (!colors_.empty()) {
+          colors_.push_back(color);
+        }
+      };
+      if (loop.size() == 3) {
+        add({boundary[loop[0]].from(), boundary[loop[2]].from(), boundary[loop[1]].from()});
+      } else {
+        // A fan around the center, which also handles holes which aren't flat.
+        glm::dvec3 center(0);
+        for (uint32_t edge : loop) {
+          center += vertices_[boundary[edge].from()];
+        }
+        uint32_t middle = static_cast<uint32_t>(vertices_.size());
+        vertices_.push_back(center / static_cast<double>(loop.size()));
+        for (uint32_t edge : loop) {
+          add({boundary[edge].to(), boundary[edge].from(), middle});
+        }
+      }
+      ++stats_->filled_holes;
+    }
+  }
+
+  // Moves the result into mesh, without the vertices no triangle uses.
+  void Compact(Mesh* mesh) {
+    const uint32_t kUnused = ~0u;
+    std::vector<uint32_t> remap(vertices_.size(), kUnused);
+    for (Triangle& t : triangles_) {
+      for (uint32_t& v : t) {
+        if (remap[v] == kUnused) {
+          remap[v] = static_cast<uint32_t>(mesh->vertices.size());
+          mesh->vertices.push_back(vertices_[v]);
+        }
+        v = remap[v];
+      }
+    }
+    mesh->triangles = std::move(triangles_);
+    mesh->colors = std::move(colors_);
+  }
+
+  std::vector<glm::dvec3> vertices_;
+  std::vector<Triangle> triangles_;
+  std::vector<PackedColor> colors_;
+  const MeshRepairOptions& options_;
+  ThreadPool* pool_;
+  MeshRepairStats* stats_;
+};
+
+}  // namespace
+
+MeshStats CheckMesh(const Mesh& mesh, double sliver_tolerance, ThreadPool* pool) {
+  MeshStats stats;
+  stats.vertices = mesh.vertices.size();
+  stats.triangles = mesh.triangles.size();
+  std::vector<std::array<size_t, 2>> counts(NumChunks(mesh.triangles.size()), {0, 0});
+  ParallelChunks(pool, mesh.triangles.size(), kChunkSize, [&](size_t begin, size_t end) {
+    std::array<size_t, 2>& count = counts[begin / kChunkSize];
+    for (size_t i = begin; i < end; ++i) {
+      int longest = 0;
+      double height = Height(mesh.vertices, mesh.triangles[i], &longest);
+      if (height == 0) {
+        ++count[0];
+      } else if (height < sliver_tolerance) {
+        ++count[1];
+      }
+    }
+  });
+  for (const auto& count : counts) {
+    stats.degenerate_triangles += count[0];
+    stats.sliver_triangles += count[1];
+  }
+  std::vector<EdgeUse> uses = EdgeUses(mesh.triangles, pool);
+  ForEachEdge(uses, [&](size_t first, size_t edge_uses) {
+    if (edge_uses == 1) {
+      ++stats.boundary_edges;
+    } else if (edge_uses > 2) {
+      ++stats.non_manifold_edges;
+    } else if (uses[first].forward == uses[first + 1].forward) {
+      ++stats.misoriented_edges;
+    }
+  });
+  return stats;
+}
+
+Mesh RepairMesh(const Mesh& mesh,
+                const MeshRepairOptions& options,
+                ThreadPool* pool,
+                MeshRepairStats* stats) {
+  MeshRepairStats local_stats;
+  if (!stats) {
+    stats = &local_stats;
+  }
+  *stats = MeshRepairStats();
+  stats->before = CheckMesh(mesh, options.sliver_tolerance, pool);
+  MeshRepairer repairer(mesh, options, pool, stats);
+  Mesh result = repairer.Run();
+  stats->after = CheckMesh(result, options.sliver_tolerance, pool);
+  return result;
+}
+
+}  // namespace scad
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace scad {
+
+// Cleanup of triangle meshes, e.g. imported stls or the boundary of the hulls around the thin
+// posts, whose duplicate vertices and near degenerate slivers make booleans and slicers slow and
+// fragile.
+
+struct MeshRepairOptions {
+  // Vertices closer than this are merged.
+  double weld_tolerance = kGeometryEpsilon;
+  // Triangles with a height below this are slivers. Their short edges are collapsed and corners
+  // lying on the opposite edge are split into the triangle across that edge.
+  double sliver_tolerance = 1e-5;
+  // Holes bounded by at most this many edges are closed with a fan of triangles.
+  size_t max_hole_edges = 32;
+};
+
+// Defects of a mesh. Edges are counted once for all triangles using them.
+struct MeshStats {
+  size_t vertices = 0;
+  size_t triangles = 0;
+  // Edges of a single triangle.
+  size_t boundary_edges = 0;
+  // Edges of more than two triangles.
+  size_t non_manifold_edges = 0;
+  // Edges of two triangles which run along them in the same direction, i.e. face opposite ways.
+  size_t misoriented_edges = 0;
+  // Triangles with repeated corners or zero area.
+  size_t degenerate_triangles = 0;
+  // Other triangles with a height below the sliver tolerance.
+  size_t sliver_triangles = 0;
+
+  // Whether the mesh is a closed, consistently oriented 2-manifold.
+  bool closed() const {
+    return boundary_edges == 0 && non_manifold_edges == 0 && misoriented_edges == 0;
+  }
+};
+
+struct MeshRepairStats {
+  MeshStats before;
+  MeshStats after;
+  // Vertices merged into others by welding and by collapsing short edges.
+  size_t merged_vertices = 0;
+  // Degenerate triangles and slivers removed.
+  size_t collapsed_triangles = 0;
+  // Copies of triangles removed. Two copies facing opposite ways are an internal wall and are
+  // both removed.
+  size_t duplicate_triangles = 0;
+  // Triangles turned around to agree with their neighbors or so that closed parts face outwards.
+  size_t flipped_triangles = 0;
+  size_t filled_holes = 0;
+};
+
+// Counts the defects of the mesh. The triangles are checked in chunks on the pool.
+MeshStats CheckMesh(const Mesh& mesh,
+                    double sliver_tolerance = MeshRepairOptions().sliver_tolerance,
+                    ThreadPool* pool = nullptr);
+
+// Welds the vertices on a spatial hash grid, collapses degenerate and sliver triangles, removes
+// duplicate triangles, makes the orientation consistent and fills small holes. Unused vertices are
+// dropped and colors are kept, filled holes take the color of a triangle along their boundary.
+// Per triangle and per vertex work is done in chunks on the pool and the result doesn't depend on
+// the number of threads. Stats may be null.
+Mesh RepairMesh(const Mesh& mesh,
+                const MeshRepairOptions& options = MeshRepairOptions(),
+                ThreadPool* pool = nullptr,
+                MeshRepairStats* stats = nullptr);
+
+}  // namespace scad
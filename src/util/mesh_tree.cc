@@ -0,0 +1,609 @@
+#include "mesh_tree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "mesh.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCAD_MESH_TREE_SSE2 1
+#endif
+
+namespace scad {
+namespace {
+
+const uint32_t kMaxLeafSize = 8;
+const int kBinCount = 16;
+// Cost of visiting a node relative to testing a triangle.
+const double kTraversalCost = 1;
+// Deeper nodes are split at the median so the traversal stacks below can't overflow, 32 more
+// levels are enough for any triangle count.
+const int kMaxSahDepth = 48;
+const int kStackSize = 96;
+// Node boxes are grown by this much relative to their coordinates so single precision errors in
+// the query (e.g. rounding the ray origin) never make a node be missed.
+const double kNodePadding = 1e-6;
+
+float RoundDown(double v) {
+  v -= kNodePadding * (std::abs(v) + 1);
+  float f = static_cast<float>(v);
+  return f > v ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+
+float RoundUp(double v) {
+  v += kNodePadding * (std::abs(v) + 1);
+  float f = static_cast<float>(v);
+  return f < v ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+double Area(const Aabb& box) {
+  glm::dvec3 size = box.size();
+  return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+Aabb TriangleBox(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c) {
+  return Aabb(glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)));
+}
+
+// A query box or point in the layout of a node so both load into one register.
+struct FloatBox {
+  float min[4];
+  float max[4];
+};
+
+FloatBox ToFloatBox(const Aabb& box, double epsilon) {
+  FloatBox result = {};
+  for (int i = 0; i < 3; ++i) {
+    result.min[i] = RoundDown(box.min[i] - epsilon);
+    result.max[i] = RoundUp(box.max[i] + epsilon);
+  }
+  return result;
+}
+
+struct FloatRay {
+  float origin[4];
+  float inverse[4];
+};
+
+// The box tests below read the node bounds as four floats, the fourth lane (the offset or count
+// of the node) is ignored.
+#ifdef SCAD_MESH_TREE_SSE2
+bool BoxesOverlap(const float* min_a, const float* max_a, const float* min_b, const float* max_b) {
+  __m128 le_1 = _mm_cmple_ps(_mm_loadu_ps(min_a), _mm_loadu_ps(max_b));
+  __m128 le_2 = _mm_cmple_ps(_mm_loadu_ps(min_b), _mm_loadu_ps(max_a));
+  return (_mm_movemask_ps(_mm_and_ps(le_1, le_2)) & 7) == 7;
+}
+
+float BoxDistance2(const float* min, const float* max, const float* p) {
+  __m128 point = _mm_loadu_ps(p);
+  __m128 below = _mm_sub_ps(_mm_loadu_ps(min), point);
+  __m128 above = _mm_sub_ps(point, _mm_loadu_ps(max));
+  __m128 d = _mm_max_ps(_mm_max_ps(below, above), _mm_setzero_ps());
+  d = _mm_mul_ps(d, d);
+  __m128 sum = _mm_add_ss(_mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1))),
+                          _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 2, 2, 2)));
+  return _mm_cvtss_f32(sum);
+}
+
+// Slab test. Returns the parameter where the ray enters the box or infinity if it misses it
+// within [0, max_t].
+float RayEnter(const float* min, const float* max, const FloatRay& ray, float max_t) {
+  __m128 origin = _mm_loadu_ps(ray.origin);
+  __m128 inverse = _mm_loadu_ps(ray.inverse);
+  __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(min), origin), inverse);
+  __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(max), origin), inverse);
+  __m128 near = _mm_min_ps(t1, t2);
+  __m128 far = _mm_max_ps(t1, t2);
+  near = _mm_max_ss(_mm_max_ss(near, _mm_shuffle_ps(near, near, _MM_SHUFFLE(1, 1, 1, 1))),
+                    _mm_shuffle_ps(near, near, _MM_SHUFFLE(2, 2, 2, 2)));
+  far = _mm_min_ss(_mm_min_ss(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(1, 1, 1, 1))),
+                   _mm_shuffle_ps(far, far, _MM_SHUFFLE(2, 2, 2, 2)));
+  float enter = std::max(_mm_cvtss_f32(near), 0.0f);
+  float exit = std::min(_mm_cvtss_f32(far), max_t);
+  return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+#else
+bool BoxesOverlap(const float* min_a, const float* max_a, const float* min_b, const float* max_b) {
+  for (int i = 0; i < 3; ++i) {
+    if (min_a[i] > max_b[i] || min_b[i] > max_a[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+float BoxDistance2(const float* min, const float* max, const float* p) {
+  float sum = 0;
+  for (int i = 0; i < 3; ++i) {
+    float d = std::max(std::max(min[i] - p[i], p[i] - max[i]), 0.0f);
+    sum += d * d;
+  }
+  return sum;
+}
+
+float RayEnter(const float* min, const float* max, const FloatRay& ray, float max_t) {
+  float enter = 0;
+  float exit = max_t;
+  for (int i = 0; i < 3; ++i) {
+    float t1 = (min[i] - ray.origin[i]) * ray.inverse[i];
+    float t2 = (max[i] - ray.origin[i]) * ray.inverse[i];
+    enter = std::max(enter, std::min(t1, t2));
+    exit = std::min(exit, std::max(t1, t2));
+  }
+  return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+#endif
+
+glm::dvec3 ClosestOnTriangle(const glm::dvec3& p,
+                             const glm::dvec3& a,
+                             const glm::dvec3& b,
+                             const glm::dvec3& c) {
+  // From Ericson, Real-Time Collision Detection 5.1.5: find the Voronoi region of p.
+  glm::dvec3 ab = b - a;
+  glm::dvec3 ac = c - a;
+  glm::dvec3 ap = p - a;
+  double d1 = glm::dot(ab, ap);
+  double d2 = glm::dot(ac, ap);
+  if (d1 <= 0 && d2 <= 0) {
+    return a;
+  }
+  glm::dvec3 bp = p - b;
+  double d3 = glm::dot(ab, bp);
+  double d4 = glm::dot(ac, bp);
+  if (d3 >= 0 && d4 <= d3) {
+    return b;
+  }
+  double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    return a + ab * (d1 / (d1 - d3));
+  }
+  glm::dvec3 cp = p - c;
+  double d5 = glm::dot(ab, cp);
+  double d6 = glm::dot(ac, cp);
+  if (d6 >= 0 && d5 <= d6) {
+    return c;
+  }
+  double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    return a + ac * (d2 / (d2 - d6));
+  }
+  double va = d3 * d6 - d5 * d4;
+  if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+    return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  }
+  double denominator = 1 / (va + vb + vc);
+  return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// Moller-Trumbore. Returns the ray parameter of the hit or a negative value.
+double RayTriangle(const glm::dvec3& origin,
+                   const glm::dvec3& direction,
+                   const glm::dvec3& a,
+                   const glm::dvec3& b,
+                   const glm::dvec3& c) {
+  glm::dvec3 e1 = b - a;
+  glm::dvec3 e2 = c - a;
+  glm::dvec3 p = glm::cross(direction, e2);
+  double det = glm::dot(e1, p);
+  if (det == 0) {
+    return -1;
+  }
+  double inverse = 1 / det;
+  glm::dvec3 s = origin - a;
+  double u = glm::dot(s, p) * inverse;
+  if (u < 0 || u > 1) {
+    return -1;
+  }
+  glm::dvec3 q = glm::cross(s, e1);
+  double v = glm::dot(direction, q) * inverse;
+  if (v < 0 || u + v > 1) {
+    return -1;
+  }
+  return glm::dot(e2, q) * inverse;
+}
+
+// Separating axis test. Any axis separating the projections proves the triangles are disjoint,
+// the face normals, the cross products of the edges and the in plane edge normals (for coplanar
+// triangles) are enough to find one if they are.
+bool TrianglesIntersect(const glm::dvec3 (&a)[3], const glm::dvec3 (&b)[3], double epsilon) {
+  glm::dvec3 edges_a[3] = {a[1] - a[0], a[2] - a[1], a[0] - a[2]};
+  glm::dvec3 edges_b[3] = {b[1] - b[0], b[2] - b[1], b[0] - b[2]};
+  auto separates = [&](const glm::dvec3& axis, double scale) {
+    double length = glm::length(axis);
+    // Nearly parallel edges give no usable axis.
+    if (length <= 1e-12 * scale) {
+      return false;
+    }
+    double min_a = std::numeric_limits<double>::max();
+    double max_a = std::numeric_limits<double>::lowest();
+    double min_b = min_a;
+    double max_b = max_a;
+    for (int i = 0; i < 3; ++i) {
+      double pa = glm::dot(a[i], axis);
+      double pb = glm::dot(b[i], axis);
+      min_a = std::min(min_a, pa);
+      max_a = std::max(max_a, pa);
+      min_b = std::min(min_b, pb);
+      max_b = std::max(max_b, pb);
+    }
+    double margin = epsilon * length;
+    return max_a + margin < min_b || max_b + margin < min_a;
+  };
+  glm::dvec3 normal_a = glm::cross(edges_a[0], -edges_a[2]);
+  glm::dvec3 normal_b = glm::cross(edges_b[0], -edges_b[2]);
+  double scale_a = glm::length(edges_a[0]) * glm::length(edges_a[2]);
+  double scale_b = glm::length(edges_b[0]) * glm::length(edges_b[2]);
+  if (separates(normal_a, scale_a) || separates(normal_b, scale_b)) {
+    return false;
+  }
+  for (const glm::dvec3& ea : edges_a) {
+    for (const glm::dvec3& eb : edges_b) {
+      if (separates(glm::cross(ea, eb), glm::length(ea) * glm::length(eb))) {
+        return false;
+      }
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (separates(glm::cross(normal_a, edges_a[i]), scale_a * glm::length(edges_a[i])) ||
+        separates(glm::cross(normal_b, edges_b[i]), scale_b * glm::length(edges_b[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+MeshTree::MeshTree(const Mesh& mesh) {
+  std::vector<BuildItem> items;
+  items.reserve(mesh.triangles.size());
+  for (uint32_t i = 0; i < mesh.triangles.size(); ++i) {
+    const auto& t = mesh.triangles[i];
+    Aabb box = TriangleBox(mesh.vertices[t[0]], mesh.vertices[t[1]], mesh.vertices[t[2]]);
+    items.push_back({box, box.center(), i});
+    bounds_.Extend(box);
+  }
+  if (items.empty()) {
+    return;
+  }
+  triangles_.reserve(items.size());
+  nodes_.reserve(2 * items.size());
+  Build(&items, 0, static_cast<uint32_t>(items.size()), 0);
+  for (Triangle& triangle : triangles_) {
+    const auto& t = mesh.triangles[triangle.index];
+    triangle.a = mesh.vertices[t[0]];
+    triangle.b = mesh.vertices[t[1]];
+    triangle.c = mesh.vertices[t[2]];
+  }
+}
+
+uint32_t MeshTree::Build(std::vector<BuildItem>* items, uint32_t first, uint32_t count, int depth) {
+  uint32_t index = static_cast<uint32_t>(nodes_.size());
+  nodes_.emplace_back();
+  auto begin = items->begin() + first;
+  auto end = begin + count;
+  Aabb box;
+  Aabb centers;
+  for (auto it = begin; it != end; ++it) {
+    box.Extend(it->box);
+    centers.Extend(it->center);
+  }
+  for (int i = 0; i < 3; ++i) {
+    nodes_[index].min[i] = RoundDown(box.min[i]);
+    nodes_[index].max[i] = RoundUp(box.max[i]);
+  }
+
+  // Bins the centers along each axis and picks the boundary between bins with the lowest
+  // surface area cost.
+  glm::dvec3 extent = centers.size();
+  int axis = -1;
+  int split = 0;
+  double best_cost = std::numeric_limits<double>::infinity();
+  auto bin_of = [&](const BuildItem& item, int a) {
+    int bin = static_cast<int>((item.center[a] - centers.min[a]) * (kBinCount / extent[a]));
+    return std::min(bin, kBinCount - 1);
+  };
+  if (depth < kMaxSahDepth && count > 1) {
+    for (int a = 0; a < 3; ++a) {
+      if (extent[a] <= 0) {
+        continue;
+      }
+      Aabb bin_boxes[kBinCount];
+      uint32_t bin_counts[kBinCount] = {};
+      for (auto it = begin; it != end; ++it) {
+        int bin = bin_of(*it, a);
+        bin_boxes[bin].Extend(it->box);
+        ++bin_counts[bin];
+      }
+      // Costs of everything right of each boundary.
+      double right_costs[kBinCount] = {};
+      Aabb right;
+      uint32_t right_count = 0;
+      for (int b = kBinCount - 1; b > 0; --b) {
+        right.Extend(bin_boxes[b]);
+        right_count += bin_counts[b];
+        right_costs[b] = right_count == 0 ? 0 : Area(right) * right_count;
+      }
+      Aabb left;
+      uint32_t left_count = 0;
+      for (int b = 1; b < kBinCount; ++b) {
+        left.Extend(bin_boxes[b - 1]);
+        left_count += bin_counts[b - 1];
+        if (left_count == 0 || left_count == count) {
+          continue;
+        }
+        double cost = Area(left) * left_count + right_costs[b];
+        if (cost < best_cost) {
+          best_cost = cost;
+          axis = a;
+          split = b;
+        }
+      }
+    }
+  }
+
+  double area = Area(box);
+  if (count == 1 ||
+      (count <= kMaxLeafSize && (axis < 0 || kTraversalCost * area + best_cost >= count * area))) {
+    nodes_[index].offset = static_cast<uint32_t>(triangles_.size());
+    nodes_[index].count = count;
+    for (auto it = begin; it != end; ++it) {
+      triangles_.push_back({glm::dvec3(0), glm::dvec3(0), glm::dvec3(0), it->triangle});
+    }
+    return index;
+  }
+
+  uint32_t left_count;
+  if (axis >= 0) {
+    auto middle =
+        std::partition(begin, end, [&](const BuildItem& item) { return bin_of(item, axis) < split; });
+    left_count = static_cast<uint32_t>(middle - begin);
+  } else {
+    // Too deep or all centers coincide, split at the median.
+    axis = 0;
+    for (int a = 1; a < 3; ++a) {
+      if (extent[a] > extent[axis]) {
+        axis = a;
+      }
+    }
+    left_count = count / 2;
+    std::nth_element(begin, begin + left_count, end, [&](const BuildItem& a, const BuildItem& b) {
+      return a.center[axis] != b.center[axis] ? a.center[axis] < b.center[axis]
+                                              : a.triangle < b.triangle;
+    });
+  }
+  Build(items, first, left_count, depth + 1);
+  uint32_t right = Build(items, first + left_count, count - left_count, depth + 1);
+  nodes_[index].offset = right;
+  nodes_[index].count = 0;
+  return index;
+}
+
+void MeshTree::Query(const Aabb& box, std::vector<uint32_t>* out, double epsilon) const {
+  if (nodes_.empty()) {
+    return;
+  }
+  FloatBox query = ToFloatBox(box, epsilon);
+  uint32_t stack[kStackSize];
+  int size = 0;
+  stack[size++] = 0;
+  while (size > 0) {
+    uint32_t index = stack[--size];
+    const Node& node = nodes_[index];
+    if (!BoxesOverlap(node.min, node.max, query.min, query.max)) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+        const Triangle& t = triangles_[i];
+        if (TriangleBox(t.a, t.b, t.c).Overlaps(box, epsilon)) {
+          out->push_back(t.index);
+        }
+      }
+      continue;
+    }
+    stack[size++] = node.offset;
+    stack[size++] = index + 1;
+  }
+}
+
+template <typename Visit>
+bool MeshTree::VisitPairs(const MeshTree& other, double epsilon, const Visit& visit) const {
+  if (nodes_.empty() || other.nodes_.empty()) {
+    return false;
+  }
+  float margin = static_cast<float>(epsilon);
+  auto overlap = [&](const Node& a, const Node& b) {
+    FloatBox grown = {{a.min[0] - margin, a.min[1] - margin, a.min[2] - margin, 0},
+                      {a.max[0] + margin, a.max[1] + margin, a.max[2] + margin, 0}};
+    return BoxesOverlap(grown.min, grown.max, b.min, b.max);
+  };
+  auto area = [](const Node& node) {
+    float x = node.max[0] - node.min[0];
+    float y = node.max[1] - node.min[1];
+    float z = node.max[2] - node.min[2];
+    return x * y + y * z + z * x;
+  };
+  // Pairs are visited depth first so the stack stays small.
+  std::vector<std::pair<uint32_t, uint32_t>> stack = {{0, 0}};
+  while (!stack.empty()) {
+    auto [ia, ib] = stack.back();
+    stack.pop_back();
+    const Node& a = nodes_[ia];
+    const Node& b = other.nodes_[ib];
+    if (!overlap(a, b)) {
+      continue;
+    }
+    if (a.count > 0 && b.count > 0) {
+      for (uint32_t i = a.offset; i < a.offset + a.count; ++i) {
+        const Triangle& ta = triangles_[i];
+        Aabb box_a = TriangleBox(ta.a, ta.b, ta.c);
+        for (uint32_t j = b.offset; j < b.offset + b.count; ++j) {
+          const Triangle& tb = other.triangles_[j];
+          if (box_a.Overlaps(TriangleBox(tb.a, tb.b, tb.c), epsilon) && visit(ta, tb)) {
+            return true;
+          }
+        }
+      }
+      continue;
+    }
+    // Descend into the larger node.
+    if (b.count > 0 || (a.count == 0 && area(a) >= area(b))) {
+      stack.push_back({a.offset, ib});
+      stack.push_back({ia + 1, ib});
+    } else {
+      stack.push_back({ia, b.offset});
+      stack.push_back({ia, ib + 1});
+    }
+  }
+  return false;
+}
+
+void MeshTree::QueryPairs(const MeshTree& other,
+                          std::vector<std::pair<uint32_t, uint32_t>>* out,
+                          double epsilon) const {
+  VisitPairs(other, epsilon, [&](const Triangle& a, const Triangle& b) {
+    out->push_back({a.index, b.index});
+    return false;
+  });
+}
+
+bool MeshTree::Intersects(const MeshTree& other, double epsilon) const {
+  return VisitPairs(other, epsilon, [&](const Triangle& a, const Triangle& b) {
+    glm::dvec3 corners_a[3] = {a.a, a.b, a.c};
+    glm::dvec3 corners_b[3] = {b.a, b.b, b.c};
+    return TrianglesIntersect(corners_a, corners_b, epsilon);
+  });
+}
+
+bool MeshTree::ClosestPoint(const glm::dvec3& p, Hit* hit, double max_distance) const {
+  if (nodes_.empty()) {
+    return false;
+  }
+  float point[4] = {static_cast<float>(p.x), static_cast<float>(p.y), static_cast<float>(p.z), 0};
+  double best = max_distance * max_distance;
+  bool found = false;
+  // Each entry keeps the squared distance to its box so it can be skipped once something closer
+  // has been found.
+  std::pair<uint32_t, float> stack[kStackSize];
+  int size = 0;
+  stack[size++] = {0, BoxDistance2(nodes_[0].min, nodes_[0].max, point)};
+  while (size > 0) {
+    auto [index, distance] = stack[--size];
+    if (distance > best) {
+      continue;
+    }
+    const Node& node = nodes_[index];
+    if (node.count > 0) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+        const Triangle& t = triangles_[i];
+        glm::dvec3 q = ClosestOnTriangle(p, t.a, t.b, t.c);
+        glm::dvec3 d = q - p;
+        double d2 = glm::dot(d, d);
+        if (d2 < best || (!found && d2 <= best)) {
+          best = d2;
+          found = true;
+          hit->triangle = t.index;
+          hit->point = q;
+        }
+      }
+      continue;
+    }
+    // Visit the nearer child first.
+    uint32_t near = index + 1;
+    uint32_t far = node.offset;
+    float near_distance = BoxDistance2(nodes_[near].min, nodes_[near].max, point);
+    float far_distance = BoxDistance2(nodes_[far].min, nodes_[far].max, point);
+    if (far_distance < near_distance) {
+      std::swap(near, far);
+      std::swap(near_distance, far_distance);
+    }
+    if (far_distance <= best) {
+      stack[size++] = {far, far_distance};
+    }
+    if (near_distance <= best) {
+      stack[size++] = {near, near_distance};
+    }
+  }
+  if (found) {
+    hit->distance = std::sqrt(best);
+  }
+  return found;
+}
+
+bool MeshTree::Raycast(const glm::dvec3& origin,
+                       const glm::dvec3& direction,
+                       Hit* hit,
+                       double max_t) const {
+  if (nodes_.empty() || direction == glm::dvec3(0)) {
+    return false;
+  }
+  FloatRay ray = {};
+  for (int i = 0; i < 3; ++i) {
+    ray.origin[i] = static_cast<float>(origin[i]);
+    // Avoids infinities (and 0 * infinity) for axis aligned rays.
+    double d = direction[i];
+    if (std::abs(d) < 1e-30) {
+      d = std::signbit(d) ? -1e-30 : 1e-30;
+    }
+    ray.inverse[i] = static_cast<float>(1 / d);
+  }
+  double best = max_t;
+  bool found = false;
+  auto limit = [&] {
+    return best > std::numeric_limits<float>::max() ? std::numeric_limits<float>::infinity()
+                                                     : RoundUp(best);
+  };
+  std::pair<uint32_t, float> stack[kStackSize];
+  int size = 0;
+  float enter = RayEnter(nodes_[0].min, nodes_[0].max, ray, limit());
+  if (!std::isinf(enter)) {
+    stack[size++] = {0, enter};
+  }
+  while (size > 0) {
+    auto [index, node_enter] = stack[--size];
+    if (node_enter > best) {
+      continue;
+    }
+    const Node& node = nodes_[index];
+    if (node.count > 0) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+        const Triangle& t = triangles_[i];
+        double t_hit = RayTriangle(origin, direction, t.a, t.b, t.c);
+        if (t_hit >= 0 && t_hit <= best && (!found || t_hit < best)) {
+          best = t_hit;
+          found = true;
+          hit->triangle = t.index;
+        }
+      }
+      continue;
+    }
+    float max = limit();
+    uint32_t near = index + 1;
+    uint32_t far = node.offset;
+    float near_enter = RayEnter(nodes_[near].min, nodes_[near].max, ray, max);
+    float far_enter = RayEnter(nodes_[far].min, nodes_[far].max, ray, max);
+    if (far_enter < near_enter) {
+      std::swap(near, far);
+      std::swap(near_enter, far_enter);
+    }
+    if (!std::isinf(far_enter)) {
+      stack[size++] = {far, far_enter};
+    }
+    if (!std::isinf(near_enter)) {
+      stack[size++] = {near, near_enter};
+    }
+  }
+  if (found) {
+    hit->distance = best;
+    hit->point = origin + direction * best;
+  }
+  return found;
+}
+
+}  // namespace scad
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "mesh.h"
+
+namespace scad {
+
+// A bounding volume hierarchy over the triangles of a mesh for overlap, distance and ray queries,
+// e.g. for clearance and wall thickness checks on evaluated meshes.
+//
+// The tree is built with the surface area heuristic over binned triangle centers. Nodes are 32
+// bytes with single precision boxes rounded outwards and stored depth first in a flat array, the
+// left child of a node directly follows it. Box tests against nodes use SSE where available.
+// Triangles are copied into leaf order so a leaf reads one contiguous block and the exact tests
+// on them are done in double precision.
+class MeshTree {
+ public:
+  explicit MeshTree(const Mesh& mesh);
+
+  struct Hit {
+    // Index of the triangle in the mesh the tree was built from.
+    uint32_t triangle = 0;
+    // Distance from the query point, or the ray parameter for ray casts.
+    double distance = 0;
+    glm::dvec3 point = glm::dvec3(0);
+  };
+
+  // Appends the triangles whose bounding boxes overlap box (within epsilon).
+  void Query(const Aabb& box, std::vector<uint32_t>* out, double epsilon = kGeometryEpsilon) const;
+
+  // Appends the pairs of triangles (from this tree, from other) whose bounding boxes overlap.
+  void QueryPairs(const MeshTree& other,
+                  std::vector<std::pair<uint32_t, uint32_t>>* out,
+                  double epsilon = kGeometryEpsilon) const;
+
+  // Whether a triangle of this tree touches or crosses a triangle of other (within epsilon).
+  bool Intersects(const MeshTree& other, double epsilon = kGeometryEpsilon) const;
+
+  // Finds the point of the mesh closest to p. Returns false if nothing is within max_distance.
+  bool ClosestPoint(const glm::dvec3& p,
+                    Hit* hit,
+                    double max_distance = std::numeric_limits<double>::infinity()) const;
+
+  // Finds the first triangle hit by the ray origin + t * direction with 0 <= t <= max_t. Both
+  // sides of triangles are hit. Returns false if there is none.
+  bool Raycast(const glm::dvec3& origin,
+               const glm::dvec3& direction,
+               Hit* hit,
+               double max_t = std::numeric_limits<double>::infinity()) const;
+
+  size_t size() const {
+    return triangles_.size();
+  }
+
+  const Aabb& bounds() const {
+    return bounds_;
+  }
+
+ private:
+  struct Node {
+    float min[3];
+    // The first triangle of leaves and the right child of interior nodes.
+    uint32_t offset;
+    float max[3];
+    // Leaf nodes have a non zero count.
+    uint32_t count;
+  };
+  static_assert(sizeof(Node) == 32, "Nodes should be half a cache line");
+
+  struct Triangle {
+    glm::dvec3 a;
+    glm::dvec3 b;
+    glm::dvec3 c;
+    uint32_t index;
+  };
+
+  struct BuildItem {
+    Aabb box;
+    glm::dvec3 center;
+    uint32_t triangle;
+  };
+
+  uint32_t Build(std::vector<BuildItem>* items, uint32_t first, uint32_t count, int depth);
+
+  // Calls visit(a, b) for pairs of triangles with overlapping boxes until it returns true.
+  template <typename Visit>
+  bool VisitPairs(const MeshTree& other, double epsilon, const Visit& visit) const;
+
+  Aabb bounds_;
+  std::vector<Node> nodes_;
+  std::vector<Triangle> triangles_;
+};
+
+}  // namespace scad
@@ -0,0 +1,1115 @@
+#include "polygon.h"
+
+// Windows!
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#include <math.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "predicates.h"
+
+namespace scad {
+namespace {
+
+// Grid steps per mm. Coordinates stay below kMaxGrid steps so products of differences fit in 64
+// bits, even in the doubled coordinates used for midpoints.
+const double kGridScale = 65536;
+const double kMaxGrid = static_cast<double>(int64_t(1) << 26);
+
+const int kMaxSplitRounds = 8;
+
+// Larger unions are split up, see ReduceUnion.
+const size_t kMaxUnionOperands = 8;
+
+// Miter joins sharper than this (in multiples of the offset) are squared off, like clipper does.
+const double kMiterLimit = 1e6;
+
+struct GridPoint {
+  int64_t x;
+  int64_t y;
+
+  bool operator==(const GridPoint& other) const {
+    return x == other.x && y == other.y;
+  }
+
+  bool operator!=(const GridPoint& other) const {
+    return !(*this == other);
+  }
+
+  bool operator<(const GridPoint& other) const {
+    return x != other.x ? x < other.x : y < other.y;
+  }
+};
+
+// Positive if o, a, b turn counterclockwise.
+int64_t Cross(const GridPoint& o, const GridPoint& a, const GridPoint& b) {
+  return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+int64_t Dot(const GridPoint& o, const GridPoint& a, const GridPoint& b) {
+  return (a.x - o.x) * (b.x - o.x) + (a.y - o.y) * (b.y - o.y);
+}
+
+// Maps mm to grid steps. The grid is coarser than kGridScale only for shapes too large to fit.
+class Grid {
+ public:
+  explicit Grid(const std::vector<Paths>& operands) {
+    double max = 0;
+    for (const Paths& paths : operands) {
+      for (const Path& path : paths) {
+        for (const glm::dvec2& p : path) {
+          max = std::max(max, std::max(std::abs(p.x), std::abs(p.y)));
+        }
+      }
+    }
+    while (max * scale_ > kMaxGrid && scale_ > 1e-9) {
+      scale_ /= 2;
+    }
+  }
+
+  GridPoint Snap(const glm::dvec2& p) const {
+    return {std::llround(p.x * scale_), std::llround(p.y * scale_)};
+  }
+
+  glm::dvec2 ToMm(const GridPoint& p) const {
+    return glm::dvec2(p.x / scale_, p.y / scale_);
+  }
+
+ private:
+  double scale_ = kGridScale;
+};
+
+struct Edge {
+  GridPoint a;
+  GridPoint b;
+  int operand;
+};
+
+// An edge after splitting with the number of times each operand runs along it from a to b (minus
+// the times it runs from b to a). a is less than b.
+struct Segment {
+  GridPoint a;
+  GridPoint b;
+  uint32_t first_count;
+  uint32_t num_counts;
+};
+
+struct OperandCount {
+  int operand;
+  int count;
+};
+
+enum class FillRule {
+  kNonZero,
+  // Only counterclockwise windings count, used for the raw paths of offsets.
+  kPositive,
+};
+
+// Whether p lies strictly between the ends of e, given it is on its line.
+bool Within(const Edge& e, const GridPoint& p) {
+  return Dot(e.a, e.b, p) > 0 && Dot(e.b, e.a, p) > 0;
+}
+
+void IntersectEdges(const Edge& e,
+                    const Edge& f,
+                    std::vector<GridPoint>* e_splits,
+                    std::vector<GridPoint>* f_splits) {
+  int64_t o1 = Cross(e.a, e.b, f.a);
+  int64_t o2 = Cross(e.a, e.b, f.b);
+  int64_t o3 = Cross(f.a, f.b, e.a);
+  int64_t o4 = Cross(f.a, f.b, e.b);
+  if (((o1 > 0 && o2 < 0) || (o1 < 0 && o2 > 0)) && ((o3 > 0 && o4 < 0) || (o3 < 0 && o4 > 0))) {
+    // The crossing is rounded to the grid.
+    double t = static_cast<double>(o3) / static_cast<double>(o3 - o4);
+    GridPoint p = {e.a.x + std::llround(t * (e.b.x - e.a.x)),
+                   e.a.y + std::llround(t * (e.b.y - e.a.y))};
+    e_splits->push_back(p);
+    f_splits->push_back(p);
+    return;
+  }
+  // Ends of one edge on the other, including overlapping collinear edges.
+  if (o1 == 0 && Within(e, f.a)) {
+    e_splits->push_back(f.a);
+  }
+  if (o2 == 0 && Within(e, f.b)) {
+    e_splits->push_back(f.b);
+  }
+  if (o3 == 0 && Within(f, e.a)) {
+    f_splits->push_back(e.a);
+  }
+  if (o4 == 0 && Within(f, e.b)) {
+    f_splits->push_back(e.b);
+  }
+}
+
+// Splits the edges wherever another edge crosses them or ends on them so that edges only meet at
+// their ends and overlapping edges become equal. Returns false if there was nothing to split.
+bool SplitEdges(const std::vector<Edge>& edges, std::vector<Edge>* result) {
+  std::vector<uint32_t> order(edges.size());
+  for (uint32_t i = 0; i < edges.size(); ++i) {
+    order[i] = i;
+  }
+  auto min_x = [&](uint32_t i) { return std::min(edges[i].a.x, edges[i].b.x); };
+  std::sort(order.begin(), order.end(), [&](uint32_t i, uint32_t j) { return min_x(i) < min_x(j); });
+
+  std::vector<std::vector<GridPoint>> splits(edges.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    const Edge& e = edges[order[i]];
+    int64_t max_x = std::max(e.a.x, e.b.x);
+    int64_t e_min_y = std::min(e.a.y, e.b.y);
+    int64_t e_max_y = std::max(e.a.y, e.b.y);
+    for (size_t j = i + 1; j < order.size() && min_x(order[j]) <= max_x; ++j) {
+      const Edge& f = edges[order[j]];
+      if (std::max(f.a.y, f.b.y) < e_min_y || std::min(f.a.y, f.b.y) > e_max_y) {
+        continue;
+      }
+      IntersectEdges(e, f, &splits[order[i]], &splits[order[j]]);
+    }
+  }
+
+  result->clear();
+  result->reserve(edges.size());
+  bool split = false;
+  for (size_t i = 0; i < edges.size(); ++i) {
+    const Edge& e = edges[i];
+    std::vector<GridPoint>& points = splits[i];
+    std::sort(points.begin(), points.end(), [&](const GridPoint& p, const GridPoint& q) {
+      return Dot(e.a, e.b, p) < Dot(e.a, e.b, q);
+    });
+    GridPoint start = e.a;
+    for (const GridPoint& p : points) {
+      if (p != start && p != e.b) {
+        result->push_back({start, p, e.operand});
+        start = p;
+        split = true;
+      }
+    }
+    result->push_back({start, e.b, e.operand});
+  }
+  return split;
+}
+
+// Merges equal edges into segments, dropping those which cancel out.
+void BuildSegments(std::vector<Edge> edges,
+                   std::vector<Segment>* segments,
+                   std::vector<OperandCount>* counts) {
+  for (Edge& e : edges) {
+    if (e.b < e.a) {
+      std::swap(e.a, e.b);
+      e.operand = ~e.operand;
+    }
+  }
+  auto operand = [](const Edge& e) { return e.operand < 0 ? ~e.operand : e.operand; };
+  std::sort(edges.begin(), edges.end(), [&](const Edge& e, const Edge& f) {
+    if (e.a != f.a) {
+      return e.a < f.a;
+    }
+    if (e.b != f.b) {
+      return e.b < f.b;
+    }
+    return operand(e) < operand(f);
+  });
+  for (size_t i = 0; i < edges.size();) {
+    Segment segment = {edges[i].a, edges[i].b, static_cast<uint32_t>(counts->size()), 0};
+    size_t j = i;
+    while (j < edges.size() && edges[j].a == segment.a && edges[j].b == segment.b) {
+      int op = operand(edges[j]);
+      int count = 0;
+      for (; j < edges.size() && edges[j].a == segment.a && edges[j].b == segment.b &&
+             operand(edges[j]) == op;
+           ++j) {
+        count += edges[j].operand < 0 ? -1 : 1;
+      }
+      if (count != 0) {
+        counts->push_back({op, count});
+        ++segment.num_counts;
+      }
+    }
+    if (segment.num_counts > 0) {
+      segments->push_back(segment);
+    }
+    i = j;
+  }
+}
+
+// Answers winding number queries at segment midpoints. Works in doubled coordinates so midpoints
+// are on the grid. Segments are bucketed by the rows of the plane they cross.
+class WindingIndex {
+ public:
+  WindingIndex(const std::vector<Segment>& segments, const std::vector<OperandCount>& counts)
+      : segments_(segments), counts_(counts) {
+    if (segments.empty()) {
+      return;
+    }
+    min_y_ = segments[0].a.y * 2;
+    int64_t max_y = min_y_;
+    for (const Segment& s : segments) {
+      min_y_ = std::min(min_y_, std::min(s.a.y, s.b.y) * 2);
+      max_y = std::max(max_y, std::max(s.a.y, s.b.y) * 2);
+    }
+    size_t num_buckets =
+        std::max<size_t>(1, static_cast<size_t>(std::sqrt(static_cast<double>(segments.size()))));
+    bucket_height_ = std::max<int64_t>(1, (max_y - min_y_) / num_buckets + 1);
+    buckets_.resize(num_buckets + 1);
+    for (uint32_t i = 0; i < segments.size(); ++i) {
+      const Segment& s = segments[i];
+      if (s.a.y == s.b.y) {
+        // Horizontal segments never cross the rays.
+        continue;
+      }
+      size_t first = Bucket(std::min(s.a.y, s.b.y) * 2);
+      size_t last = Bucket(std::max(s.a.y, s.b.y) * 2);
+      for (size_t b = first; b <= last; ++b) {
+        buckets_[b].push_back(i);
+      }
+    }
+  }
+
+  // Adds the winding numbers of every operand at the midpoint of segment `skip` to windings, not
+  // counting that segment. The midpoint is treated as moved up by an infinitesimal so the rays
+  // never pass through segment ends.
+  void AddWindings(uint32_t skip, std::vector<int>* windings) const {
+    const Segment& s = segments_[skip];
+    GridPoint p = {s.a.x + s.b.x, s.a.y + s.b.y};
+    for (uint32_t i : buckets_[Bucket(p.y)]) {
+      if (i == skip) {
+        continue;
+      }
+      const Segment& other = segments_[i];
+      GridPoint a = {other.a.x * 2, other.a.y * 2};
+      GridPoint b = {other.b.x * 2, other.b.y * 2};
+      int sign = 0;
+      if (a.y <= p.y && p.y < b.y) {
+        // Upwards, counts if the point is left of it.
+        sign = Cross(a, b, p) > 0 ? 1 : 0;
+      } else if (b.y <= p.y && p.y < a.y) {
+        sign = Cross(a, b, p) < 0 ? -1 : 0;
+      }
+      if (sign != 0) {
+        for (uint32_t c = other.first_count; c < other.first_count + other.num_counts; ++c) {
+          (*windings)[counts_[c].operand] += sign * counts_[c].count;
+        }
+      }
+    }
+  }
+
+ private:
+  size_t Bucket(int64_t y) const {
+    return static_cast<size_t>((y - min_y_) / bucket_height_);
+  }
+
+  const std::vector<Segment>& segments_;
+  const std::vector<OperandCount>& counts_;
+  int64_t min_y_ = 0;
+  int64_t bucket_height_ = 1;
+  std::vector<std::vector<uint32_t>> buckets_;
+};
+
+bool Filled(int winding, FillRule rule) {
+  return rule == FillRule::kPositive ? winding > 0 : winding != 0;
+}
+
+bool Inside(PolygonOp op, FillRule rule, const std::vector<int>& windings) {
+  switch (op) {
+    case PolygonOp::kUnion:
+      for (int w : windings) {
+        if (Filled(w, rule)) {
+          return true;
+        }
+      }
+      return false;
+    case PolygonOp::kIntersection:
+      for (int w : windings) {
+        if (!Filled(w, rule)) {
+          return false;
+        }
+      }
+      return !windings.empty();
+    case PolygonOp::kDifference:
+      if (windings.empty() || !Filled(windings[0], rule)) {
+        return false;
+      }
+      for (size_t i = 1; i < windings.size(); ++i) {
+        if (Filled(windings[i], rule)) {
+          return false;
+        }
+      }
+      return true;
+  }
+  return false;
+}
+
+// Joins directed boundary edges into closed loops. Where several loops touch at a point the
+// sharpest left turn is taken so they come out as separate loops.
+std::vector<std::vector<GridPoint>> TraceLoops(std::vector<std::array<GridPoint, 2>> edges) {
+  std::sort(edges.begin(), edges.end(), [](const auto& e, const auto& f) {
+    return e[0] != f[0] ? e[0] < f[0] : e[1] < f[1];
+  });
+  std::vector<char> used(edges.size(), 0);
+  auto outgoing = [&](const GridPoint& p) {
+    auto it = std::lower_bound(edges.begin(), edges.end(), p, [](const auto& e, const GridPoint& q) {
+      return e[0] < q;
+    });
+    return static_cast<size_t>(it - edges.begin());
+  };
+
+  std::vector<std::vector<GridPoint>> loops;
+  for (size_t start = 0; start < edges.size(); ++start) {
+    if (used[start]) {
+      continue;
+    }
+    used[start] = 1;
+    std::vector<GridPoint> loop = {edges[start][0]};
+    size_t current = start;
+    bool closed = false;
+    while (true) {
+      const GridPoint& from = edges[current][0];
+      const GridPoint& at = edges[current][1];
+      if (at == edges[start][0]) {
+        closed = true;
+        break;
+      }
+      loop.push_back(at);
+      size_t best = edges.size();
+      double best_turn = 0;
+      glm::dvec2 in(static_cast<double>(at.x - from.x), static_cast<double>(at.y - from.y));
+      for (size_t i = outgoing(at); i < edges.size() && edges[i][0] == at; ++i) {
+        if (used[i]) {
+          continue;
+        }
+        glm::dvec2 out(static_cast<double>(edges[i][1].x - at.x),
+                       static_cast<double>(edges[i][1].y - at.y));
+        double turn = std::atan2(in.x * out.y - in.y * out.x, glm::dot(in, out));
+        if (best == edges.size() || turn > best_turn) {
+          best = i;
+          best_turn = turn;
+        }
+      }
+      if (best == edges.size()) {
+        break;
+      }
+      used[best] = 1;
+      current = best;
+    }
+    if (!closed) {
+      continue;
+    }
+    // Drops points in the middle of straight runs.
+    std::vector<GridPoint> simplified;
+    for (size_t i = 0; i < loop.size(); ++i) {
+      const GridPoint& prev = loop[(i + loop.size() - 1) % loop.size()];
+      const GridPoint& next = loop[(i + 1) % loop.size()];
+      if (Cross(prev, loop[i], next) != 0) {
+        simplified.push_back(loop[i]);
+      }
+    }
+    if (simplified.size() >= 3) {
+      loops.push_back(std::move(simplified));
+    }
+  }
+  return loops;
+}
+
+Paths Boolean(PolygonOp op, FillRule rule, const std::vector<Paths>& operands) {
+  Grid grid(operands);
+  std::vector<Edge> edges;
+  for (size_t i = 0; i < operands.size(); ++i) {
+    for (const Path& path : operands[i]) {
+      for (size_t j = 0; j < path.size(); ++j) {
+        GridPoint a = grid.Snap(path[j]);
+        GridPoint b = grid.Snap(path[(j + 1) % path.size()]);
+        if (a != b) {
+          edges.push_back({a, b, static_cast<int>(i)});
+        }
+      }
+    }
+  }
+  std::vector<Segment> segments;
+  std::vector<OperandCount> counts;
+  // Rounding the crossings to the grid moves the edges a little, which can make them cross others.
+  // That is rare and settles after another round or two.
+  std::vector<Edge> split;
+  for (int i = 0; i < kMaxSplitRounds && SplitEdges(edges, &split); ++i) {
+    edges.swap(split);
+  }
+  BuildSegments(std::move(edges), &segments, &counts);
+
+  // Each segment separates two regions whose winding numbers differ by the segment's counts. The
+  // winding numbers at the midpoint (moved up infinitesimally, which is on the left of segments
+  // going right and on the right of vertical ones) tell both.
+  WindingIndex index(segments, counts);
+  std::vector<std::array<GridPoint, 2>> boundary;
+  std::vector<int> left(operands.size());
+  std::vector<int> right(operands.size());
+  for (uint32_t i = 0; i < segments.size(); ++i) {
+    const Segment& s = segments[i];
+    std::fill(left.begin(), left.end(), 0);
+    index.AddWindings(i, &left);
+    bool vertical = s.a.x == s.b.x;
+    right = left;
+    for (uint32_t c = s.first_count; c < s.first_count + s.num_counts; ++c) {
+      const OperandCount& count = counts[c];
+      // Segments go right or straight up since a < b. The ray from the moved midpoint crosses
+      // the segment itself if it goes up and right.
+      if (s.b.y > s.a.y && !vertical) {
+        left[count.operand] += count.count;
+        right[count.operand] += count.count;
+      }
+      if (vertical) {
+        left[count.operand] += count.count;
+      } else {
+        right[count.operand] -= count.count;
+      }
+    }
+    bool inside_left = Inside(op, rule, left);
+    bool inside_right = Inside(op, rule, right);
+    if (inside_left && !inside_right) {
+      boundary.push_back({s.a, s.b});
+    } else if (inside_right && !inside_left) {
+      boundary.push_back({s.b, s.a});
+    }
+  }
+
+  Paths result;
+  for (const std::vector<GridPoint>& loop : TraceLoops(std::move(boundary))) {
+    Path path;
+    path.reserve(loop.size());
+    for (const GridPoint& p : loop) {
+      path.push_back(grid.ToMm(p));
+    }
+    result.push_back(std::move(path));
+  }
+  return result;
+}
+
+glm::dvec2 Rotate(const glm::dvec2& v, double angle) {
+  double c = std::cos(angle);
+  double s = std::sin(angle);
+  return glm::dvec2(v.x * c - v.y * s, v.x * s + v.y * c);
+}
+
+double Cross(const glm::dvec2& a, const glm::dvec2& b) {
+  return a.x * b.y - a.y * b.x;
+}
+
+// Where the offset line through v + a * u along d meets the chamfer at distance a from v across
+// the bisector m.
+glm::dvec2 ChamferPoint(const glm::dvec2& v,
+                        const glm::dvec2& u,
+                        const glm::dvec2& d,
+                        const glm::dvec2& m,
+                        double a) {
+  double s = a * (1 - glm::dot(u, m)) / glm::dot(d, m);
+  return v + u * a + d * s;
+}
+
+// The corner of the offset path at v between edges with directions d1 and d2 whose offset
+// directions u1 and u2 diverge.
+void AddJoin(const glm::dvec2& v,
+             const glm::dvec2& d1,
+             const glm::dvec2& d2,
+             const glm::dvec2& u1,
+             const glm::dvec2& u2,
+             double a,
+             JoinType join,
+             int fragments,
+             Path* out) {
+  double cos_angle = glm::dot(u1, u2);
+  if (join == JoinType::kMiter && 1 + cos_angle < 2 / (kMiterLimit * kMiterLimit)) {
+    join = JoinType::kSquare;
+  }
+  switch (join) {
+    case JoinType::kRound: {
+      double angle = std::atan2(Cross(u1, u2), cos_angle);
+      int steps = std::max(1, static_cast<int>(std::ceil(fragments * std::abs(angle) / (2 * M_PI))));
+      for (int i = 0; i <= steps; ++i) {
+        out->push_back(v + Rotate(u1, angle * i / steps) * a);
+      }
+      return;
+    }
+    case JoinType::kMiter:
+      out->push_back(v + (u1 + u2) * (a / (1 + cos_angle)));
+      return;
+    case JoinType::kSquare: {
+      glm::dvec2 m = u1 + u2;
+      // Turning all the way back, the end is cut square to the edge.
+      m = glm::length(m) < 1e-12 ? d1 : glm::normalize(m);
+      out->push_back(ChamferPoint(v, u1, d1, m, a));
+      out->push_back(ChamferPoint(v, u2, d2, m, a));
+      return;
+    }
+  }
+}
+
+// Whether p is inside or on the counterclockwise triangle a, b, c.
+bool InTriangle(const glm::dvec2& a, const glm::dvec2& b, const glm::dvec2& c, const glm::dvec2& p) {
+  return Orient2d(a, b, p) >= 0 && Orient2d(b, c, p) >= 0 && Orient2d(c, a, p) >= 0;
+}
+
+// Whether the direction from a towards p is strictly inside the corner a of the counterclockwise
+// triangle a, b, c.
+bool InCorner(const glm::dvec2& a, const glm::dvec2& b, const glm::dvec2& c, const glm::dvec2& p) {
+  return Orient2d(a, b, p) > 0 && Orient2d(c, a, p) > 0;
+}
+
+// Whether segments ab and cd cross or touch anywhere except at shared ends.
+bool SegmentsMeet(const glm::dvec2& a, const glm::dvec2& b, const glm::dvec2& c, const glm::dvec2& d) {
+  if (a == c || a == d || b == c || b == d) {
+    return false;
+  }
+  double o1 = Orient2d(a, b, c);
+  double o2 = Orient2d(a, b, d);
+  double o3 = Orient2d(c, d, a);
+  double o4 = Orient2d(c, d, b);
+  if (((o1 > 0 && o2 < 0) || (o1 < 0 && o2 > 0)) && ((o3 > 0 && o4 < 0) || (o3 < 0 && o4 > 0))) {
+    return true;
+  }
+  auto on = [](const glm::dvec2& p, const glm::dvec2& q, const glm::dvec2& r) {
+    return glm::dot(r - p, q - p) >= 0 && glm::dot(r - q, p - q) >= 0;
+  };
+  return (o1 == 0 && on(a, b, c)) || (o2 == 0 && on(a, b, d)) || (o3 == 0 && on(c, d, a)) ||
+         (o4 == 0 && on(c, d, b));
+}
+
+// Ear clipping over a circular list of vertex indices.
+class EarClipper {
+ public:
+  EarClipper(const std::vector<glm::dvec2>& vertices,
+             std::vector<std::array<uint32_t, 3>>* triangles)
+      : vertices_(vertices), triangles_(triangles) {
+  }
+
+  // Adds a ring and returns its first node.
+  uint32_t AddRing(const std::vector<uint32_t>& ring) {
+    uint32_t first = static_cast<uint32_t>(nodes_.size());
+    for (size_t i = 0; i < ring.size(); ++i) {
+      Node node;
+      node.vertex = ring[i];
+      node.prev = first + static_cast<uint32_t>((i + ring.size() - 1) % ring.size());
+      node.next = first + static_cast<uint32_t>((i + 1) % ring.size());
+      nodes_.push_back(node);
+    }
+    return first;
+  }
+
+  // Joins the hole ring to the outer ring by a pair of edges between mutually visible vertices.
+  void Bridge(uint32_t outer, uint32_t hole) {
+    // The rightmost point of the hole sees the outer ring or a hole already joined to it.
+    uint32_t m = hole;
+    for (uint32_t n = nodes_[hole].next; n != hole; n = nodes_[n].next) {
+      if (point(n).x > point(m).x || (point(n).x == point(m).x && point(n).y > point(m).y)) {
+        m = n;
+      }
+    }
+    std::vector<uint32_t> candidates;
+    for (uint32_t n = outer;;) {
+      candidates.push_back(n);
+      n = nodes_[n].next;
+      if (n == outer) {
+        break;
+      }
+    }
+    const glm::dvec2& mp = point(m);
+    std::sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+      glm::dvec2 da = point(a) - mp;
+      glm::dvec2 db = point(b) - mp;
+      return glm::dot(da, da) < glm::dot(db, db);
+    });
+    uint32_t target = candidates[0];
+    for (uint32_t c : candidates) {
+      if (LocallyInside(c, mp) && LocallyInside(m, point(c)) && Visible(c, m, outer, hole)) {
+        target = c;
+        break;
+      }
+    }
+    // target -> m -> hole ... -> m' -> target' -> rest of the outer ring.
+    uint32_t target_copy = static_cast<uint32_t>(nodes_.size());
+    uint32_t m_copy = target_copy + 1;
+    nodes_.push_back(nodes_[target]);
+    nodes_.push_back(nodes_[m]);
+    uint32_t after_target = nodes_[target].next;
+    uint32_t before_m = nodes_[m].prev;
+    nodes_[target].next = m;
+    nodes_[m].prev = target;
+    nodes_[before_m].next = m_copy;
+    nodes_[m_copy].prev = before_m;
+    nodes_[m_copy].next = target_copy;
+    nodes_[target_copy].prev = m_copy;
+    nodes_[target_copy].next = after_target;
+    nodes_[after_target].prev = target_copy;
+    other_rings_.erase(std::remove(other_rings_.begin(), other_rings_.end(), hole),
+                       other_rings_.end());
+  }
+
+  void AddOtherRing(uint32_t ring) {
+    other_rings_.push_back(ring);
+  }
+
+  void Clip(uint32_t start) {
+    uint32_t count = 1;
+    for (uint32_t n = nodes_[start].next; n != start; n = nodes_[n].next) {
+      ++count;
+    }
+    std::vector<uint32_t> reflex;
+    std::vector<uint32_t> ring;
+    for (uint32_t n = start, i = 0; i < count; ++i, n = nodes_[n].next) {
+      if (Orient(n) <= 0) {
+        reflex.push_back(n);
+      }
+      ring.push_back(n);
+    }
+    // Bridges and pinches visit points twice.
+    std::sort(ring.begin(), ring.end(), [&](uint32_t a, uint32_t b) {
+      return point(a).x != point(b).x ? point(a).x < point(b).x : point(a).y < point(b).y;
+    });
+    for (size_t i = 0; i < ring.size(); ++i) {
+      if ((i > 0 && point(ring[i]) == point(ring[i - 1])) ||
+          (i + 1 < ring.size() && point(ring[i]) == point(ring[i + 1]))) {
+        shared_.push_back(ring[i]);
+      }
+    }
+    uint32_t node = start;
+    uint32_t stop = start;
+    while (count > 3) {
+      double orient = Orient(node);
+      uint32_t prev = nodes_[node].prev;
+      uint32_t next = nodes_[node].next;
+      bool ear = orient > 0 && IsEar(node, reflex);
+      bool stuck = !ear && nodes_[node].next == stop;
+      if (ear || orient == 0 || stuck) {
+        // Flat vertices are dropped without a triangle. Without any ear left (only for broken
+        // input) the vertex is clipped anyway so this always finishes.
+        if (orient > 0) {
+          triangles_->push_back({nodes_[prev].vertex, nodes_[node].vertex, nodes_[next].vertex});
+        }
+        nodes_[prev].next = next;
+        nodes_[next].prev = prev;
+        nodes_[node].removed = true;
+        --count;
+        node = prev;
+        stop = prev;
+        continue;
+      }
+      node = next;
+    }
+    uint32_t prev = nodes_[node].prev;
+    uint32_t next = nodes_[node].next;
+    if (Orient(node) > 0) {
+      triangles_->push_back({nodes_[prev].vertex, nodes_[node].vertex, nodes_[next].vertex});
+    }
+  }
+
+ private:
+  struct Node {
+    uint32_t vertex;
+    uint32_t prev;
+    uint32_t next;
+    bool removed = false;
+  };
+
+  const glm::dvec2& point(uint32_t node) const {
+    return vertices_[nodes_[node].vertex];
+  }
+
+  double Orient(uint32_t node) const {
+    return Orient2d(point(nodes_[node].prev), point(node), point(nodes_[node].next));
+  }
+
+  bool IsEar(uint32_t node, std::vector<uint32_t>& reflex) const {
+    const glm::dvec2& a = point(nodes_[node].prev);
+    const glm::dvec2& b = point(node);
+    const glm::dvec2& c = point(nodes_[node].next);
+    glm::dvec2 min = glm::min(a, glm::min(b, c));
+    glm::dvec2 max = glm::max(a, glm::max(b, c));
+    // Only reflex vertices can be inside an ear. Vertices only ever become convex so the list is
+    // compacted as it goes.
+    size_t kept = 0;
+    bool ear = true;
+    for (size_t i = 0; i < reflex.size(); ++i) {
+      uint32_t r = reflex[i];
+      if (nodes_[r].removed || Orient(r) > 0) {
+        continue;
+      }
+      reflex[kept++] = r;
+      if (!ear || r == node) {
+        continue;
+      }
+      const glm::dvec2& p = point(r);
+      if (p.x < min.x || p.y < min.y || p.x > max.x || p.y > max.y || p == a || p == b || p == c) {
+        continue;
+      }
+      if (InTriangle(a, b, c, p)) {
+        ear = false;
+      }
+    }
+    reflex.resize(kept);
+    // The other visits of the corners block the ear if the ring leaves them into it.
+    for (size_t i = 0; ear && i < shared_.size(); ++i) {
+      uint32_t d = shared_[i];
+      if (nodes_[d].removed || d == node || d == nodes_[node].prev || d == nodes_[node].next) {
+        continue;
+      }
+      const glm::dvec2& p = point(d);
+      const glm::dvec2& p_prev = point(nodes_[d].prev);
+      const glm::dvec2& p_next = point(nodes_[d].next);
+      if (p == a) {
+        ear = !InCorner(a, b, c, p_prev) && !InCorner(a, b, c, p_next);
+      } else if (p == b) {
+        ear = !InCorner(b, c, a, p_prev) && !InCorner(b, c, a, p_next);
+      } else if (p == c) {
+        ear = !InCorner(c, a, b, p_prev) && !InCorner(c, a, b, p_next);
+      } else {
+        ear = !InTriangle(a, b, c, p);
+      }
+    }
+    return ear;
+  }
+
+  bool LocallyInside(uint32_t node, const glm::dvec2& p) const {
+    const glm::dvec2& a = point(nodes_[node].prev);
+    const glm::dvec2& v = point(node);
+    const glm::dvec2& b = point(nodes_[node].next);
+    if (Orient2d(a, v, b) >= 0) {
+      return Orient2d(a, v, p) > 0 && Orient2d(v, b, p) > 0;
+    }
+    return Orient2d(a, v, p) > 0 || Orient2d(v, b, p) > 0;
+  }
+
+  bool RingBlocks(uint32_t ring, const glm::dvec2& a, const glm::dvec2& b) const {
+    uint32_t n = ring;
+    do {
+      if (SegmentsMeet(a, b, point(n), point(nodes_[n].next))) {
+        return true;
+      }
+      n = nodes_[n].next;
+    } while (n != ring);
+    return false;
+  }
+
+  bool Visible(uint32_t outer_node, uint32_t hole_node, uint32_t outer, uint32_t hole) const {
+    const glm::dvec2& a = point(outer_node);
+    const glm::dvec2& b = point(hole_node);
+    if (RingBlocks(outer, a, b) || RingBlocks(hole, a, b)) {
+      return false;
+    }
+    for (uint32_t ring : other_rings_) {
+      if (ring != hole && RingBlocks(ring, a, b)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const std::vector<glm::dvec2>& vertices_;
+  std::vector<std::array<uint32_t, 3>>* triangles_;
+  std::vector<Node> nodes_;
+  // Holes which are not joined to the outer ring yet.
+  std::vector<uint32_t> other_rings_;
+  // Nodes at the same point as another node.
+  std::vector<uint32_t> shared_;
+};
+
+// Whether the path winds around p. Points on the path are reported separately.
+bool ContainsPoint(const Path& path, const glm::dvec2& p, bool* on_boundary) {
+  int winding = 0;
+  *on_boundary = false;
+  for (size_t i = 0; i < path.size(); ++i) {
+    const glm::dvec2& a = path[i];
+    const glm::dvec2& b = path[(i + 1) % path.size()];
+    double orient = Orient2d(a, b, p);
+    if (orient == 0 && glm::dot(p - a, b - a) >= 0 && glm::dot(p - b, a - b) >= 0) {
+      *on_boundary = true;
+      return false;
+    }
+    if (a.y <= p.y && p.y < b.y && orient > 0) {
+      ++winding;
+    } else if (b.y <= p.y && p.y < a.y && orient < 0) {
+      --winding;
+    }
+  }
+  return winding != 0;
+}
+
+// Unions of many operands, e.g. the triangles of a projection, are merged by a balanced tree of
+// smaller unions. Edges inside the partial unions drop out early and each merge only tracks the
+// winding numbers of a few operands.
+Paths ReduceUnion(const std::vector<Paths>& operands, size_t begin, size_t end) {
+  if (end - begin <= kMaxUnionOperands) {
+    std::vector<Paths> group(operands.begin() + begin, operands.begin() + end);
+    return Boolean(PolygonOp::kUnion, FillRule::kNonZero, group);
+  }
+  size_t middle = begin + (end - begin) / 2;
+  return Boolean(PolygonOp::kUnion,
+                 FillRule::kNonZero,
+                 {ReduceUnion(operands, begin, middle), ReduceUnion(operands, middle, end)});
+}
+
+}  // namespace
+
+Paths PolygonBoolean(PolygonOp op, const std::vector<Paths>& operands) {
+  if (operands.size() > kMaxUnionOperands) {
+    if (op == PolygonOp::kUnion) {
+      return ReduceUnion(operands, 0, operands.size());
+    }
+    if (op == PolygonOp::kDifference) {
+      return Boolean(op,
+                     FillRule::kNonZero,
+                     {operands[0], ReduceUnion(operands, 1, operands.size())});
+    }
+  }
+  return Boolean(op, FillRule::kNonZero, operands);
+}
+
+Paths UnionPolygons(const Paths& paths) {
+  return Boolean(PolygonOp::kUnion, FillRule::kNonZero, {paths});
+}
+
+Paths OffsetPolygons(const Paths& paths, double delta, JoinType join, int fragments) {
+  if (delta == 0) {
+    return paths;
+  }
+  // Like clipper, every path is offset on its own with concave corners joined through the
+  // original vertex. The raw paths overlap and loop back on themselves where the offset swallows
+  // features, only the parts they wind around counterclockwise are the result.
+  double a = std::abs(delta);
+  double sign = delta > 0 ? 1 : -1;
+  Paths raw;
+  for (const Path& input : paths) {
+    Path path;
+    for (const glm::dvec2& p : input) {
+      if (path.empty() || p != path.back()) {
+        path.push_back(p);
+      }
+    }
+    while (path.size() > 1 && path.back() == path.front()) {
+      path.pop_back();
+    }
+    if (path.size() < 3) {
+      continue;
+    }
+    size_t n = path.size();
+    std::vector<glm::dvec2> directions(n);
+    for (size_t i = 0; i < n; ++i) {
+      directions[i] = glm::normalize(path[(i + 1) % n] - path[i]);
+    }
+    Path out;
+    for (size_t i = 0; i < n; ++i) {
+      const glm::dvec2& v = path[i];
+      const glm::dvec2& d1 = directions[(i + n - 1) % n];
+      const glm::dvec2& d2 = directions[i];
+      // Outwards for counterclockwise paths, into the hole for clockwise ones.
+      glm::dvec2 u1 = glm::dvec2(d1.y, -d1.x) * sign;
+      glm::dvec2 u2 = glm::dvec2(d2.y, -d2.x) * sign;
+      double turn = Cross(u1, u2) * sign;
+      if (turn < -1e-12) {
+        out.push_back(v + u1 * a);
+        out.push_back(v);
+        out.push_back(v + u2 * a);
+      } else if (turn <= 1e-12 && glm::dot(u1, u2) > 0) {
+        out.push_back(v + u1 * a);
+      } else {
+        AddJoin(v, d1, d2, u1, u2, a, join, fragments, &out);
+      }
+    }
+    raw.push_back(std::move(out));
+  }
+  return Boolean(PolygonOp::kUnion, FillRule::kPositive, {raw});
+}
+
+void TriangulatePolygons(const Paths& paths,
+                         std::vector<glm::dvec2>* vertices,
+                         std::vector<std::array<uint32_t, 3>>* triangles) {
+  std::vector<double> areas;
+  std::vector<size_t> outers;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    areas.push_back(SignedArea(paths[i]));
+    if (areas.back() > 0) {
+      outers.push_back(i);
+    }
+  }
+  // Each hole belongs to the smallest outer boundary around it.
+  std::vector<std::vector<size_t>> holes(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (areas[i] >= 0) {
+      continue;
+    }
+    size_t best = paths.size();
+    for (size_t outer : outers) {
+      if (best != paths.size() && areas[outer] >= areas[best]) {
+        continue;
+      }
+      for (const glm::dvec2& p : paths[i]) {
+        bool on_boundary;
+        bool inside = ContainsPoint(paths[outer], p, &on_boundary);
+        if (!on_boundary) {
+          if (inside) {
+            best = outer;
+          }
+          break;
+        }
+      }
+    }
+    if (best != paths.size()) {
+      holes[best].push_back(i);
+    }
+  }
+
+  for (size_t outer : outers) {
+    EarClipper clipper(*vertices, triangles);
+    auto add_ring = [&](const Path& path) {
+      std::vector<uint32_t> ring;
+      for (const glm::dvec2& p : path) {
+        ring.push_back(static_cast<uint32_t>(vertices->size()));
+        vertices->push_back(p);
+      }
+      return clipper.AddRing(ring);
+    };
+    uint32_t start = add_ring(paths[outer]);
+    // Rightmost holes first, like the usual bridge construction.
+    std::vector<size_t>& outer_holes = holes[outer];
+    auto max_x = [&](size_t hole) {
+      double x = paths[hole][0].x;
+      for (const glm::dvec2& p : paths[hole]) {
+        x = std::max(x, p.x);
+      }
+      return x;
+    };
+    std::sort(outer_holes.begin(), outer_holes.end(), [&](size_t a, size_t b) {
+      return max_x(a) > max_x(b);
+    });
+    std::vector<uint32_t> rings;
+    for (size_t hole : outer_holes) {
+      rings.push_back(add_ring(paths[hole]));
+      clipper.AddOtherRing(rings.back());
+    }
+    for (uint32_t ring : rings) {
+      clipper.Bridge(start, ring);
+    }
+    clipper.Clip(start);
+  }
+}
+
+Paths ConvexPartition(const Paths& polygon) {
+  std::vector<glm::dvec2> vertices;
+  std::vector<std::array<uint32_t, 3>> triangles;
+  TriangulatePolygons(polygon, &vertices, &triangles);
+  std::vector<std::vector<uint32_t>> pieces;
+  for (const auto& t : triangles) {
+    pieces.push_back({t[0], t[1], t[2]});
+  }
+  auto key = [](uint32_t a, uint32_t b) { return (static_cast<uint64_t>(a) << 32) | b; };
+  std::unordered_map<uint64_t, uint32_t> owners;
+  for (uint32_t i = 0; i < pieces.size(); ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      owners[key(pieces[i][j], pieces[i][(j + 1) % 3])] = i;
+    }
+  }
+  std::vector<char> merged(pieces.size(), 0);
+  for (uint32_t i = 0; i < pieces.size(); ++i) {
+    if (merged[i]) {
+      continue;
+    }
+    std::vector<uint32_t>& p = pieces[i];
+    // Every successful merge changes p so its edges are scanned again from the start.
+    for (size_t j = 0; j < p.size();) {
+      uint32_t a = p[j];
+      uint32_t b = p[(j + 1) % p.size()];
+      auto it = owners.find(key(b, a));
+      if (it == owners.end() || it->second == i) {
+        ++j;
+        continue;
+      }
+      const std::vector<uint32_t>& q = pieces[it->second];
+      // Points visited twice by bridges have the same index, the edge itself is unique.
+      size_t k = 0;
+      while (q[k] != b || q[(k + 1) % q.size()] != a) {
+        ++k;
+      }
+      // p runs ... p_prev, a, b, p_next ... and q runs ... q_prev, b, a, q_next ...
+      uint32_t p_prev = p[(j + p.size() - 1) % p.size()];
+      uint32_t p_next = p[(j + 2) % p.size()];
+      uint32_t q_prev = q[(k + q.size() - 1) % q.size()];
+      uint32_t q_next = q[(k + 2) % q.size()];
+      if (Orient2d(vertices[p_prev], vertices[a], vertices[q_next]) < 0 ||
+          Orient2d(vertices[q_prev], vertices[b], vertices[p_next]) < 0) {
+        ++j;
+        continue;
+      }
+      std::vector<uint32_t> joined;
+      for (size_t n = 0; n < p.size(); ++n) {
+        joined.push_back(p[(j + 1 + n) % p.size()]);
+      }
+      for (size_t n = 2; n < q.size(); ++n) {
+        joined.push_back(q[(k + n) % q.size()]);
+      }
+      uint32_t other = it->second;
+      merged[other] = 1;
+      owners.erase(key(a, b));
+      owners.erase(key(b, a));
+      for (size_t n = 0; n < joined.size(); ++n) {
+        owners[key(joined[n], joined[(n + 1) % joined.size()])] = i;
+      }
+      p = std::move(joined);
+      j = 0;
+    }
+  }
+  Paths result;
+  for (uint32_t i = 0; i < pieces.size(); ++i) {
+    if (merged[i]) {
+      continue;
+    }
+    Path path;
+    for (uint32_t v : pieces[i]) {
+      path.push_back(vertices[v]);
+    }
+    result.push_back(std::move(path));
+  }
+  return result;
+}
+
+Path ConvexHull2d(std::vector<glm::dvec2> points) {
+  std::sort(points.begin(), points.end(), [](const glm::dvec2& a, const glm::dvec2& b) {
+    return a.x != b.x ? a.x < b.x : a.y < b.y;
+  });
+  points.erase(std::unique(points.begin(), points.end()), points.end());
+  if (points.size() < 3) {
+    return {};
+  }
+  // Andrew's monotone chain.
+  Path hull(2 * points.size());
+  size_t k = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    while (k >= 2 && Orient2d(hull[k - 2], hull[k - 1], points[i]) <= 0) {
+      --k;
+    }
+    hull[k++] = points[i];
+  }
+  for (size_t i = points.size() - 1, lower = k + 1; i-- > 0;) {
+    while (k >= lower && Orient2d(hull[k - 2], hull[k - 1], points[i]) <= 0) {
+      --k;
+    }
+    hull[k++] = points[i];
+  }
+  hull.resize(k - 1);
+  return hull.size() >= 3 ? hull : Path();
+}
+
+double SignedArea(const Path& path) {
+  double area = 0;
+  for (size_t i = 0; i < path.size(); ++i) {
+    const glm::dvec2& a = path[i];
+    const glm::dvec2& b = path[(i + 1) % path.size()];
+    area += a.x * b.y - a.y * b.x;
+  }
+  return area / 2;
+}
+
+}  // namespace scad
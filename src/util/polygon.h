@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace scad {
+
+// 2D polygons for the native evaluation of squares, circles, polygons, offsets and everything built
+// from them.
+//
+// A polygon is a list of closed paths. Results of the operations below are always normalized: the
+// paths don't cross or overlap, outer boundaries are counterclockwise and holes are clockwise.
+// Inputs may be any paths, every point covered by a nonzero winding number is inside.
+//
+// Booleans snap every point to a grid of 2^-16 mm (coarser for shapes over a meter), split the
+// edges where they cross or touch and keep the edges between inside and outside. All of the
+// decisions are made with exact integer arithmetic so touching and coincident edges, which are
+// everywhere in this model, are handled without tolerances.
+using Path = std::vector<glm::dvec2>;
+using Paths = std::vector<Path>;
+
+enum class PolygonOp {
+  // Everything covered by any operand.
+  kUnion,
+  // Everything covered by all operands.
+  kIntersection,
+  // The first operand minus all the others.
+  kDifference,
+};
+
+Paths PolygonBoolean(PolygonOp op, const std::vector<Paths>& operands);
+
+// Normalizes a single polygon, e.g. one given by overlapping or self intersecting paths.
+Paths UnionPolygons(const Paths& paths);
+
+enum class JoinType {
+  // Arcs around the corners, offset(r = ...).
+  kRound,
+  // The edges are extended until they meet, offset(delta = ...).
+  kMiter,
+  // The corners are cut off at the offset distance, offset(delta = ..., chamfer = true).
+  kSquare,
+};
+
+// Grows the normalized polygon by delta, shrinks it for negative delta, with openscad's offset
+// semantics. Round joins use fragments segments for a full circle.
+Paths OffsetPolygons(const Paths& paths, double delta, JoinType join, int fragments = 0);
+
+// Splits a normalized polygon into counterclockwise triangles by ear clipping, with holes joined
+// to their outer boundaries by bridges.
+void TriangulatePolygons(const Paths& paths,
+                         std::vector<glm::dvec2>* vertices,
+                         std::vector<std::array<uint32_t, 3>>* triangles);
+
+// Splits a normalized polygon into counterclockwise convex pieces by merging the triangles of
+// TriangulatePolygons across diagonals as long as the result stays convex (Hertel and Mehlhorn),
+// which needs at most four times as many pieces as the optimal partition.
+Paths ConvexPartition(const Paths& polygon);
+
+// Counterclockwise convex hull of the points.
+Path ConvexHull2d(std::vector<glm::dvec2> points);
+
+// Positive for counterclockwise paths.
+double SignedArea(const Path& path);
+
+}  // namespace scad
@@ -0,0 +1,281 @@
+#include "predicates.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace scad {
+namespace {
+
+// Half an ulp of 1, the relative error of one rounded operation.
+constexpr double kEpsilon = 1.1102230246251565e-16;
+// Error bounds of the double precision determinants relative to their permanents.
+constexpr double kOrient2dBound = (3 + 16 * kEpsilon) * kEpsilon;
+constexpr double kOrient3dBound = (7 + 56 * kEpsilon) * kEpsilon;
+constexpr double kInCircleBound = (10 + 96 * kEpsilon) * kEpsilon;
+
+std::atomic<uint64_t> orient2d_count{0};
+std::atomic<uint64_t> orient3d_count{0};
+std::atomic<uint64_t> incircle_count{0};
+
+// A number represented exactly as the sum of non overlapping doubles in order of increasing
+// magnitude. The last component has the sign of the sum. Never empty, zero is {0}.
+using Expansion = std::vector<double>;
+
+void TwoSum(double a, double b, double* sum, double* error) {
+  double x = a + b;
+  double b_virtual = x - a;
+  double a_virtual = x - b_virtual;
+  *sum = x;
+  *error = (a - a_virtual) + (b - b_virtual);
+}
+
+// Requires |a| >= |b|.
+void FastTwoSum(double a, double b, double* sum, double* error) {
+  double x = a + b;
+  *sum = x;
+  *error = b - (x - a);
+}
+
+void TwoProduct(double a, double b, double* product, double* error) {
+  double x = a * b;
+  *product = x;
+  *error = std::fma(a, b, -x);
+}
+
+Expansion Difference(double a, double b) {
+  double sum;
+  double error;
+  TwoSum(a, -b, &sum, &error);
+  return error == 0 ? Expansion{sum} : Expansion{error, sum};
+}
+
+// Shewchuk's fast_expansion_sum_zeroelim: merges the components by magnitude and then adds them
+// up from the smallest, dropping zeros.
+Expansion Sum(const Expansion& e, const Expansion& f) {
+  Expansion h;
+  h.reserve(e.size() + f.size());
+  size_t ei = 0;
+  size_t fi = 0;
+  auto next = [&] {
+    if (fi >= f.size() || (ei < e.size() && (f[fi] > e[ei]) == (f[fi] > -e[ei]))) {
+      return e[ei++];
+    }
+    return f[fi++];
+  };
+  double q = next();
+  double q_new;
+  double error;
+  if (ei + fi < e.size() + f.size()) {
+    FastTwoSum(next(), q, &q_new, &error);
+    q = q_new;
+    if (error != 0) {
+      h.push_back(error);
+    }
+  }
+  while (ei + fi < e.size() + f.size()) {
+    TwoSum(q, next(), &q_new, &error);
+    q = q_new;
+    if (error != 0) {
+      h.push_back(error);
+    }
+  }
+  if (q != 0 || h.empty()) {
+    h.push_back(q);
+  }
+  return h;
+}
+
+Expansion Negate(Expansion e) {
+  for (double& component : e) {
+    component = -component;
+  }
+  return e;
+}
+
+// Shewchuk's scale_expansion_zeroelim.
+Expansion Scale(const Expansion& e, double b) {
+  Expansion h;
+  h.reserve(2 * e.size());
+  double q;
+  double error;
+  TwoProduct(e[0], b, &q, &error);
+  if (error != 0) {
+    h.push_back(error);
+  }
+  for (size_t i = 1; i < e.size(); ++i) {
+    double product;
+    double product_error;
+    double sum;
+    TwoProduct(e[i], b, &product, &product_error);
+    TwoSum(q, product_error, &sum, &error);
+    if (error != 0) {
+      h.push_back(error);
+    }
+    FastTwoSum(product, sum, &q, &error);
+    if (error != 0) {
+      h.push_back(error);
+    }
+  }
+  if (q != 0 || h.empty()) {
+    h.push_back(q);
+  }
+  return h;
+}
+
+Expansion Product(const Expansion& e, const Expansion& f) {
+  Expansion result = Scale(e, f[0]);
+  for (size_t i = 1; i < f.size(); ++i) {
+    result = Sum(result, Scale(e, f[i]));
+  }
+  return result;
+}
+
+// The largest component, which has the sign of the expansion and is within an ulp of its value.
+double Approximate(const Expansion& e) {
+  return e.back();
+}
+
+// a * d - b * c.
+Expansion Determinant2(const Expansion& a,
+                       const Expansion& b,
+                       const Expansion& c,
+                       const Expansion& d) {
+  return Sum(Product(a, d), Negate(Product(b, c)));
+}
+
+// Shared corners are the most common reason for the filters to fail, e.g. hulls of posts which
+// share corners, and are decided without any arithmetic.
+
+double Orient2dExact(const glm::dvec2& a, const glm::dvec2& b, const glm::dvec2& c) {
+  if (a == b || b == c || c == a) {
+    return 0;
+  }
+  orient2d_count.fetch_add(1, std::memory_order_relaxed);
+  return Approximate(Determinant2(
+      Difference(a.x, c.x), Difference(a.y, c.y), Difference(b.x, c.x), Difference(b.y, c.y)));
+}
+
+double Orient3dExact(const glm::dvec3& a,
+                     const glm::dvec3& b,
+                     const glm::dvec3& c,
+                     const glm::dvec3& d) {
+  if (d == a || d == b || d == c || a == b || b == c || c == a) {
+    return 0;
+  }
+  orient3d_count.fetch_add(1, std::memory_order_relaxed);
+  Expansion adx = Difference(a.x, d.x);
+  Expansion ady = Difference(a.y, d.y);
+  Expansion adz = Difference(a.z, d.z);
+  Expansion bdx = Difference(b.x, d.x);
+  Expansion bdy = Difference(b.y, d.y);
+  Expansion bdz = Difference(b.z, d.z);
+  Expansion cdx = Difference(c.x, d.x);
+  Expansion cdy = Difference(c.y, d.y);
+  Expansion cdz = Difference(c.z, d.z);
+  Expansion det = Product(adz, Determinant2(bdx, bdy, cdx, cdy));
+  det = Sum(det, Product(bdz, Determinant2(cdx, cdy, adx, ady)));
+  det = Sum(det, Product(cdz, Determinant2(adx, ady, bdx, bdy)));
+  return Approximate(det);
+}
+
+double InCircleExact(const glm::dvec2& a,
+                     const glm::dvec2& b,
+                     const glm::dvec2& c,
+                     const glm::dvec2& d) {
+  if (d == a || d == b || d == c) {
+    return 0;
+  }
+  incircle_count.fetch_add(1, std::memory_order_relaxed);
+  Expansion adx = Difference(a.x, d.x);
+  Expansion ady = Difference(a.y, d.y);
+  Expansion bdx = Difference(b.x, d.x);
+  Expansion bdy = Difference(b.y, d.y);
+  Expansion cdx = Difference(c.x, d.x);
+  Expansion cdy = Difference(c.y, d.y);
+  auto lift = [](const Expansion& x, const Expansion& y) {
+    return Sum(Product(x, x), Product(y, y));
+  };
+  Expansion det = Product(lift(adx, ady), Determinant2(bdx, bdy, cdx, cdy));
+  det = Sum(det, Product(lift(bdx, bdy), Determinant2(cdx, cdy, adx, ady)));
+  det = Sum(det, Product(lift(cdx, cdy), Determinant2(adx, ady, bdx, bdy)));
+  return Approximate(det);
+}
+
+}  // namespace
+
+double Orient2d(const glm::dvec2& a, const glm::dvec2& b, const glm::dvec2& c) {
+  double left = (a.x - c.x) * (b.y - c.y);
+  double right = (a.y - c.y) * (b.x - c.x);
+  double det = left - right;
+  double bound = kOrient2dBound * (std::abs(left) + std::abs(right));
+  if (det > bound || -det > bound) {
+    return det;
+  }
+  return Orient2dExact(a, b, c);
+}
+
+double Orient3d(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c, const glm::dvec3& d) {
+  glm::dvec3 ad = a - d;
+  glm::dvec3 bd = b - d;
+  glm::dvec3 cd = c - d;
+  double bdx_cdy = bd.x * cd.y;
+  double cdx_bdy = cd.x * bd.y;
+  double cdx_ady = cd.x * ad.y;
+  double adx_cdy = ad.x * cd.y;
+  double adx_bdy = ad.x * bd.y;
+  double bdx_ady = bd.x * ad.y;
+  double det = ad.z * (bdx_cdy - cdx_bdy) + bd.z * (cdx_ady - adx_cdy) +
+               cd.z * (adx_bdy - bdx_ady);
+  double permanent = (std::abs(bdx_cdy) + std::abs(cdx_bdy)) * std::abs(ad.z) +
+                     (std::abs(cdx_ady) + std::abs(adx_cdy)) * std::abs(bd.z) +
+                     (std::abs(adx_bdy) + std::abs(bdx_ady)) * std::abs(cd.z);
+  double bound = kOrient3dBound * permanent;
+  if (det > bound || -det > bound) {
+    return det;
+  }
+  return Orient3dExact(a, b, c, d);
+}
+
+double InCircle(const glm::dvec2& a, const glm::dvec2& b, const glm::dvec2& c, const glm::dvec2& d) {
+  glm::dvec2 ad = a - d;
+  glm::dvec2 bd = b - d;
+  glm::dvec2 cd = c - d;
+  double bdx_cdy = bd.x * cd.y;
+  double cdx_bdy = cd.x * bd.y;
+  double a_lift = ad.x * ad.x + ad.y * ad.y;
+  double cdx_ady = cd.x * ad.y;
+  double adx_cdy = ad.x * cd.y;
+  double b_lift = bd.x * bd.x + bd.y * bd.y;
+  double adx_bdy = ad.x * bd.y;
+  double bdx_ady = bd.x * ad.y;
+  double c_lift = cd.x * cd.x + cd.y * cd.y;
+  double det = a_lift * (bdx_cdy - cdx_bdy) + b_lift * (cdx_ady - adx_cdy) +
+               c_lift * (adx_bdy - bdx_ady);
+  double permanent = (std::abs(bdx_cdy) + std::abs(cdx_bdy)) * a_lift +
+                     (std::abs(cdx_ady) + std::abs(adx_cdy)) * b_lift +
+                     (std::abs(adx_bdy) + std::abs(bdx_ady)) * c_lift;
+  double bound = kInCircleBound * permanent;
+  if (det > bound || -det > bound) {
+    return det;
+  }
+  return InCircleExact(a, b, c, d);
+}
+
+PredicateCounts ExactPredicateCounts() {
+  PredicateCounts counts;
+  counts.orient2d = orient2d_count.load(std::memory_order_relaxed);
+  counts.orient3d = orient3d_count.load(std::memory_order_relaxed);
+  counts.incircle = incircle_count.load(std::memory_order_relaxed);
+  return counts;
+}
+
+void ResetExactPredicateCounts() {
+  orient2d_count = 0;
+  orient3d_count = 0;
+  incircle_count = 0;
+}
+
+}  // namespace scad
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace scad {
+
+// Exact geometric predicates after Shewchuk, "Adaptive Precision Floating-Point Arithmetic and
+// Fast Robust Geometric Predicates". Each one first evaluates the determinant in double precision
+// and returns it if it is larger than a bound on its rounding error, which is the case for nearly
+// every call. Otherwise (the points are coplanar or nearly so, which is common in this model) the
+// determinant is computed exactly with floating point expansions.
+//
+// The results have the exact sign of the determinant and approximate its value. They are zero only
+// if the points are exactly degenerate.
+
+// Positive if a, b, c are counterclockwise, negative if clockwise, zero if collinear.
+double Orient2d(const glm::dvec2& a, const glm::dvec2& b, const glm::dvec2& c);
+
+// Positive if d is below the plane through a, b, c, where below means a, b, c appear counterclockwise
+// seen from above. Zero if the points are coplanar.
+double Orient3d(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c, const glm::dvec3& d);
+
+// Positive if d is inside the circle through a, b, c, which must be counterclockwise. Zero if the
+// points are cocircular.
+double InCircle(const glm::dvec2& a, const glm::dvec2& b, const glm::dvec2& c, const glm::dvec2& d);
+
+// How often each predicate needed exact arithmetic, counted over all threads.
+struct PredicateCounts {
+  uint64_t orient2d = 0;
+  uint64_t orient3d = 0;
+  uint64_t incircle = 0;
+};
+
+PredicateCounts ExactPredicateCounts();
+void ResetExactPredicateCounts();
+
+}  // namespace scad
@@ -6,12 +6,72 @@
 #endif
 
 #include <math.h>
+#include <algorithm>
 #include <cstdio>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "convex.h"
+#include "evaluator.h"
+#include "import.h"
+#include "mesh.h"
+
 namespace scad {
+namespace {
+
+double OptionalArg(const Optional<double>& value) {
+  return value.has_value() ? value.value() : NAN;
+}
+
+QualityProfile& MutableQuality() {
+  static QualityProfile quality;
+  return quality;
+}
+
+// Takes $fn, $fa and $fs from the quality profile unless the caller set any of them.
+template <typename Params>
+Params WithQuality(Params params) {
+  if (params.fn.has_value() || params.fa.has_value() || params.fs.has_value()) {
+    return params;
+  }
+  const QualityProfile& quality = CurrentQuality();
+  params.fn = quality.fn;
+  params.fa = quality.fa;
+  params.fs = quality.fs;
+  return params;
+}
+
+ShapeNode MakeNode(ShapeOp op, std::vector<double> args, std::vector<Shape> children = {}) {
+  ShapeNode node;
+  node.op = op;
+  node.args = std::move(args);
+  node.children = std::move(children);
+  return node;
+}
+
+Shape PolyhedronFromPolytope(const ConvexPolytope& polytope) {
+  VertexWelder welder;
+  std::vector<std::vector<int>> faces;
+  for (const ConvexFace& face : polytope.faces) {
+    std::vector<int> indices;
+    // Polyhedron faces are clockwise when viewed from the outside.
+    for (auto it = face.points.rbegin(); it != face.points.rend(); ++it) {
+      indices.push_back(static_cast<int>(welder.Add(*it)));
+    }
+    faces.push_back(std::move(indices));
+  }
+  std::vector<Point3d> points;
+  for (const glm::dvec3& v : welder.vertices()) {
+    points.push_back({v.x, v.y, v.z});
+  }
+  return Polyhedron(points, faces);
+}
+
+}  // namespace
 
 const char* BoolStr(bool b) {
   return b ? "true" : "false";
@@ -63,8 +123,54 @@ Shape Shape::LiteralPrimitive(const std::string& primitive) {
   return Primitive([=](std::FILE* file) { fprintf(file, "%s", primitive.c_str()); });
 }
 
+Shape Shape::Primitive(ShapeNode node, const std::function<void(std::FILE*)>& scad_writer) {
+  Shape shape = Primitive(scad_writer);
+  shape.node_ = std::make_shared<const ShapeNode>(std::move(node));
+  return shape;
+}
+
+Shape Shape::Composite(ShapeNode node, const std::function<void(std::FILE*)>& write_name) {
+  Shape shape = Composite(write_name, node.children);
+  shape.node_ = std::make_shared<const ShapeNode>(std::move(node));
+  return shape;
+}
+
+QualityProfile QualityProfile::Draft() {
+  QualityProfile profile;
+  profile.fn = 12;
+  profile.decorations = false;
+  profile.subtractions = false;
+  return profile;
+}
+
+QualityProfile QualityProfile::Review() {
+  QualityProfile profile;
+  profile.fn = 20;
+  return profile;
+}
+
+QualityProfile QualityProfile::Final() {
+  QualityProfile profile;
+  profile.fn = 30;
+  return profile;
+}
+
+const QualityProfile& CurrentQuality() {
+  return MutableQuality();
+}
+
+ScopedQuality::ScopedQuality(const QualityProfile& profile) : previous_(MutableQuality()) {
+  MutableQuality() = profile;
+}
+
+ScopedQuality::~ScopedQuality() {
+  MutableQuality() = previous_;
+}
+
 Shape Cube(const CubeParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
+  ShapeNode node =
+      MakeNode(ShapeOp::kCube, {params.x, params.y, params.z, params.center ? 1.0 : 0.0});
+  return Shape::Primitive(std::move(node), [=](std::FILE* file) {
     fprintf(file,
             "cube (size = [ %.3f, %.3f, %.3f], center = %s);",
             params.x,
@@ -88,7 +194,8 @@ Shape Cube(double size, bool center) {
 }
 
 Shape Square(const SquareParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
+  ShapeNode node = MakeNode(ShapeOp::kSquare, {params.x, params.y, params.center ? 1.0 : 0.0});
+  return Shape::Primitive(std::move(node), [=](std::FILE* file) {
     fprintf(file,
             "square (size = [%.3f, %.3f], center = %s);",
             params.x,
@@ -109,8 +216,12 @@ Shape Square(double size, bool center) {
   return Square(size, size, center);
 }
 
-Shape Sphere(const SphereParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
+Shape Sphere(const SphereParams& sphere_params) {
+  SphereParams params = WithQuality(sphere_params);
+  ShapeNode node = MakeNode(
+      ShapeOp::kSphere,
+      {params.r, OptionalArg(params.fn), OptionalArg(params.fa), OptionalArg(params.fs)});
+  return Shape::Primitive(std::move(node), [=](std::FILE* file) {
     fprintf(file, "sphere (r = %.3f", params.r);
     if (params.fs.has_value()) {
       fprintf(file, ", $fs = %.3f", params.fs.value());
@@ -138,8 +249,12 @@ Shape Sphere(double radius, double fn) {
   return Sphere(params);
 }
 
-Shape Circle(const CircleParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
+Shape Circle(const CircleParams& circle_params) {
+  CircleParams params = WithQuality(circle_params);
+  ShapeNode node = MakeNode(
+      ShapeOp::kCircle,
+      {params.r, OptionalArg(params.fn), OptionalArg(params.fa), OptionalArg(params.fs)});
+  return Shape::Primitive(std::move(node), [=](std::FILE* file) {
     fprintf(file, "circle (r = %.3f", params.r);
     if (params.fs.has_value()) {
       fprintf(file, ", $fs = %.3f", params.fs.value());
@@ -167,17 +282,32 @@ Shape Circle(double radius, double fn) {
   return Circle(params);
 }
 
-Shape Cylinder(const CylinderParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
+Shape Cylinder(const CylinderParams& cylinder_params) {
+  CylinderParams params = WithQuality(cylinder_params);
+  ShapeNode node = MakeNode(ShapeOp::kCylinder,
+                            {params.h,
+                             params.r1,
+                             params.r2,
+                             params.center ? 1.0 : 0.0,
+                             OptionalArg(params.fn),
+                             OptionalArg(params.fa),
+                             OptionalArg(params.fs)});
+  return Shape::Primitive(std::move(node), [=](std::FILE* file) {
     fprintf(file,
             "cylinder(h = %.3f, r1 = %.3f, r2 = %.3f, center = %s",
             params.h,
             params.r1,
             params.r2,
             BoolStr(params.center));
+    if (params.fs.has_value()) {
+      fprintf(file, ", $fs = %.3f", params.fs.value());
+    }
     if (params.fn.has_value()) {
       fprintf(file, ", $fn = %.3f", params.fn.value());
     }
+    if (params.fa.has_value()) {
+      fprintf(file, ", $fa = %.3f", params.fa.value());
+    }
     fprintf(file, ");");
   });
 }
@@ -192,7 +322,11 @@ Shape Cylinder(double height, double radius, Optional<double> fn) {
 }
 
 Shape Polygon(const std::vector<Point2d>& points) {
-  return Shape::Primitive([=](std::FILE* file) {
+  ShapeNode node = MakeNode(ShapeOp::kPolygon, {});
+  for (const Point2d& p : points) {
+    node.points.push_back({p.x, p.y, 0});
+  }
+  return Shape::Primitive(std::move(node), [=](std::FILE* file) {
     fprintf(file, "polygon (points = [");
     for (size_t i = 0; i < points.size(); ++i) {
       const Point2d& p = points[i];
@@ -217,7 +351,10 @@ Shape RegularPolygon(int n, double r) {
 Shape Polyhedron(const std::vector<Point3d>& points,
                  const std::vector<std::vector<int>>& faces,
                  int convexity) {
-  return Shape::Primitive([=](std::FILE* file) {
+  ShapeNode node = MakeNode(ShapeOp::kPolyhedron, {static_cast<double>(convexity)});
+  node.points = points;
+  node.faces = faces;
+  return Shape::Primitive(std::move(node), [=](std::FILE* file) {
     fprintf(file, "polyhedron (points = [");
     for (size_t i = 0; i < points.size(); ++i) {
       const Point3d& p = points[i];
@@ -245,27 +382,70 @@ Shape Polyhedron(const std::vector<Point3d>& points,
   });
 }
 
+Shape RoundedHull(const std::vector<Point3d>& points, double radius, Optional<double> fn) {
+  if (!fn.has_value()) {
+    fn = CurrentQuality().fn;
+  }
+  ShapeNode node = MakeNode(ShapeOp::kRoundedHull, {radius, OptionalArg(fn)});
+  node.points = points;
+  return Shape::Primitive(std::move(node), [=](std::FILE* file) {
+    fprintf(file, "hull () {");
+    for (const Point3d& p : points) {
+      fprintf(file, " translate ([%.3f, %.3f, %.3f]) sphere (r = %.3f", p.x, p.y, p.z, radius);
+      if (fn.has_value()) {
+        fprintf(file, ", $fn = %.3f", fn.value());
+      }
+      fprintf(file, ");");
+    }
+    fprintf(file, " }");
+  });
+}
+
 Shape HullAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("hull ()", shapes);
+  return Shape::Composite(MakeNode(ShapeOp::kHull, {}, shapes),
+                          [](std::FILE* file) { fprintf(file, "hull ()"); });
 }
 
 Shape UnionAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("union ()", shapes);
+  return Shape::Composite(MakeNode(ShapeOp::kUnion, {}, shapes),
+                          [](std::FILE* file) { fprintf(file, "union ()"); });
 }
 
 Shape DifferenceAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("difference ()", shapes);
+  return Shape::Composite(MakeNode(ShapeOp::kDifference, {}, shapes),
+                          [](std::FILE* file) { fprintf(file, "difference ()"); });
 }
 
 Shape IntersectionAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("intersection ()", shapes);
+  return Shape::Composite(MakeNode(ShapeOp::kIntersection, {}, shapes),
+                          [](std::FILE* file) { fprintf(file, "intersection ()"); });
+}
+
+Shape SmoothUnion(const std::vector<Shape>& shapes, double radius) {
+  return Shape::Composite(MakeNode(ShapeOp::kSmoothUnion, {radius}, shapes), [=](std::FILE* file) {
+    fprintf(file, "union () /* smooth, r = %.3f */", radius);
+  });
+}
+
+Shape SmoothDifference(const std::vector<Shape>& shapes, double radius) {
+  return Shape::Composite(MakeNode(ShapeOp::kSmoothDifference, {radius}, shapes),
+                          [=](std::FILE* file) {
+                            fprintf(file, "difference () /* smooth, r = %.3f */", radius);
+                          });
+}
+
+Shape SmoothIntersection(const std::vector<Shape>& shapes, double radius) {
+  return Shape::Composite(MakeNode(ShapeOp::kSmoothIntersection, {radius}, shapes),
+                          [=](std::FILE* file) {
+                            fprintf(file, "intersection () /* smooth, r = %.3f */", radius);
+                          });
 }
 
 Shape Shape::Translate(double x, double y, double z) const {
   auto write_name = [=](std::FILE* file) {
     fprintf(file, "translate ([%.3f, %.3f, %.3f])", x, y, z);
   };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(MakeNode(ShapeOp::kTranslate, {x, y, z}, {*this}), write_name);
 }
 
 Shape Shape::TranslateX(double x) const {
@@ -282,21 +462,22 @@ Shape Shape::TranslateZ(double z) const {
 
 Shape Shape::Mirror(double x, double y, double z) const {
   auto write_name = [=](std::FILE* file) { fprintf(file, "mirror ([%.3f, %.3f, %.3f])", x, y, z); };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(MakeNode(ShapeOp::kMirror, {x, y, z}, {*this}), write_name);
 }
 
 Shape Shape::Rotate(double rx, double ry, double rz) const {
   auto write_name = [=](std::FILE* file) {
     fprintf(file, "rotate ([%.3f, %.3f, %.3f])", rx, ry, rz);
   };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(MakeNode(ShapeOp::kRotate, {rx, ry, rz}, {*this}), write_name);
 }
 
 Shape Shape::Rotate(double degrees, double x, double y, double z) const {
   auto write_name = [=](std::FILE* file) {
     fprintf(file, "rotate (a = %.3f, v = [%.3f, %.3f, %.3f])", degrees, x, y, z);
   };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(MakeNode(ShapeOp::kRotateAxis, {degrees, x, y, z}, {*this}),
+                          write_name);
 }
 
 Shape Shape::RotateX(double degrees) const {
@@ -323,7 +504,15 @@ Shape Shape::LinearExtrude(const LinearExtrudeParams& params) const {
             params.slices,
             params.scale);
   };
-  return Shape::Composite(write_name, {*this});
+  ShapeNode node = MakeNode(ShapeOp::kLinearExtrude,
+                            {params.height,
+                             params.center ? 1.0 : 0.0,
+                             params.convexity,
+                             params.twist,
+                             static_cast<double>(params.slices),
+                             params.scale},
+                            {*this});
+  return Shape::Composite(std::move(node), write_name);
 }
 
 Shape Shape::LinearExtrude(double height) const {
@@ -336,22 +525,24 @@ Shape Shape::Color(double r, double g, double b, double a) const {
   auto write_name = [=](std::FILE* file) {
     fprintf(file, "color (c = [%.3f, %.3f, %.3f, %.3f])", r, g, b, a);
   };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(MakeNode(ShapeOp::kColor, {r, g, b, a}, {*this}), write_name);
 }
 
 Shape Shape::Color(const std::string& color, double a) const {
   auto write_name = [=](std::FILE* file) { fprintf(file, "color (\"%s\", %f)", color.c_str(), a); };
-  return Shape::Composite(write_name, {*this});
+  ShapeNode node = MakeNode(ShapeOp::kColor, {NAN, NAN, NAN, a}, {*this});
+  node.text = color;
+  return Shape::Composite(std::move(node), write_name);
 }
 
 Shape Shape::Alpha(double a) const {
   auto write_name = [=](std::FILE* file) { fprintf(file, "color (alpha = %.3f)", a); };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(MakeNode(ShapeOp::kColor, {NAN, NAN, NAN, a}, {*this}), write_name);
 }
 
 Shape Shape::Scale(double x, double y, double z) const {
   auto write_name = [=](std::FILE* file) { fprintf(file, "scale ([%.3f, %.3f, %.3f])", x, y, z); };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(MakeNode(ShapeOp::kScale, {x, y, z}, {*this}), write_name);
 }
 
 Shape Shape::Scale(double s) const {
@@ -362,14 +553,16 @@ Shape Shape::OffsetRadius(double r, bool chamfer) const {
   auto write_name = [=](std::FILE* file) {
     fprintf(file, "offset (r = %.3f, chamfer = %s)", r, BoolStr(chamfer));
   };
-  return Shape::Composite(write_name, {*this});
+  ShapeNode node = MakeNode(ShapeOp::kOffsetRadius, {r, chamfer ? 1.0 : 0.0}, {*this});
+  return Shape::Composite(std::move(node), write_name);
 }
 
 Shape Shape::OffsetDelta(double delta, bool chamfer) const {
   auto write_name = [=](std::FILE* file) {
     fprintf(file, "offset (delta = %.3f, chamfer = %s)", delta, BoolStr(chamfer));
   };
-  return Shape::Composite(write_name, {*this});
+  ShapeNode node = MakeNode(ShapeOp::kOffsetDelta, {delta, chamfer ? 1.0 : 0.0}, {*this});
+  return Shape::Composite(std::move(node), write_name);
 }
 
 Shape Shape::Subtract(const Shape& other) const {
@@ -400,16 +593,64 @@ Shape& Shape::operator+=(const Shape& other) {
 
 Shape Shape::Comment(const std::string& comment) const {
   Shape shape_copy = *this;
-  return Shape([=](std::FILE* file, int indent_level) {
+  Shape shape([=](std::FILE* file, int indent_level) {
     WriteIndent(file, indent_level);
     fprintf(file, "/* %s */\n", comment.c_str());
     shape_copy.AppendScad(file, indent_level);
   });
+  ShapeNode node = MakeNode(ShapeOp::kComment, {}, {*this});
+  node.text = comment;
+  shape.node_ = std::make_shared<const ShapeNode>(std::move(node));
+  return shape;
 }
 
 Shape Shape::Projection(bool cut) const {
   auto write_name = [=](std::FILE* file) { fprintf(file, "projection (cut = %s)", BoolStr(cut)); };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite(MakeNode(ShapeOp::kProjection, {cut ? 1.0 : 0.0}, {*this}), write_name);
+}
+
+Shape Shape::Sdf(double cell_size) const {
+  auto write_name = [=](std::FILE* file) { fprintf(file, "union () /* sdf, cell = %.3f */", cell_size); };
+  return Shape::Composite(MakeNode(ShapeOp::kSdf, {cell_size}, {*this}), write_name);
+}
+
+Shape Shape::Shell(double thickness, double cell_size) const {
+  Aabb box = Bounds();
+  glm::dvec3 extent = box.size();
+  if (box.empty() || !std::isfinite(extent.x + extent.y + extent.z)) {
+    box = Aabb(glm::dvec3(-1000), glm::dvec3(1000));
+  }
+  box.min -= glm::dvec3(thickness + 1);
+  box.max += glm::dvec3(thickness + 1);
+  glm::dvec3 size = box.size();
+  Shape big = Cube(size.x, size.y, size.z, false).Translate(box.min.x, box.min.y, box.min.z);
+  // The inside is the complement of the outside grown by the thickness.
+  Shape inside = big.Subtract(Minkowski(big.Subtract(*this), Sphere(thickness)));
+  Shape shape = Subtract(inside);
+  shape.node_ = std::make_shared<const ShapeNode>(
+      MakeNode(ShapeOp::kShell, {thickness, cell_size}, {*this}));
+  return shape;
+}
+
+Shape Shape::ExtendToFloor(double z) const {
+  Evaluator evaluator(nullptr);
+  GeometryPtr geometry = evaluator.Evaluate(*this);
+  if (!geometry || !geometry->meshes.empty() || !geometry->polygons.empty()) {
+    return Hull(*this, Projection().LinearExtrude(.1).TranslateZ(z + .05));
+  }
+  std::vector<Shape> shapes;
+  for (const ConvexPolytope& piece : geometry->pieces) {
+    std::vector<glm::dvec3> points = piece.Vertices();
+    size_t count = points.size();
+    for (size_t i = 0; i < count; ++i) {
+      points.push_back({points[i].x, points[i].y, z});
+    }
+    ConvexPolytope swept = ConvexHull(points);
+    if (!swept.empty()) {
+      shapes.push_back(PolyhedronFromPolytope(swept));
+    }
+  }
+  return shapes.size() == 1 ? shapes[0] : UnionAll(shapes);
 }
 
 void Shape::AppendScad(std::FILE* file, int indent_level) const {
@@ -438,7 +679,9 @@ void Shape::WriteToFile(const std::string& file_name) const {
 }
 
 Shape Import(const std::string& file_name, int convexity) {
-  return Shape::Primitive([=](std::FILE* file) {
+  ShapeNode node = MakeNode(ShapeOp::kImport, {static_cast<double>(convexity)});
+  node.text = file_name;
+  return Shape::Primitive(std::move(node), [=](std::FILE* file) {
     if (convexity > 0) {
       fprintf(file, "import (file = \"%s\", convexity = %d);", file_name.c_str(), convexity);
     } else {
@@ -448,7 +691,262 @@ Shape Import(const std::string& file_name, int convexity) {
 }
 
 Shape Minkowski(const Shape& first, const Shape& second) {
-  return Shape::LiteralComposite("minkowski ()", {first, second});
+  return Shape::Composite(MakeNode(ShapeOp::kMinkowski, {}, {first, second}),
+                          [](std::FILE* file) { fprintf(file, "minkowski ()"); });
+}
+
+glm::dmat4 ShapeNode::AffineTransform() const {
+  const std::vector<double>& a = args;
+  glm::dmat4 identity(1.0);
+  switch (op) {
+    case ShapeOp::kTranslate:
+      return glm::translate(identity, glm::dvec3(a[0], a[1], a[2]));
+    case ShapeOp::kRotate: {
+      // openscad rotates around x, then y, then z.
+      glm::dmat4 m = glm::rotate(identity, glm::radians(a[2]), glm::dvec3(0, 0, 1));
+      m = glm::rotate(m, glm::radians(a[1]), glm::dvec3(0, 1, 0));
+      return glm::rotate(m, glm::radians(a[0]), glm::dvec3(1, 0, 0));
+    }
+    case ShapeOp::kRotateAxis: {
+      glm::dvec3 axis(a[1], a[2], a[3]);
+      if (glm::length(axis) == 0) {
+        return identity;
+      }
+      return glm::rotate(identity, glm::radians(a[0]), glm::normalize(axis));
+    }
+    case ShapeOp::kMirror: {
+      glm::dvec3 n(a[0], a[1], a[2]);
+      if (glm::length(n) == 0) {
+        return identity;
+      }
+      n = glm::normalize(n);
+      glm::dmat4 m(1.0);
+      for (int c = 0; c < 3; ++c) {
+        for (int r = 0; r < 3; ++r) {
+          m[c][r] -= 2 * n[c] * n[r];
+        }
+      }
+      return m;
+    }
+    case ShapeOp::kScale:
+      return glm::scale(identity, glm::dvec3(a[0], a[1], a[2]));
+    default:
+      return identity;
+  }
+}
+
+namespace {
+
+Aabb InfiniteBox() {
+  double inf = std::numeric_limits<double>::infinity();
+  return Aabb(glm::dvec3(-inf), glm::dvec3(inf));
+}
+
+bool IsFinite(const Aabb& box) {
+  for (int i = 0; i < 3; ++i) {
+    if (std::isinf(box.min[i]) || std::isinf(box.max[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Aabb TransformBox(const Aabb& box, const glm::dmat4& transform) {
+  if (box.empty() || !IsFinite(box)) {
+    return box;
+  }
+  Aabb result;
+  for (int i = 0; i < 8; ++i) {
+    glm::dvec3 corner(i & 1 ? box.max.x : box.min.x,
+                      i & 2 ? box.max.y : box.min.y,
+                      i & 4 ? box.max.z : box.min.z);
+    result.Extend(glm::dvec3(transform * glm::dvec4(corner, 1)));
+  }
+  return result;
+}
+
+// Grows the box in x and y, e.g. for offsets.
+Aabb ExpandXy(Aabb box, double distance) {
+  if (!box.empty()) {
+    box.min -= glm::dvec3(distance, distance, 0);
+    box.max += glm::dvec3(distance, distance, 0);
+  }
+  return box;
+}
+
+Aabb Flatten(Aabb box) {
+  if (!box.empty()) {
+    box.min.z = 0;
+    box.max.z = 0;
+  }
+  return box;
+}
+
+Aabb ExtrudeBounds(const ShapeNode& node, const Aabb& child) {
+  if (child.empty()) {
+    return child;
+  }
+  double height = node.args[0];
+  bool center = node.args[1] != 0;
+  double twist = node.args[3];
+  double scale = node.args[5];
+  // The top is scaled about the origin and the sides interpolate linearly so the ends bound
+  // every slice.
+  Aabb box = Flatten(child);
+  box.Extend(glm::dvec3(child.min.x * scale, child.min.y * scale, 0));
+  box.Extend(glm::dvec3(child.max.x * scale, child.max.y * scale, 0));
+  if (twist != 0 && IsFinite(box)) {
+    // Twisting sweeps the corners around the z axis.
+    double radius = 0;
+    for (int i = 0; i < 4; ++i) {
+      radius = std::max(radius,
+                        glm::length(glm::dvec2(i & 1 ? box.max.x : box.min.x,
+                                               i & 2 ? box.max.y : box.min.y)));
+    }
+    box = Aabb(glm::dvec3(-radius, -radius, 0), glm::dvec3(radius, radius, 0));
+  }
+  box.min.z = center ? -height / 2 : 0;
+  box.max.z = center ? height / 2 : height;
+  return box;
+}
+
+Aabb ComputeBounds(const ShapeNode& node) {
+  const std::vector<double>& a = node.args;
+  std::vector<Aabb> children;
+  for (const Shape& child : node.children) {
+    children.push_back(child.Bounds());
+  }
+  switch (node.op) {
+    case ShapeOp::kOpaque:
+      return InfiniteBox();
+    case ShapeOp::kCube: {
+      glm::dvec3 size(a[0], a[1], a[2]);
+      glm::dvec3 min = a[3] != 0 ? size * -0.5 : glm::dvec3(0);
+      return Aabb(min, min + size);
+    }
+    case ShapeOp::kSquare: {
+      glm::dvec3 size(a[0], a[1], 0);
+      glm::dvec3 min = a[2] != 0 ? size * -0.5 : glm::dvec3(0);
+      return Aabb(min, min + size);
+    }
+    case ShapeOp::kSphere:
+      // Every vertex of the approximation is on the sphere.
+      return Aabb(glm::dvec3(-a[0]), glm::dvec3(a[0]));
+    case ShapeOp::kCircle:
+      return Aabb(glm::dvec3(-a[0], -a[0], 0), glm::dvec3(a[0], a[0], 0));
+    case ShapeOp::kCylinder: {
+      double r = std::max(a[1], a[2]);
+      double z = a[3] != 0 ? -a[0] / 2 : 0;
+      return Aabb(glm::dvec3(-r, -r, z), glm::dvec3(r, r, z + a[0]));
+    }
+    case ShapeOp::kPolygon:
+    case ShapeOp::kPolyhedron: {
+      Aabb box;
+      for (const Point3d& p : node.points) {
+        box.Extend(glm::dvec3(p.x, p.y, p.z));
+      }
+      return box;
+    }
+    case ShapeOp::kRoundedHull: {
+      Aabb box;
+      for (const Point3d& p : node.points) {
+        box.Extend(glm::dvec3(p.x, p.y, p.z));
+      }
+      if (!box.empty()) {
+        box.min -= glm::dvec3(a[0]);
+        box.max += glm::dvec3(a[0]);
+      }
+      return box;
+    }
+    case ShapeOp::kImport: {
+      Mesh mesh;
+      return ImportMesh(node.text, &mesh) ? mesh.Bounds() : InfiniteBox();
+    }
+    case ShapeOp::kTranslate:
+    case ShapeOp::kRotate:
+    case ShapeOp::kRotateAxis:
+    case ShapeOp::kMirror:
+    case ShapeOp::kScale:
+      return TransformBox(children[0], node.AffineTransform());
+    case ShapeOp::kColor:
+    case ShapeOp::kComment:
+      return children[0];
+    case ShapeOp::kLinearExtrude:
+      return ExtrudeBounds(node, children[0]);
+    case ShapeOp::kProjection:
+      return Flatten(children[0]);
+    case ShapeOp::kOffsetRadius:
+      return ExpandXy(children[0], std::max(a[0], 0.0));
+    case ShapeOp::kOffsetDelta:
+      // Chamfered corners stay within delta of the square around each vertex but mitered corners
+      // of sharp angles can reach arbitrarily far.
+      if (a[0] <= 0) {
+        return children[0];
+      }
+      if (a[1] == 0) {
+        return ExpandXy(children[0], std::numeric_limits<double>::infinity());
+      }
+      return ExpandXy(children[0], a[0] * std::sqrt(2.0));
+    case ShapeOp::kSdf:
+    case ShapeOp::kShell:
+      return children[0];
+    case ShapeOp::kUnion:
+    case ShapeOp::kHull: {
+      Aabb box;
+      for (const Aabb& child : children) {
+        box.Extend(child);
+      }
+      return box;
+    }
+    case ShapeOp::kSmoothUnion: {
+      // Blends fill the corners between the shapes but stay within a quarter of the radius.
+      Aabb box;
+      for (const Aabb& child : children) {
+        box.Extend(child);
+      }
+      if (!box.empty()) {
+        box.min -= glm::dvec3(a[0] / 4);
+        box.max += glm::dvec3(a[0] / 4);
+      }
+      return box;
+    }
+    case ShapeOp::kDifference:
+    case ShapeOp::kSmoothDifference:
+      return children.empty() ? Aabb() : children[0];
+    case ShapeOp::kIntersection:
+    case ShapeOp::kSmoothIntersection: {
+      if (children.empty()) {
+        return Aabb();
+      }
+      Aabb box = children[0];
+      for (const Aabb& child : children) {
+        box.min = glm::max(box.min, child.min);
+        box.max = glm::min(box.max, child.max);
+      }
+      return box.empty() ? Aabb() : box;
+    }
+    case ShapeOp::kMinkowski: {
+      Aabb box(glm::dvec3(0), glm::dvec3(0));
+      for (const Aabb& child : children) {
+        if (child.empty()) {
+          return Aabb();
+        }
+        box.min += child.min;
+        box.max += child.max;
+      }
+      return box;
+    }
+  }
+  return InfiniteBox();
+}
+
+}  // namespace
+
+Aabb Shape::Bounds() const {
+  if (!node_) {
+    return InfiniteBox();
+  }
+  return node_->bounds.Get([this] { return ComputeBounds(*node_); });
 }
 
 }  // namespace scad
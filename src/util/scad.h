@@ -1,10 +1,14 @@
 #pragma once
 
 #include <functional>
+#include <glm/glm.hpp>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "mesh.h"
+
 #if defined(__GNUC__) || defined(__GNUG__)
 #define SCAD_WARN_UNUSED_RESULT __attribute__((warn_unused_result))
 #else
@@ -39,6 +43,17 @@ class Optional {
   bool has_value_ = false;
 };
 
+struct Point2d {
+  double x = 0;
+  double y = 0;
+};
+
+struct Point3d {
+  double x = 0;
+  double y = 0;
+  double z = 0;
+};
+
 struct LinearExtrudeParams {
   double height = 0;
   double twist = 0;
@@ -48,6 +63,8 @@ struct LinearExtrudeParams {
   bool center = true;
 };
 
+struct ShapeNode;
+
 class Shape {
  public:
   Shape() {
@@ -62,6 +79,21 @@ class Shape {
   static Shape LiteralComposite(const std::string& name, const std::vector<Shape>& shapes);
   static Shape Primitive(const std::function<void(std::FILE*)>& scad_writer);
   static Shape LiteralPrimitive(const std::string& primitive);
+  // The same as Primitive and Composite but also records what the shape is so that it can be
+  // evaluated natively. The children of a composite are taken from the node.
+  static Shape Primitive(ShapeNode node, const std::function<void(std::FILE*)>& scad_writer);
+  static Shape Composite(ShapeNode node, const std::function<void(std::FILE*)>& write_name);
+
+  // Null for opaque shapes which were built directly from a scad writer.
+  const ShapeNode* node() const {
+    return node_.get();
+  }
+
+  // A conservative axis aligned bounding box worked out from the structure of the shape without
+  // rendering it. Primitives have exact boxes, transforms map the box of their child, unions and
+  // hulls merge boxes, intersections shrink them and differences keep the box of the first child.
+  // 2d shapes are flat at z = 0 and opaque shapes are unbounded. The box is memoized per node.
+  Aabb Bounds() const;
 
   void WriteToFile(const std::string& file_name) const;
   void AppendScad(std::FILE* file, int indent_level) const;
@@ -114,8 +146,150 @@ class Shape {
 
   Shape SCAD_WARN_UNUSED_RESULT Projection(bool cut = false) const;
 
+  // Evaluates the shape natively as a signed distance field meshed with cells of the given size,
+  // see sdf.h. The blends of SmoothUnion and friends only take effect inside of it. Written to
+  // openscad as a plain union.
+  Shape SCAD_WARN_UNUSED_RESULT Sdf(double cell_size) const;
+
+  // Hollows the solid to a wall of the given thickness inside of its surface. Evaluated natively
+  // as the distance field of the wall meshed with cells of the given size, which should be well
+  // below the thickness. Written to openscad as the solid minus its inside eroded by a minkowski
+  // sum with a sphere, which is exact but very slow there.
+  Shape SCAD_WARN_UNUSED_RESULT Shell(double thickness, double cell_size) const;
+
+  // The shape swept straight down (or up) to the plane at height z, i.e. each convex piece hulled
+  // with its own footprint. Shapes which evaluate natively to convex pieces become one polyhedron
+  // per piece right away, anything else is written as the hull with a thin slab of its projection.
+  Shape SCAD_WARN_UNUSED_RESULT ExtendToFloor(double z = 0) const;
+
  private:
   std::shared_ptr<const ScadWriter> scad_;
+  std::shared_ptr<const ShapeNode> node_;
+};
+
+enum class ShapeOp {
+  kOpaque,
+  // Primitives
+  kCube,
+  kSphere,
+  kCylinder,
+  kSquare,
+  kCircle,
+  kPolygon,
+  kPolyhedron,
+  kImport,
+  kRoundedHull,
+  // Single child operations
+  kTranslate,
+  kRotate,
+  kRotateAxis,
+  kMirror,
+  kScale,
+  kColor,
+  kComment,
+  kLinearExtrude,
+  kProjection,
+  kOffsetRadius,
+  kOffsetDelta,
+  kSdf,
+  kShell,
+  // Operations over all children
+  kUnion,
+  kDifference,
+  kIntersection,
+  kHull,
+  kMinkowski,
+  kSmoothUnion,
+  kSmoothDifference,
+  kSmoothIntersection,
+};
+
+// A value computed on first use which can be shared between threads. Copies start out without a
+// value.
+template <typename T>
+class Memo {
+ public:
+  Memo() {
+  }
+  Memo(const Memo&) {
+  }
+  Memo& operator=(const Memo&) {
+    return *this;
+  }
+
+  template <typename Compute>
+  T Get(const Compute& compute) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_value_) {
+      value_ = compute();
+      has_value_ = true;
+    }
+    return value_;
+  }
+
+ private:
+  std::mutex mutex_;
+  bool has_value_ = false;
+  T value_;
+};
+
+// Structural description of a shape used by the native evaluator.
+struct ShapeNode {
+  ShapeOp op = ShapeOp::kOpaque;
+  // Numeric arguments in the order they are written to scad, e.g. [x, y, z] for translate and
+  // [h, r1, r2, center, fn, fa, fs] for cylinder. Booleans are 0 or 1 and unset optionals are NaN.
+  std::vector<double> args;
+  // Points for polygon (z = 0) and polyhedron.
+  std::vector<Point3d> points;
+  std::vector<std::vector<int>> faces;
+  // The file for import, the color name for color and the text of a comment.
+  std::string text;
+  std::vector<Shape> children;
+
+  // The transform applied by translate, rotate, mirror and scale nodes. The identity for any other
+  // node.
+  glm::dmat4 AffineTransform() const;
+
+  // Memoized by Shape::Bounds().
+  mutable Memo<Aabb> bounds;
+};
+
+// The level of detail of a whole model. Curved primitives which set none of $fn, $fa and $fs
+// themselves take them from the current profile, and model code asks it whether to add parts which
+// are only there to look at and subtractions which are slow to preview. Without a profile nothing
+// is set and openscad's defaults apply.
+struct QualityProfile {
+  Optional<double> fn;
+  Optional<double> fa;
+  Optional<double> fs;
+  // E.g. key caps.
+  bool decorations = true;
+  // Subtractions which hardly change the outline, e.g. the clearance around the keys.
+  bool subtractions = true;
+
+  // Coarse circles without decorations and subtractions, quick to iterate on.
+  static QualityProfile Draft();
+  // Finer circles with everything else, for looking over a change.
+  static QualityProfile Review();
+  // The exact model which gets printed.
+  static QualityProfile Final();
+};
+
+// The profile shapes are created with. It is process wide so it should only be changed while no
+// shapes are created on other threads.
+const QualityProfile& CurrentQuality();
+
+// Makes a profile current until it goes out of scope.
+class ScopedQuality {
+ public:
+  explicit ScopedQuality(const QualityProfile& profile);
+  ~ScopedQuality();
+
+  ScopedQuality(const ScopedQuality&) = delete;
+  ScopedQuality& operator=(const ScopedQuality&) = delete;
+
+ private:
+  QualityProfile previous_;
 };
 
 struct CubeParams {
@@ -153,6 +327,8 @@ struct CylinderParams {
   double r1 = 1;
   double r2 = 1;
   Optional<double> fn;
+  Optional<double> fa;
+  Optional<double> fs;
   bool center = true;
 };
 Shape SCAD_WARN_UNUSED_RESULT Cylinder(const CylinderParams& params);
@@ -167,23 +343,22 @@ Shape SCAD_WARN_UNUSED_RESULT Square(const CubeParams& params);
 Shape SCAD_WARN_UNUSED_RESULT Square(double x, double y, bool center = true);
 Shape SCAD_WARN_UNUSED_RESULT Square(double size, bool center = true);
 
-struct Point2d {
-  double x = 0;
-  double y = 0;
-};
 Shape SCAD_WARN_UNUSED_RESULT Polygon(const std::vector<Point2d>& points);
 
 Shape SCAD_WARN_UNUSED_RESULT RegularPolygon(int n, double radius);
 
-struct Point3d {
-  double x = 0;
-  double y = 0;
-  double z = 0;
-};
 Shape SCAD_WARN_UNUSED_RESULT Polyhedron(const std::vector<Point3d>& points,
                                          const std::vector<std::vector<int>>& faces,
                                          int convexity = 1);
 
+// The hull of spheres of the given radius around the points, e.g. a wall or connector with rounded
+// edges. fn is the number of fragments of a full circle like for spheres. Natively the offset of
+// the hull of the points is tessellated directly, which costs about as much as a plain hull.
+// Written to openscad as the hull of the spheres.
+Shape SCAD_WARN_UNUSED_RESULT RoundedHull(const std::vector<Point3d>& points,
+                                          double radius,
+                                          Optional<double> fn = {});
+
 Shape SCAD_WARN_UNUSED_RESULT HullAll(const std::vector<Shape>& shapes);
 
 template <typename... Shapes>
@@ -212,6 +387,13 @@ Shape SCAD_WARN_UNUSED_RESULT Intersection(const Shape& shape, const Shapes&...
   return IntersectionAll({shape, more_shapes...});
 }
 
+// Booleans which round the edges where the shapes meet with a blend of the given radius. They
+// are only blended when evaluated inside of Shape::Sdf, everywhere else (and in openscad) they are
+// the sharp booleans.
+Shape SCAD_WARN_UNUSED_RESULT SmoothUnion(const std::vector<Shape>& shapes, double radius);
+Shape SCAD_WARN_UNUSED_RESULT SmoothDifference(const std::vector<Shape>& shapes, double radius);
+Shape SCAD_WARN_UNUSED_RESULT SmoothIntersection(const std::vector<Shape>& shapes, double radius);
+
 Shape SCAD_WARN_UNUSED_RESULT Import(const std::string& file_name, int convexity = -1);
 
 Shape SCAD_WARN_UNUSED_RESULT Minkowski(const Shape& first, const Shape& second);
@@ -0,0 +1,920 @@
+#include "sdf.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "convex_union.h"
+
+namespace scad {
+namespace {
+
+// Points per batch, a multiple of every vector width.
+constexpr size_t kBatchSize = 64;
+
+using Batch = std::array<double, kBatchSize>;
+
+// Blends of the polynomial smooth minimum, which is below both values by at most radius / 4 and
+// only where they are within radius of each other.
+double SmoothMin(double a, double b, double radius) {
+  double h = std::max(radius - std::abs(a - b), 0.0) / radius;
+  return std::min(a, b) - h * h * radius * 0.25;
+}
+
+double Combine(double a, double b, double radius, bool take_max) {
+  if (radius > 0) {
+    return take_max ? -SmoothMin(-a, -b, radius) : SmoothMin(a, b, radius);
+  }
+  return take_max ? std::max(a, b) : std::min(a, b);
+}
+
+// Distances in the frame of the primitives, see Instruction::size.
+
+inline double SphereValue(const glm::dvec3& size, double x, double y, double z) {
+  return std::sqrt(x * x + y * y + z * z) - size.x;
+}
+
+inline double BoxValue(const glm::dvec3& size, double x, double y, double z) {
+  double qx = std::abs(x) - size.x;
+  double qy = std::abs(y) - size.y;
+  double qz = std::abs(z) - size.z;
+  double ox = std::max(qx, 0.0);
+  double oy = std::max(qy, 0.0);
+  double oz = std::max(qz, 0.0);
+  double inside = std::min(std::max(qx, std::max(qy, qz)), 0.0);
+  return std::sqrt(ox * ox + oy * oy + oz * oz) + inside;
+}
+
+// The larger of the distances to the planes of the caps and to the line of the side in the plane
+// through the axis.
+inline double CylinderValue(const glm::dvec3& size, double x, double y, double z) {
+  double r1 = size.x;
+  double r2 = size.y;
+  double h = size.z;
+  double length = std::sqrt(h * h + (r2 - r1) * (r2 - r1));
+  double rho = std::sqrt(x * x + y * y);
+  double side = (rho - 0.5 * (r1 + r2)) * h - (r2 - r1) * z;
+  double cap = std::abs(z) - 0.5 * h;
+  return std::max(length > 0 ? side / length : side, cap);
+}
+
+// Eigen decomposition of a symmetric 3x3 matrix by Jacobi rotations. The columns of vectors are
+// the eigenvectors.
+void SymmetricEigen(glm::dmat3 a, glm::dvec3* values, glm::dmat3* vectors) {
+  glm::dmat3 v(1.0);
+  for (int sweep = 0; sweep < 16; ++sweep) {
+    double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    if (off < 1e-24) {
+      break;
+    }
+    for (int p = 0; p < 2; ++p) {
+      for (int q = p + 1; q < 3; ++q) {
+        if (a[p][q] == 0) {
+          continue;
+        }
+        double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+        double t = (theta >= 0 ? 1 : -1) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+        double c = 1 / std::sqrt(t * t + 1);
+        double s = t * c;
+        glm::dmat3 rotation(1.0);
+        rotation[p][p] = c;
+        rotation[q][q] = c;
+        rotation[q][p] = s;
+        rotation[p][q] = -s;
+        a = glm::transpose(rotation) * a * rotation;
+        v = v * rotation;
+      }
+    }
+  }
+  *values = glm::dvec3(a[0][0], a[1][1], a[2][2]);
+  *vectors = v;
+}
+
+// The smallest singular value of the linear part of the transform.
+double SmallestStretch(const glm::dmat4& transform) {
+  glm::dmat3 linear(transform);
+  glm::dvec3 values;
+  glm::dmat3 vectors;
+  SymmetricEigen(glm::transpose(linear) * linear, &values, &vectors);
+  return std::sqrt(std::max(std::min({values.x, values.y, values.z}), 0.0));
+}
+
+}  // namespace
+
+struct SdfProgram::PieceSet {
+  std::vector<ConvexPolytope> pieces;
+  std::unique_ptr<BoxTree> tree;
+};
+
+struct SdfProgram::ShellSet {
+  double thickness = 0;
+  // The surface the distances are measured to.
+  std::unique_ptr<MeshTree> surface;
+  // Points inside of these pieces or inside of the imported meshes are inside.
+  std::unique_ptr<PieceSet> pieces;
+  Mesh imported;
+  std::unique_ptr<MeshTree> imported_tree;
+  // The triangles of the surface from here on are the imported ones, in order.
+  size_t first_imported = 0;
+};
+
+namespace {
+
+// Whether p is inside of the closed mesh, by the parity of the crossings of a ray.
+bool InsideMesh(const MeshTree& tree, glm::dvec3 p) {
+  // Not along any axis or diagonal so rays hardly ever graze the edges of the mostly axis
+  // aligned faces of the case.
+  const glm::dvec3 direction = glm::normalize(glm::dvec3(0.5773, 0.6131, 0.5399));
+  bool inside = false;
+  MeshTree::Hit hit;
+  for (int i = 0; i < 1000 && tree.Raycast(p, direction, &hit); ++i) {
+    inside = !inside;
+    p = hit.point + direction * kGeometryEpsilon;
+  }
+  return inside;
+}
+
+}  // namespace
+
+SdfProgram::SdfProgram() {
+}
+
+SdfProgram::~SdfProgram() {
+}
+
+bool SdfProgram::Compile(const Shape& shape,
+                         const PieceEvaluator& evaluate_pieces,
+                         double band,
+                         ThreadPool* pool) {
+  program_.clear();
+  piece_sets_.clear();
+  shell_sets_.clear();
+  blend_memo_.clear();
+  evaluate_pieces_ = &evaluate_pieces;
+  pool_ = pool;
+  bool ok = CompileNode(shape, glm::dmat4(1.0));
+  evaluate_pieces_ = nullptr;
+  pool_ = nullptr;
+  if (!ok) {
+    return false;
+  }
+  size_t depth = 0;
+  max_depth_ = 0;
+  double radius = 0;
+  for (const Instruction& instruction : program_) {
+    if (instruction.op >= Op::kUnion) {
+      --depth;
+      radius = std::max(radius, instruction.radius);
+    } else {
+      max_depth_ = std::max(max_depth_, ++depth);
+    }
+  }
+  band_ = band + 2 * radius;
+  return true;
+}
+
+bool SdfProgram::HasBlend(const ShapeNode* node) {
+  if (!node) {
+    return false;
+  }
+  auto it = blend_memo_.find(node);
+  if (it != blend_memo_.end()) {
+    return it->second;
+  }
+  bool blend = node->op == ShapeOp::kSmoothUnion || node->op == ShapeOp::kSmoothDifference ||
+               node->op == ShapeOp::kSmoothIntersection;
+  for (const Shape& child : node->children) {
+    blend = blend || HasBlend(child.node());
+  }
+  blend_memo_[node] = blend;
+  return blend;
+}
+
+void SdfProgram::AddPrimitive(Op op,
+                              const glm::dmat4& transform,
+                              const glm::dmat4& frame,
+                              glm::dvec3 size) {
+  Instruction instruction;
+  instruction.op = op;
+  glm::dmat4 to_world = transform * frame;
+  instruction.to_local = glm::inverse(to_world);
+  instruction.scale = SmallestStretch(to_world);
+  instruction.size = size;
+  program_.push_back(instruction);
+}
+
+std::unique_ptr<SdfProgram::PieceSet> SdfProgram::MakePieceSet(
+    std::vector<ConvexPolytope> pieces) {
+  auto set = std::make_unique<PieceSet>();
+  set->pieces = std::move(pieces);
+  std::vector<Aabb> boxes;
+  for (const ConvexPolytope& piece : set->pieces) {
+    boxes.push_back(piece.Bounds());
+  }
+  if (!boxes.empty()) {
+    set->tree = std::make_unique<BoxTree>(std::move(boxes));
+  }
+  return set;
+}
+
+bool SdfProgram::CompilePieces(const Shape& shape, const glm::dmat4& transform) {
+  std::vector<ConvexPolytope> pieces;
+  if (!(*evaluate_pieces_)(shape, &pieces)) {
+    return false;
+  }
+  if (transform != glm::dmat4(1.0)) {
+    for (ConvexPolytope& piece : pieces) {
+      piece = TransformPolytope(piece, transform);
+    }
+  }
+  Instruction instruction;
+  instruction.op = Op::kPieces;
+  instruction.pieces = piece_sets_.size();
+  piece_sets_.push_back(MakePieceSet(std::move(pieces)));
+  program_.push_back(instruction);
+  return true;
+}
+
+void SdfProgram::AddShell(std::vector<ConvexPolytope> pieces,
+                          const std::vector<Mesh>& meshes,
+                          double thickness,
+                          ThreadPool* pool) {
+  auto set = std::make_unique<ShellSet>();
+  set->thickness = thickness;
+  Mesh surface = UnionConvex(pieces, pool);
+  set->first_imported = surface.triangles.size();
+  for (const Mesh& mesh : meshes) {
+    set->imported.Append(mesh);
+  }
+  surface.Append(set->imported);
+  set->surface = std::make_unique<MeshTree>(surface);
+  set->pieces = MakePieceSet(std::move(pieces));
+  if (!set->imported.empty()) {
+    set->imported_tree = std::make_unique<MeshTree>(set->imported);
+  }
+  Instruction instruction;
+  instruction.op = Op::kShell;
+  instruction.size = glm::dvec3(thickness, 0, 0);
+  instruction.pieces = shell_sets_.size();
+  shell_sets_.push_back(std::move(set));
+  program_.push_back(instruction);
+}
+
+void SdfProgram::CompileShell(const std::vector<ConvexPolytope>& pieces,
+                              const std::vector<Mesh>& meshes,
+                              double thickness,
+                              double band,
+                              ThreadPool* pool) {
+  program_.clear();
+  piece_sets_.clear();
+  shell_sets_.clear();
+  AddShell(pieces, meshes, thickness, pool);
+  max_depth_ = 1;
+  band_ = band;
+}
+
+bool SdfProgram::CompileNode(const Shape& shape, const glm::dmat4& transform) {
+  const ShapeNode* node = shape.node();
+  if (!node) {
+    fprintf(stderr, "Distance fields do not support opaque shapes\n");
+    return false;
+  }
+  const std::vector<double>& a = node->args;
+  switch (node->op) {
+    case ShapeOp::kTranslate:
+    case ShapeOp::kRotate:
+    case ShapeOp::kRotateAxis:
+    case ShapeOp::kMirror:
+    case ShapeOp::kScale:
+      return CompileNode(node->children[0], transform * node->AffineTransform());
+    case ShapeOp::kColor:
+    case ShapeOp::kComment:
+    case ShapeOp::kSdf:
+      return CompileNode(node->children[0], transform);
+    case ShapeOp::kSphere:
+      AddPrimitive(Op::kSphere, transform, glm::dmat4(1.0), glm::dvec3(a[0], 0, 0));
+      return true;
+    case ShapeOp::kCube: {
+      glm::dvec3 half(a[0] / 2, a[1] / 2, a[2] / 2);
+      glm::dvec3 center = a[3] != 0 ? glm::dvec3(0) : half;
+      AddPrimitive(Op::kBox, transform, glm::translate(glm::dmat4(1.0), center), half);
+      return true;
+    }
+    case ShapeOp::kCylinder: {
+      double center = a[3] != 0 ? 0 : a[0] / 2;
+      AddPrimitive(Op::kCylinder,
+                   transform,
+                   glm::translate(glm::dmat4(1.0), glm::dvec3(0, 0, center)),
+                   glm::dvec3(a[1], a[2], a[0]));
+      return true;
+    }
+    case ShapeOp::kShell: {
+      std::vector<ConvexPolytope> pieces;
+      if (!(*evaluate_pieces_)(node->children[0], &pieces)) {
+        return false;
+      }
+      for (ConvexPolytope& piece : pieces) {
+        piece = TransformPolytope(piece, transform);
+      }
+      AddShell(std::move(pieces), {}, a[0] * SmallestStretch(transform), pool_);
+      return true;
+    }
+    case ShapeOp::kUnion:
+    case ShapeOp::kDifference:
+    case ShapeOp::kIntersection:
+    case ShapeOp::kSmoothUnion:
+    case ShapeOp::kSmoothDifference:
+    case ShapeOp::kSmoothIntersection:
+      break;
+    case ShapeOp::kSquare:
+    case ShapeOp::kCircle:
+    case ShapeOp::kPolygon:
+    case ShapeOp::kProjection:
+    case ShapeOp::kOffsetRadius:
+    case ShapeOp::kOffsetDelta:
+      fprintf(stderr, "Distance fields do not support 2D shapes\n");
+      return false;
+    default:
+      return CompilePieces(shape, transform);
+  }
+
+  // Sharp booleans of pieces are just pieces, which are much cheaper to evaluate as one set.
+  if (!HasBlend(node) || node->children.empty()) {
+    return CompilePieces(shape, transform);
+  }
+  Instruction instruction;
+  switch (node->op) {
+    case ShapeOp::kUnion:
+    case ShapeOp::kSmoothUnion:
+      instruction.op = Op::kUnion;
+      break;
+    case ShapeOp::kDifference:
+    case ShapeOp::kSmoothDifference:
+      instruction.op = Op::kDifference;
+      break;
+    default:
+      instruction.op = Op::kIntersection;
+      break;
+  }
+  bool smooth = node->op == ShapeOp::kSmoothUnion || node->op == ShapeOp::kSmoothDifference ||
+                node->op == ShapeOp::kSmoothIntersection;
+  instruction.radius = smooth ? std::max(a[0], 0.0) : 0;
+  for (size_t i = 0; i < node->children.size(); ++i) {
+    if (!CompileNode(node->children[i], transform)) {
+      return false;
+    }
+    if (i > 0) {
+      program_.push_back(instruction);
+    }
+  }
+  return true;
+}
+
+double SdfProgram::EvaluatePieces(const PieceSet& set, const glm::dvec3& p) const {
+  if (!set.tree) {
+    return band_;
+  }
+  thread_local std::vector<uint32_t> found;
+  found.clear();
+  set.tree->Query(Aabb(p, p), &found, band_);
+  double value = band_;
+  for (uint32_t index : found) {
+    double distance = std::numeric_limits<double>::lowest();
+    for (const ConvexFace& face : set.pieces[index].faces) {
+      distance = std::max(distance, face.plane.Distance(p));
+    }
+    value = std::min(value, distance);
+  }
+  return value;
+}
+
+// The distance to the wall, which is where the distance to the surface is between minus the
+// thickness and zero.
+double SdfProgram::EvaluateShell(const ShellSet& set, const glm::dvec3& p) const {
+  MeshTree::Hit hit;
+  if (!set.surface->ClosestPoint(p, &hit, band_ + set.thickness)) {
+    // Far from the wall on either side, which saves the ray casts.
+    return band_;
+  }
+  double distance = hit.distance;
+  bool inside = EvaluatePieces(*set.pieces, p) < 0;
+  if (!inside && set.imported_tree) {
+    // The side of an imported face is given by its normal if the closest point is inside of it,
+    // only points closest to edges and corners need the ray casts.
+    glm::dvec3 offset = p - hit.point;
+    glm::dvec3 normal(0);
+    if (hit.triangle >= set.first_imported) {
+      const auto& t = set.imported.triangles[hit.triangle - set.first_imported];
+      const std::vector<glm::dvec3>& v = set.imported.vertices;
+      normal = glm::cross(v[t[1]] - v[t[0]], v[t[2]] - v[t[0]]);
+    }
+    double length = glm::length(normal) * distance;
+    double along = glm::dot(offset, normal);
+    if (length > 0 && std::abs(along) > length * (1 - 1e-9)) {
+      inside = along < 0;
+    } else {
+      inside = InsideMesh(*set.imported_tree, p);
+    }
+  }
+  double value = inside ? -distance : distance;
+  // Clamped like the pieces.
+  return std::min(std::max(value, -value - set.thickness), band_);
+}
+
+SdfProgram::Interval SdfProgram::EvaluatePieces(const PieceSet& set, const Aabb& box) const {
+  if (!set.tree) {
+    return {band_, band_};
+  }
+  std::vector<uint32_t> found;
+  set.tree->Query(box, &found, band_);
+  glm::dvec3 center = box.center();
+  glm::dvec3 half = box.size() * 0.5;
+  Interval result{band_, band_};
+  for (uint32_t index : found) {
+    // Plane distances are linear so their range over the box is exact.
+    Interval piece{std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+    for (const ConvexFace& face : set.pieces[index].faces) {
+      double d = face.plane.Distance(center);
+      double spread = glm::dot(glm::abs(face.plane.normal), half);
+      piece.min = std::max(piece.min, d - spread);
+      piece.max = std::max(piece.max, d + spread);
+    }
+    result.min = std::min(result.min, piece.min);
+    result.max = std::min(result.max, piece.max);
+  }
+  return result;
+}
+
+void SdfProgram::Evaluate(const glm::dvec3* points, size_t count, double* values) const {
+  for (size_t begin = 0; begin < count; begin += kBatchSize) {
+    EvaluateBatch(points + begin, std::min(kBatchSize, count - begin), values + begin);
+  }
+}
+
+void SdfProgram::EvaluateBatch(const glm::dvec3* points, size_t count, double* values) const {
+  alignas(64) Batch x;
+  alignas(64) Batch y;
+  alignas(64) Batch z;
+  for (size_t i = 0; i < count; ++i) {
+    x[i] = points[i].x;
+    y[i] = points[i].y;
+    z[i] = points[i].z;
+  }
+  for (size_t i = count; i < kBatchSize; ++i) {
+    x[i] = y[i] = z[i] = 0;
+  }
+  thread_local std::vector<Batch> stack;
+  stack.resize(std::max(stack.size(), max_depth_));
+  size_t top = 0;
+  alignas(64) Batch lx;
+  alignas(64) Batch ly;
+  alignas(64) Batch lz;
+  for (const Instruction& instruction : program_) {
+    if (instruction.op >= Op::kUnion) {
+      Batch& a = stack[top - 2];
+      const Batch& b = stack[top - 1];
+      --top;
+      double radius = instruction.radius;
+      if (instruction.op == Op::kUnion) {
+        for (size_t i = 0; i < kBatchSize; ++i) {
+          a[i] = Combine(a[i], b[i], radius, false);
+        }
+      } else if (instruction.op == Op::kIntersection) {
+        for (size_t i = 0; i < kBatchSize; ++i) {
+          a[i] = Combine(a[i], b[i], radius, true);
+        }
+      } else {
+        for (size_t i = 0; i < kBatchSize; ++i) {
+          a[i] = Combine(a[i], -b[i], radius, true);
+        }
+      }
+      continue;
+    }
+    Batch& out = stack[top++];
+    if (instruction.op == Op::kPieces) {
+      const PieceSet& set = *piece_sets_[instruction.pieces];
+      for (size_t i = 0; i < count; ++i) {
+        out[i] = EvaluatePieces(set, points[i]);
+      }
+      continue;
+    }
+    if (instruction.op == Op::kShell) {
+      const ShellSet& set = *shell_sets_[instruction.pieces];
+      for (size_t i = 0; i < count; ++i) {
+        out[i] = EvaluateShell(set, points[i]);
+      }
+      continue;
+    }
+    const glm::dmat4& m = instruction.to_local;
+    for (size_t i = 0; i < kBatchSize; ++i) {
+      lx[i] = m[0][0] * x[i] + m[1][0] * y[i] + m[2][0] * z[i] + m[3][0];
+      ly[i] = m[0][1] * x[i] + m[1][1] * y[i] + m[2][1] * z[i] + m[3][1];
+      lz[i] = m[0][2] * x[i] + m[1][2] * y[i] + m[2][2] * z[i] + m[3][2];
+    }
+    double scale = instruction.scale;
+    const glm::dvec3& size = instruction.size;
+    switch (instruction.op) {
+      case Op::kSphere:
+        for (size_t i = 0; i < kBatchSize; ++i) {
+          out[i] = SphereValue(size, lx[i], ly[i], lz[i]) * scale;
+        }
+        break;
+      case Op::kBox:
+        for (size_t i = 0; i < kBatchSize; ++i) {
+          out[i] = BoxValue(size, lx[i], ly[i], lz[i]) * scale;
+        }
+        break;
+      case Op::kCylinder:
+        for (size_t i = 0; i < kBatchSize; ++i) {
+          out[i] = CylinderValue(size, lx[i], ly[i], lz[i]) * scale;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  std::copy(stack[0].begin(), stack[0].begin() + count, values);
+}
+
+SdfProgram::Interval SdfProgram::Evaluate(const Aabb& box) const {
+  std::vector<Interval> stack;
+  stack.reserve(max_depth_);
+  glm::dvec3 center = box.center();
+  double half_diagonal = glm::length(box.size()) * 0.5;
+  for (const Instruction& instruction : program_) {
+    if (instruction.op >= Op::kUnion) {
+      Interval b = stack.back();
+      stack.pop_back();
+      Interval& a = stack.back();
+      double radius = instruction.radius;
+      // Every operation is monotonic in each of its arguments.
+      if (instruction.op == Op::kUnion) {
+        a = {Combine(a.min, b.min, radius, false), Combine(a.max, b.max, radius, false)};
+      } else if (instruction.op == Op::kIntersection) {
+        a = {Combine(a.min, b.min, radius, true), Combine(a.max, b.max, radius, true)};
+      } else {
+        a = {Combine(a.min, -b.max, radius, true), Combine(a.max, -b.min, radius, true)};
+      }
+      continue;
+    }
+    if (instruction.op == Op::kPieces) {
+      stack.push_back(EvaluatePieces(*piece_sets_[instruction.pieces], box));
+      continue;
+    }
+    // Primitives change by at most the distance moved.
+    glm::dvec3 l(instruction.to_local * glm::dvec4(center, 1));
+    double value = 0;
+    if (instruction.op == Op::kShell) {
+      value = EvaluateShell(*shell_sets_[instruction.pieces], center);
+    } else if (instruction.op == Op::kSphere) {
+      value = SphereValue(instruction.size, l.x, l.y, l.z);
+    } else if (instruction.op == Op::kBox) {
+      value = BoxValue(instruction.size, l.x, l.y, l.z);
+    } else {
+      value = CylinderValue(instruction.size, l.x, l.y, l.z);
+    }
+    value *= instruction.scale;
+    stack.push_back({value - half_diagonal, value + half_diagonal});
+  }
+  return stack.empty() ? Interval{band_, band_} : stack[0];
+}
+
+namespace {
+
+// Cells and corners of the lattice are packed into keys of 20 bits per axis.
+constexpr int kKeyBits = 20;
+constexpr int64_t kMaxCells = int64_t(1) << (kKeyBits - 1);
+
+uint64_t Key(int64_t x, int64_t y, int64_t z) {
+  return static_cast<uint64_t>(x) | static_cast<uint64_t>(y) << kKeyBits |
+         static_cast<uint64_t>(z) << (2 * kKeyBits);
+}
+
+glm::i64vec3 Unkey(uint64_t key) {
+  uint64_t mask = (uint64_t(1) << kKeyBits) - 1;
+  return glm::i64vec3(key & mask, (key >> kKeyBits) & mask, key >> (2 * kKeyBits));
+}
+
+// Index of key in the sorted keys or -1.
+int64_t Find(const std::vector<uint64_t>& keys, uint64_t key) {
+  auto it = std::lower_bound(keys.begin(), keys.end(), key);
+  return it != keys.end() && *it == key ? it - keys.begin() : -1;
+}
+
+// Runs f(begin, end) over chunks of [0, count) on the pool.
+template <typename F>
+void ParallelChunks(ThreadPool* pool, size_t count, size_t chunk, const F& f) {
+  TaskGroup group(pool);
+  for (size_t begin = 0; begin < count; begin += chunk) {
+    size_t end = std::min(count, begin + chunk);
+    group.Run([&f, begin, end] { f(begin, end); });
+  }
+  group.Wait();
+}
+
+constexpr size_t kChunkSize = 4096;
+
+class DualContouring {
+ public:
+  DualContouring(const SdfProgram& program,
+                 const glm::dvec3& origin,
+                 double cell_size,
+                 ThreadPool* pool)
+      : program_(program), origin_(origin), cell_size_(cell_size), pool_(pool) {
+  }
+
+  Mesh Run(int64_t root_size) {
+    FindCells(glm::i64vec3(0), root_size, &cells_);
+    std::sort(cells_.begin(), cells_.end());
+    EvaluateCorners();
+    FindCrossings();
+    PlaceVertices();
+    return MakeMesh();
+  }
+
+ private:
+  struct Crossing {
+    uint64_t corner = 0;
+    int axis = 0;
+    // Whether the surface is crossed from inside to outside along the axis.
+    bool outwards = false;
+    glm::dvec3 point = glm::dvec3(0);
+    glm::dvec3 normal = glm::dvec3(0);
+  };
+
+  glm::dvec3 Position(const glm::i64vec3& p) const {
+    return origin_ + glm::dvec3(p) * cell_size_;
+  }
+
+  // Appends the cells below the octree node whose values may change sign.
+  void FindCells(const glm::i64vec3& min, int64_t size, std::vector<uint64_t>* out) const {
+    Aabb box(Position(min), Position(min + size));
+    // The intervals are rounded so corners at exactly zero need a margin.
+    SdfProgram::Interval range = program_.Evaluate(box);
+    double margin = cell_size_ * 1e-6;
+    if (range.min > margin || range.max < -margin) {
+      return;
+    }
+    if (size == 1) {
+      out->push_back(Key(min.x, min.y, min.z));
+      return;
+    }
+    int64_t half = size / 2;
+    if (size < 32) {
+      for (int i = 0; i < 8; ++i) {
+        FindCells(min + glm::i64vec3(i & 1, (i >> 1) & 1, i >> 2) * half, half, out);
+      }
+      return;
+    }
+    std::array<std::vector<uint64_t>, 8> children;
+    {
+      TaskGroup group(pool_);
+      for (int i = 0; i < 8; ++i) {
+        group.Run([&, i] {
+          FindCells(min + glm::i64vec3(i & 1, (i >> 1) & 1, i >> 2) * half, half, &children[i]);
+        });
+      }
+      group.Wait();
+    }
+    for (const std::vector<uint64_t>& child : children) {
+      out->insert(out->end(), child.begin(), child.end());
+    }
+  }
+
+  void EvaluateCorners() {
+    for (uint64_t cell : cells_) {
+      glm::i64vec3 c = Unkey(cell);
+      for (int i = 0; i < 8; ++i) {
+        corners_.push_back(Key(c.x + (i & 1), c.y + ((i >> 1) & 1), c.z + (i >> 2)));
+      }
+    }
+    std::sort(corners_.begin(), corners_.end());
+    corners_.erase(std::unique(corners_.begin(), corners_.end()), corners_.end());
+    values_.resize(corners_.size());
+    ParallelChunks(pool_, corners_.size(), kChunkSize, [&](size_t begin, size_t end) {
+      std::vector<glm::dvec3> points;
+      for (size_t i = begin; i < end; ++i) {
+        points.push_back(Position(Unkey(corners_[i])));
+      }
+      program_.Evaluate(points.data(), points.size(), values_.data() + begin);
+    });
+  }
+
+  double Value(uint64_t corner) const {
+    return values_[Find(corners_, corner)];
+  }
+
+  // Every crossed edge of the lattice starts at the first corner of one of the cells.
+  void FindCrossings() {
+    for (uint64_t cell : cells_) {
+      glm::i64vec3 c = Unkey(cell);
+      double start = Value(cell);
+      for (int axis = 0; axis < 3; ++axis) {
+        glm::i64vec3 e = c;
+        e[axis] += 1;
+        double end = Value(Key(e.x, e.y, e.z));
+        if ((start < 0) != (end < 0)) {
+          Crossing crossing;
+          crossing.corner = cell;
+          crossing.axis = axis;
+          crossing.outwards = start < 0;
+          double t = start / (start - end);
+          crossing.point = glm::mix(Position(c), Position(e), t);
+          crossings_.push_back(crossing);
+        }
+      }
+    }
+    // Normals from central differences of the field.
+    double step = cell_size_ * 1e-3;
+    ParallelChunks(pool_, crossings_.size(), kChunkSize, [&](size_t begin, size_t end) {
+      std::vector<glm::dvec3> points;
+      for (size_t i = begin; i < end; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+          glm::dvec3 offset(0);
+          offset[axis] = step;
+          points.push_back(crossings_[i].point + offset);
+          points.push_back(crossings_[i].point - offset);
+        }
+      }
+      std::vector<double> values(points.size());
+      program_.Evaluate(points.data(), points.size(), values.data());
+      for (size_t i = begin; i < end; ++i) {
+        const double* v = values.data() + (i - begin) * 6;
+        glm::dvec3 gradient(v[0] - v[1], v[2] - v[3], v[4] - v[5]);
+        Crossing& crossing = crossings_[i];
+        if (glm::length(gradient) > 0) {
+          crossing.normal = glm::normalize(gradient);
+        } else {
+          crossing.normal[crossing.axis] = crossing.outwards ? 1 : -1;
+        }
+      }
+    });
+    crossing_keys_.reserve(crossings_.size());
+    for (const Crossing& crossing : crossings_) {
+      crossing_keys_.push_back(crossing.corner << 2 | crossing.axis);
+    }
+  }
+
+  // The point minimizing the squared distances to the planes of the crossings, found relative to
+  // their mean with the small eigenvalues dropped so flat and creased cells stay near the mean.
+  // Points outside of the cell fall back to the mean.
+  glm::dvec3 SolveVertex(const glm::i64vec3& cell, const std::vector<const Crossing*>& planes) {
+    glm::dvec3 mean(0);
+    for (const Crossing* plane : planes) {
+      mean += plane->point;
+    }
+    mean /= static_cast<double>(planes.size());
+    glm::dmat3 ata(0.0);
+    glm::dvec3 atb(0);
+    for (const Crossing* plane : planes) {
+      const glm::dvec3& n = plane->normal;
+      ata += glm::outerProduct(n, n);
+      atb += n * glm::dot(n, plane->point - mean);
+    }
+    glm::dvec3 values;
+    glm::dmat3 vectors;
+    SymmetricEigen(ata, &values, &vectors);
+    double largest = std::max({values.x, values.y, values.z});
+    glm::dvec3 x(0);
+    for (int i = 0; i < 3; ++i) {
+      if (values[i] > largest * 0.1) {
+        x += vectors[i] * (glm::dot(vectors[i], atb) / values[i]);
+      }
+    }
+    glm::dvec3 vertex = mean + x;
+    glm::dvec3 min = Position(cell);
+    glm::dvec3 max = Position(cell + int64_t(1));
+    double margin = cell_size_ * 0.25;
+    for (int axis = 0; axis < 3; ++axis) {
+      if (vertex[axis] < min[axis] - margin || vertex[axis] > max[axis] + margin) {
+        return mean;
+      }
+    }
+    return vertex;
+  }
+
+  void PlaceVertices() {
+    vertices_.resize(cells_.size());
+    has_vertex_.resize(cells_.size());
+    ParallelChunks(pool_, cells_.size(), kChunkSize, [&](size_t begin, size_t end) {
+      std::vector<const Crossing*> planes;
+      for (size_t i = begin; i < end; ++i) {
+        glm::i64vec3 c = Unkey(cells_[i]);
+        planes.clear();
+        // The 12 edges of the cell, 4 along each axis.
+        for (int axis = 0; axis < 3; ++axis) {
+          int u = (axis + 1) % 3;
+          int v = (axis + 2) % 3;
+          for (int j = 0; j < 4; ++j) {
+            glm::i64vec3 corner = c;
+            corner[u] += j & 1;
+            corner[v] += j >> 1;
+            int64_t index = Find(crossing_keys_, Key(corner.x, corner.y, corner.z) << 2 | axis);
+            if (index >= 0) {
+              planes.push_back(&crossings_[index]);
+            }
+          }
+        }
+        has_vertex_[i] = !planes.empty();
+        if (!planes.empty()) {
+          vertices_[i] = SolveVertex(c, planes);
+        }
+      }
+    });
+  }
+
+  // A quad around each crossed edge between the vertices of the four cells sharing it.
+  Mesh MakeMesh() {
+    Mesh mesh;
+    std::vector<int64_t> index(cells_.size(), -1);
+    for (size_t i = 0; i < cells_.size(); ++i) {
+      if (has_vertex_[i]) {
+        index[i] = static_cast<int64_t>(mesh.vertices.size());
+        mesh.vertices.push_back(vertices_[i]);
+      }
+    }
+    for (const Crossing& crossing : crossings_) {
+      glm::i64vec3 c = Unkey(crossing.corner);
+      int u = (crossing.axis + 1) % 3;
+      int v = (crossing.axis + 2) % 3;
+      // Counterclockwise around the axis.
+      std::array<int64_t, 4> quad;
+      static const int kOffsets[4][2] = {{-1, -1}, {0, -1}, {0, 0}, {-1, 0}};
+      bool complete = true;
+      for (int k = 0; k < 4; ++k) {
+        glm::i64vec3 cell = c;
+        cell[u] += kOffsets[k][0];
+        cell[v] += kOffsets[k][1];
+        int64_t found = cell[u] < 0 || cell[v] < 0 ? -1 : Find(cells_, Key(cell.x, cell.y, cell.z));
+        quad[k] = found >= 0 ? index[found] : -1;
+        complete = complete && quad[k] >= 0;
+      }
+      if (!complete) {
+        continue;
+      }
+      if (!crossing.outwards) {
+        std::reverse(quad.begin(), quad.end());
+      }
+      auto vertex = [&](int k) { return mesh.vertices[quad[k]]; };
+      auto add = [&](int a, int b, int c) {
+        mesh.triangles.push_back({static_cast<uint32_t>(quad[a]),
+                                  static_cast<uint32_t>(quad[b]),
+                                  static_cast<uint32_t>(quad[c])});
+      };
+      if (glm::distance(vertex(0), vertex(2)) <= glm::distance(vertex(1), vertex(3))) {
+        add(0, 1, 2);
+        add(0, 2, 3);
+      } else {
+        add(0, 1, 3);
+        add(1, 2, 3);
+      }
+    }
+    return mesh;
+  }
+
+  const SdfProgram& program_;
+  glm::dvec3 origin_;
+  double cell_size_;
+  ThreadPool* pool_;
+  // Sorted keys of the cells the surface may pass through.
+  std::vector<uint64_t> cells_;
+  // Sorted keys of their corners and the values there.
+  std::vector<uint64_t> corners_;
+  std::vector<double> values_;
+  // Edges where the value changes sign, in the order of their keys.
+  std::vector<Crossing> crossings_;
+  std::vector<uint64_t> crossing_keys_;
+  std::vector<glm::dvec3> vertices_;
+  std::vector<char> has_vertex_;
+};
+
+}  // namespace
+
+Mesh MeshSdf(const SdfProgram& program, const Aabb& bounds, double cell_size, ThreadPool* pool) {
+  if (bounds.empty() || !(cell_size > 0)) {
+    return Mesh();
+  }
+  // Two cells of margin so the surface never touches the sides of the lattice.
+  glm::dvec3 origin = bounds.min - glm::dvec3(2 * cell_size);
+  glm::dvec3 size = bounds.size() + glm::dvec3(4 * cell_size);
+  double cells = std::ceil(std::max({size.x, size.y, size.z}) / cell_size);
+  if (!(cells <= static_cast<double>(kMaxCells))) {
+    fprintf(stderr, "Distance field of %.0f cells per side is too large\n", cells);
+    return Mesh();
+  }
+  int64_t root_size = 1;
+  while (root_size < static_cast<int64_t>(cells)) {
+    root_size *= 2;
+  }
+  DualContouring contouring(program, origin, cell_size, pool);
+  return contouring.Run(root_size);
+}
+
+}  // namespace scad
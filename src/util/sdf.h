@@ -0,0 +1,137 @@
+#pragma once
+
+#include <functional>
+#include <glm/glm.hpp>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "box_tree.h"
+#include "convex.h"
+#include "mesh.h"
+#include "mesh_tree.h"
+#include "scad.h"
+#include "thread_pool.h"
+
+namespace scad {
+
+// Signed distance fields for blends and fillets, which are awkward to build from convex pieces.
+//
+// A shape is compiled into a flat program of primitives and operations in postfix order. Spheres,
+// cubes and cylinders have analytic distances in their own frame and the transforms above them
+// are folded into that frame. Sharp booleans without blends below them, hulls and everything else
+// are evaluated natively and enter as sets of convex pieces, whose field is the largest distance
+// to the planes of a piece. None of the fields overestimate the distance to the surface and none
+// change faster than the distance does, which is all the mesher relies on.
+//
+// Negative values are inside.
+class SdfProgram {
+ public:
+  // Evaluates a subtree natively to convex pieces. Returns false, after reporting why, if it can't.
+  using PieceEvaluator =
+      std::function<bool(const Shape& shape, std::vector<ConvexPolytope>* pieces)>;
+
+  struct Interval {
+    double min = 0;
+    double max = 0;
+  };
+
+  SdfProgram();
+  ~SdfProgram();
+
+  // Returns false, after reporting why, if the shape can't be compiled, e.g. a 2D shape. Distances
+  // to convex pieces are only computed up to band beyond twice the largest blend radius and are
+  // clamped further away, so band should cover the cells the mesher evaluates around the surface.
+  // The surfaces of shells are built on the pool.
+  bool Compile(const Shape& shape,
+               const PieceEvaluator& evaluate_pieces,
+               double band,
+               ThreadPool* pool = nullptr);
+
+  // Compiles the wall of the given thickness inside of the surface of the pieces and meshes, see
+  // Shape::Shell. Its field is the exact distance to the wall up to band beyond the thickness: the
+  // distance to the surface comes from a MeshTree over the union of the pieces and the meshes, and
+  // the side from the pieces or from the parity of ray crossings of the meshes.
+  void CompileShell(const std::vector<ConvexPolytope>& pieces,
+                    const std::vector<Mesh>& meshes,
+                    double thickness,
+                    double band,
+                    ThreadPool* pool);
+
+  // The values at count points. Points are evaluated in batches, every instruction runs over a
+  // whole batch held as separate x, y and z arrays in loops the compiler vectorizes.
+  void Evaluate(const glm::dvec3* points, size_t count, double* values) const;
+
+  // A range containing the value at every point of the box.
+  Interval Evaluate(const Aabb& box) const;
+
+ private:
+  enum class Op {
+    kSphere,
+    kBox,
+    kCylinder,
+    kPieces,
+    kShell,
+    kUnion,
+    kIntersection,
+    kDifference,
+  };
+
+  struct Instruction {
+    Op op = Op::kUnion;
+    // Maps points into the frame of a primitive.
+    glm::dmat4 to_local = glm::dmat4(1.0);
+    // The smallest stretch of the transform into the world, which turns distances in the frame
+    // into lower bounds of world distances.
+    double scale = 1;
+    // Sphere radius in x, half the size of a box, a cylinder's bottom and top radius and height
+    // with the frame centered between the caps, or the thickness of a shell in x.
+    glm::dvec3 size = glm::dvec3(0);
+    // Blend radius of a boolean, zero for sharp ones.
+    double radius = 0;
+    // Index of the piece or shell set.
+    size_t pieces = 0;
+  };
+
+  struct PieceSet;
+  struct ShellSet;
+
+  bool CompileNode(const Shape& shape, const glm::dmat4& transform);
+  bool CompilePieces(const Shape& shape, const glm::dmat4& transform);
+  bool HasBlend(const ShapeNode* node);
+  void AddPrimitive(Op op, const glm::dmat4& transform, const glm::dmat4& frame, glm::dvec3 size);
+  std::unique_ptr<PieceSet> MakePieceSet(std::vector<ConvexPolytope> pieces);
+  void AddShell(std::vector<ConvexPolytope> pieces,
+                const std::vector<Mesh>& meshes,
+                double thickness,
+                ThreadPool* pool);
+
+  void EvaluateBatch(const glm::dvec3* points, size_t count, double* values) const;
+  double EvaluatePieces(const PieceSet& set, const glm::dvec3& p) const;
+  Interval EvaluatePieces(const PieceSet& set, const Aabb& box) const;
+  double EvaluateShell(const ShellSet& set, const glm::dvec3& p) const;
+
+  std::vector<Instruction> program_;
+  std::vector<std::unique_ptr<PieceSet>> piece_sets_;
+  std::vector<std::unique_ptr<ShellSet>> shell_sets_;
+  // The most values on the stack at any point of the program.
+  size_t max_depth_ = 0;
+  double band_ = 0;
+  const PieceEvaluator* evaluate_pieces_ = nullptr;
+  ThreadPool* pool_ = nullptr;
+  std::unordered_map<const ShapeNode*, bool> blend_memo_;
+};
+
+// Meshes the surface of the field inside bounds with cells of the given size.
+//
+// The cells near the surface are found on an octree over the bounds which drops every node whose
+// interval of values doesn't contain zero, so only the cells the surface passes through are ever
+// visited. Each of them gets one vertex by dual contouring: the point which best fits the planes
+// through the crossings on its edges, with the normals taken from the field. That keeps the sharp
+// edges and corners of boxes and hulls which marching cubes would round off. The quads around the
+// crossed edges are split into triangles along their shorter diagonal. The octree, the field
+// values and the vertices are computed in parallel on the pool and the result doesn't depend on
+// the number of threads.
+Mesh MeshSdf(const SdfProgram& program, const Aabb& bounds, double cell_size, ThreadPool* pool);
+
+}  // namespace scad
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace scad {
+
+// Little endian encoding of numbers for cache files. Files are shared between machines so the
+// byte order is fixed rather than taken from the host.
+
+inline void PutU32(uint32_t value, std::string* out) {
+  for (int i = 0; i < 4; ++i) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+inline void PutU64(uint64_t value, std::string* out) {
+  for (int i = 0; i < 8; ++i) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+inline void PutDouble(double value, std::string* out) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  PutU64(bits, out);
+}
+
+// Reads values written by the functions above. Reading past the end sets ok() to false and
+// returns zeros.
+class ByteReader {
+ public:
+  explicit ByteReader(const std::string& data) : data_(data) {
+  }
+
+  uint32_t U32() {
+    return static_cast<uint32_t>(Read(4));
+  }
+
+  uint64_t U64() {
+    return Read(8);
+  }
+
+  double Double() {
+    uint64_t bits = Read(8);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  // Reads length bytes.
+  std::string Bytes(uint64_t length) {
+    if (remaining() < length) {
+      ok_ = false;
+      position_ = data_.size();
+      return "";
+    }
+    std::string bytes = data_.substr(position_, length);
+    position_ += length;
+    return bytes;
+  }
+
+  bool ok() const {
+    return ok_;
+  }
+
+  size_t remaining() const {
+    return data_.size() - position_;
+  }
+
+ private:
+  uint64_t Read(int bytes) {
+    if (remaining() < static_cast<size_t>(bytes)) {
+      ok_ = false;
+      position_ = data_.size();
+      return 0;
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+      value |= static_cast<uint64_t>(static_cast<unsigned char>(data_[position_ + i])) << (8 * i);
+    }
+    position_ += bytes;
+    return value;
+  }
+
+  const std::string& data_;
+  size_t position_ = 0;
+  bool ok_ = true;
+};
+
+}  // namespace scad
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace scad {
+
+// A contiguous sequence with room for N elements inline which grows at either end in amortized
+// constant time. Elements sit in the middle of the buffer with free space on both sides, when one
+// side runs out they are moved back to the middle or into a larger buffer on the heap.
+// Short sequences never allocate, so copying one is a copy of the inline buffer. Only for
+// trivially copyable types, elements are moved with memcpy and the inline buffer is left
+// uninitialized so constructing an empty deque is free.
+template <typename T, size_t N>
+class SmallDeque {
+  static_assert(std::is_trivially_copyable<T>::value, "elements are moved as plain copies");
+  static_assert(N >= 2, "needs room to grow at both ends");
+
+ public:
+  SmallDeque() = default;
+
+  SmallDeque(const SmallDeque& other) {
+    *this = other;
+  }
+
+  SmallDeque& operator=(const SmallDeque& other) {
+    if (this != &other) {
+      clear();
+      append(other.begin(), other.end());
+    }
+    return *this;
+  }
+
+  // Takes over the heap buffer of the other deque, which is left empty.
+  SmallDeque(SmallDeque&& other) {
+    *this = std::move(other);
+  }
+
+  SmallDeque& operator=(SmallDeque&& other) {
+    if (this == &other) {
+      return *this;
+    }
+    if (!other.heap_) {
+      return *this = other;
+    }
+    heap_ = std::move(other.heap_);
+    data_ = heap_.get();
+    capacity_ = other.capacity_;
+    first_ = other.first_;
+    size_ = other.size_;
+    other.data_ = other.inline_data();
+    other.capacity_ = N;
+    other.clear();
+    return *this;
+  }
+
+  const T* begin() const {
+    return data_ + first_;
+  }
+  const T* end() const {
+    return data_ + first_ + size_;
+  }
+  T* begin() {
+    return data_ + first_;
+  }
+  T* end() {
+    return data_ + first_ + size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  T& front() {
+    return data_[first_];
+  }
+  T& back() {
+    return data_[first_ + size_ - 1];
+  }
+  const T& front() const {
+    return data_[first_];
+  }
+  const T& back() const {
+    return data_[first_ + size_ - 1];
+  }
+
+  // Keeps the heap buffer, if any.
+  void clear() {
+    size_ = 0;
+    first_ = capacity_ / 4;
+  }
+
+  void push_back(const T& value) {
+    // The value may live in this deque.
+    T copy = value;
+    Reserve(0, 1);
+    data_[first_ + size_++] = copy;
+  }
+
+  void push_front(const T& value) {
+    T copy = value;
+    Reserve(1, 0);
+    data_[--first_] = copy;
+    ++size_;
+  }
+
+  // Adds a range at the back or the front, keeping its order. The range must not be part of this
+  // deque.
+  void append(const T* from, const T* to) {
+    size_t count = to - from;
+    Reserve(0, count);
+    Copy(from, count, end());
+    size_ += count;
+  }
+
+  void prepend(const T* from, const T* to) {
+    size_t count = to - from;
+    Reserve(count, 0);
+    first_ -= count;
+    size_ += count;
+    Copy(from, count, begin());
+  }
+
+ private:
+  // Makes room for the given number of elements before and after the current ones.
+  void Reserve(size_t before, size_t after) {
+    if (before <= first_ && after <= capacity_ - first_ - size_) {
+      return;
+    }
+    size_t needed = size_ + before + after;
+    size_t capacity = capacity_;
+    // Moving the elements back to the middle only pays off if it frees up a fair share of the
+    // buffer, otherwise pushing to one end keeps moving everything. The inline buffer is small
+    // enough to be used up.
+    bool fits_inline = !heap_ && needed <= N;
+    while (!fits_inline && capacity < needed * 2) {
+      capacity *= 2;
+    }
+    size_t first = before + (capacity - needed) / 2;
+    if (capacity == capacity_) {
+      // Overlapping move within the same buffer.
+      std::memmove(static_cast<void*>(data_ + first), begin(), size_ * sizeof(T));
+    } else {
+      std::unique_ptr<T[]> heap(new T[capacity]);
+      Copy(begin(), size_, heap.get() + first);
+      heap_ = std::move(heap);
+      data_ = heap_.get();
+      capacity_ = capacity;
+    }
+    first_ = first;
+  }
+
+  static void Copy(const T* from, size_t count, T* to) {
+    if (count > 0) {
+      std::memcpy(static_cast<void*>(to), from, count * sizeof(T));
+    }
+  }
+
+  T* inline_data() {
+    return reinterpret_cast<T*>(inline_);
+  }
+
+  alignas(T) unsigned char inline_[N * sizeof(T)];
+  std::unique_ptr<T[]> heap_;
+  T* data_ = inline_data();
+  size_t capacity_ = N;
+  // Starts closer to the front since most sequences grow at the back.
+  size_t first_ = N / 4;
+  size_t size_ = 0;
+};
+
+}  // namespace scad
@@ -0,0 +1,138 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace scad {
+namespace {
+
+thread_local ThreadPool* current_pool = nullptr;
+thread_local int current_worker = -1;
+
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+ThreadPool& ThreadPool::Default() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  int index = current_pool == this ? current_worker
+                                   : static_cast<int>(next_worker_++ % workers_.size());
+  {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+  }
+  {
+    // Taking the lock orders the increment with a worker about to sleep so the wake up isn't lost.
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    ++pending_;
+  }
+  wake_.notify_one();
+}
+
+bool ThreadPool::PopTask(int worker_index, std::function<void()>* task) {
+  if (worker_index >= 0) {
+    Worker& own = *workers_[worker_index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      *task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  int n = static_cast<int>(workers_.size());
+  int start = worker_index >= 0 ? worker_index + 1 : 0;
+  for (int i = 0; i < n; ++i) {
+    int victim_index = (start + i) % n;
+    if (victim_index == worker_index) {
+      continue;
+    }
+    Worker& victim = *workers_[victim_index];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::RunPendingTask() {
+  std::function<void()> task;
+  if (!PopTask(current_pool == this ? current_worker : -1, &task)) {
+    return false;
+  }
+  --pending_;
+  task();
+  return true;
+}
+
+void ThreadPool::WorkerLoop(int worker_index) {
+  current_pool = this;
+  current_worker = worker_index;
+  std::function<void()> task;
+  while (true) {
+    if (PopTask(worker_index, &task)) {
+      --pending_;
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_.wait(lock, [this] { return stop_ || pending_ > 0; });
+    if (stop_ && pending_ == 0) {
+      return;
+    }
+  }
+}
+
+void TaskGroup::Run(std::function<void()> task) {
+  if (!pool_) {
+    task();
+    return;
+  }
+  ++*pending_;
+  std::shared_ptr<std::atomic<int>> pending = pending_;
+  pool_->Submit([task = std::move(task), pending] {
+    task();
+    --*pending;
+  });
+}
+
+void TaskGroup::Wait() {
+  while (*pending_ > 0) {
+    if (!pool_ || !pool_->RunPendingTask()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+}  // namespace scad
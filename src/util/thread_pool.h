@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace scad {
+
+// A work stealing thread pool. Every worker owns a deque. Tasks submitted from a worker go to the
+// back of its own deque and are run last in first out, idle workers steal from the front of the
+// other deques. Tasks submitted from outside of the pool are spread over the workers.
+class ThreadPool {
+ public:
+  // Uses one worker per hardware thread if num_threads is 0.
+  explicit ThreadPool(int num_threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int num_threads() const {
+    return static_cast<int>(workers_.size());
+  }
+
+  void Submit(std::function<void()> task);
+
+  // Runs one pending task on the calling thread if there is one. Threads waiting on other tasks
+  // call this so that nested waits can not deadlock the pool.
+  bool RunPendingTask();
+
+  // A process wide pool for callers which don't manage their own.
+  static ThreadPool& Default();
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  bool PopTask(int worker_index, std::function<void()>* task);
+  void WorkerLoop(int worker_index);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<int> pending_{0};
+  std::atomic<unsigned> next_worker_{0};
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  bool stop_ = false;
+};
+
+// A set of tasks which can be waited on. The waiting thread helps run pending tasks. With a null
+// pool tasks are run inline when they are added.
+class TaskGroup {
+ public:
+  explicit TaskGroup(ThreadPool* pool) : pool_(pool) {
+  }
+  ~TaskGroup() {
+    Wait();
+  }
+
+  void Run(std::function<void()> task);
+  void Wait();
+
+ private:
+  ThreadPool* pool_;
+  std::shared_ptr<std::atomic<int>> pending_ = std::make_shared<std::atomic<int>>(0);
+};
+
+}  // namespace scad
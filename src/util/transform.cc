@@ -2,23 +2,37 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <type_traits>
 #include <vector>
 
 #include "scad.h"
 
-namespace scad {
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCAD_TRANSFORM_SSE2 1
+#endif
 
-glm::vec3 Transform::Apply(const glm::vec3& p) const {
-  glm::mat4 transform(1.0f);
-  transform = glm::translate(transform, translation());
-  transform = glm::rotate(transform, glm::radians((float)ry), glm::vec3(0, 1, 0));
-  transform = glm::rotate(transform, glm::radians((float)rx), glm::vec3(1, 0, 0));
-  transform = glm::rotate(transform, glm::radians((float)rz), glm::vec3(0, 0, 1));
+namespace scad {
 
-  glm::vec4 transformed = transform * glm::vec4(p.x, p.y, p.z, 1);
-  return glm::vec3(transformed.x, transformed.y, transformed.z);
+template <typename T>
+glm::mat<4, 4, T> Transform::Matrix() const {
+  using Vec3 = glm::vec<3, T>;
+  glm::mat<4, 4, T> transform = glm::translate(glm::mat<4, 4, T>(1), Vec3(x, y, z));
+  if (ry != 0) {
+    transform = glm::rotate(transform, glm::radians(static_cast<T>(ry)), Vec3(0, 1, 0));
+  }
+  if (rx != 0) {
+    transform = glm::rotate(transform, glm::radians(static_cast<T>(rx)), Vec3(1, 0, 0));
+  }
+  if (rz != 0) {
+    transform = glm::rotate(transform, glm::radians(static_cast<T>(rz)), Vec3(0, 0, 1));
+  }
+  return transform;
 }
 
+template glm::mat<4, 4, float> Transform::Matrix<float>() const;
+template glm::mat<4, 4, double> Transform::Matrix<double>() const;
+
 Shape TransformList::Apply(const Shape& in) const {
   Shape shape = in;
   for (auto& transform : transforms_) {
@@ -27,12 +41,88 @@ Shape TransformList::Apply(const Shape& in) const {
   return shape;
 }
 
-glm::vec3 TransformList::Apply(const glm::vec3& in) const {
-  glm::vec3 point = in;
-  for (auto& transform : transforms_) {
-    point = transform.Apply(point);
+template <typename T>
+const glm::mat<4, 4, T>& TransformList::Matrix() const {
+  if (!matrix_valid_) {
+    matrix_ = glm::dmat4(1.0);
+    for (const Transform& transform : transforms_) {
+      matrix_ = transform.Matrix() * matrix_;
+    }
+    matrix_valid_ = true;
+  }
+  if constexpr (std::is_same_v<T, double>) {
+    return matrix_;
+  } else {
+    if (!float_matrix_valid_) {
+      float_matrix_ = glm::mat4(matrix_);
+      float_matrix_valid_ = true;
+    }
+    return float_matrix_;
   }
-  return point;
+}
+
+template const glm::mat<4, 4, float>& TransformList::Matrix<float>() const;
+template const glm::mat<4, 4, double>& TransformList::Matrix<double>() const;
+
+void TransformList::ApplyBatch(const glm::vec3* points, size_t count, glm::vec3* out) const {
+  static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "points are read as packed floats");
+  const glm::mat4& m = Matrix<float>();
+  size_t i = 0;
+#ifdef SCAD_TRANSFORM_SSE2
+  // Columns of the matrix in every lane.
+  __m128 c[4][3];
+  for (int col = 0; col < 4; ++col) {
+    for (int row = 0; row < 3; ++row) {
+      c[col][row] = _mm_set1_ps(m[col][row]);
+    }
+  }
+  for (; i + 4 <= count; i += 4) {
+    // Four packed points are x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3, shuffled into one register
+    // per coordinate.
+    const float* in = &points[i].x;
+    __m128 a = _mm_loadu_ps(in);
+    __m128 b = _mm_loadu_ps(in + 4);
+    __m128 d = _mm_loadu_ps(in + 8);
+    __m128 x =
+        _mm_shuffle_ps(a, _mm_shuffle_ps(b, d, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+                              _mm_shuffle_ps(b, d, _MM_SHUFFLE(2, 2, 3, 3)),
+                              _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+                              _mm_shuffle_ps(d, d, _MM_SHUFFLE(3, 3, 0, 0)),
+                              _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 result[3];
+    for (int row = 0; row < 3; ++row) {
+      result[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0][row], x), _mm_mul_ps(c[1][row], y)),
+                               _mm_add_ps(_mm_mul_ps(c[2][row], z), c[3][row]));
+    }
+    const __m128& rx = result[0];
+    const __m128& ry = result[1];
+    const __m128& rz = result[2];
+    float* o = &out[i].x;
+    _mm_storeu_ps(o,
+                  _mm_shuffle_ps(_mm_shuffle_ps(rx, ry, _MM_SHUFFLE(0, 0, 0, 0)),
+                                 _mm_shuffle_ps(rz, rx, _MM_SHUFFLE(1, 1, 0, 0)),
+                                 _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(o + 4,
+                  _mm_shuffle_ps(_mm_shuffle_ps(ry, rz, _MM_SHUFFLE(1, 1, 1, 1)),
+                                 _mm_shuffle_ps(rx, ry, _MM_SHUFFLE(2, 2, 2, 2)),
+                                 _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(o + 8,
+                  _mm_shuffle_ps(_mm_shuffle_ps(rz, rx, _MM_SHUFFLE(3, 3, 2, 2)),
+                                 _mm_shuffle_ps(ry, rz, _MM_SHUFFLE(3, 3, 3, 3)),
+                                 _MM_SHUFFLE(2, 0, 2, 0)));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = Apply(points[i]);
+  }
+}
+
+std::vector<glm::vec3> TransformList::ApplyBatch(const std::vector<glm::vec3>& points) const {
+  std::vector<glm::vec3> out(points.size());
+  ApplyBatch(points.data(), points.size(), out.data());
+  return out;
 }
 
 }  // namespace scad
@@ -4,10 +4,13 @@
 #include <vector>
 
 #include "scad.h"
+#include "small_deque.h"
 
 namespace scad {
 
 const glm::vec3 kOrigin(0, 0, 0);
+// The origin for the double precision path of Apply, see TransformList.
+const glm::dvec3 kDoubleOrigin(0, 0, 0);
 
 // A rotation and translation. The rotations are applied first in z,x,y order and then the
 // translation is added.
@@ -89,24 +92,63 @@ struct Transform {
     return shape;
   }
 
-  glm::vec3 Apply(const glm::vec3& p) const;
+  // Applies the transform in the precision of the point.
+  template <typename T>
+  glm::vec<3, T> Apply(const glm::vec<3, T>& p) const {
+    return glm::vec<3, T>(Matrix<T>() * glm::vec<4, T>(p, 1));
+  }
+
+  // The same transform as a matrix in the precision of T, float and double are instantiated.
+  // Rotations which are zero are skipped.
+  template <typename T = double>
+  glm::mat<4, 4, T> Matrix() const;
 };
 
 // A list of transforms to apply to a shape or a point. The transforms are applied in order. If you
 // are looking at a shape which has been placed by a transform list and you want to rotate it in
 // place, the transform you add needs to be applied first and you must use a "front" method.
+//
+// The list keeps the composite matrix of its transforms so applying it to a point is a single
+// matrix multiply. Adding transforms and appending lists update the matrix in place, appending
+// computes and caches the matrix of the other list too, so lists built from the transforms of
+// keys reuse the matrices of their parents. Methods which hand out a reference to a transform
+// drop the matrix and it is rebuilt on the next use, so change the transform right away and don't
+// hold on to the reference. The matrix is cached on first use, which isn't thread safe.
+//
+// Points are transformed in their own precision. The matrix is always composed in double. Float
+// points go through it rounded to float, with the same arithmetic as ApplyBatch, which is quick
+// for sweeps over many layouts. Double points, e.g. kDoubleOrigin, go through the double matrix
+// so long parent chains stay exact and the final geometry doesn't depend on how the points were
+// batched.
 class TransformList {
  public:
   Shape Apply(const Shape& shape) const;
-  glm::vec3 Apply(const glm::vec3& p) const;
+
+  template <typename T>
+  glm::vec<3, T> Apply(const glm::vec<3, T>& p) const {
+    const glm::mat<4, 4, T>& m = Matrix<T>();
+    return glm::vec<3, T>((m[0] * p.x + m[1] * p.y) + (m[2] * p.z + m[3]));
+  }
+
+  // Applies the list to count float points, which may be transformed in place. Four points at a
+  // time go through SSE where available, the rest and builds without SSE give the same results
+  // one point at a time.
+  void ApplyBatch(const glm::vec3* points, size_t count, glm::vec3* out) const;
+  std::vector<glm::vec3> ApplyBatch(const std::vector<glm::vec3>& points) const;
+
+  // The composite of all transforms in the precision of T, float and double are instantiated.
+  template <typename T = double>
+  const glm::mat<4, 4, T>& Matrix() const;
 
   Transform& AddTransform(Transform t = {}) {
+    Invalidate();
     transforms_.push_back(t);
     return transforms_.back();
   }
 
   Transform& AddTransformFront(Transform t = {}) {
-    transforms_.insert(transforms_.begin(), t);
+    Invalidate();
+    transforms_.push_front(t);
     return transforms_.front();
   }
 
@@ -118,40 +160,32 @@ class TransformList {
     if (empty()) {
       return AddTransform();
     }
+    Invalidate();
     return transforms_.front();
   }
 
   TransformList& RotateX(float deg) {
-    Transform& t = AddTransform();
-    t.rx = deg;
-    return *this;
+    return Append(Transform::Rotation(deg, 0, 0));
   }
 
   TransformList& RotateY(float deg) {
-    Transform& t = AddTransform();
-    t.ry = deg;
-    return *this;
+    return Append(Transform::Rotation(0, deg, 0));
   }
 
   TransformList& RotateZ(float deg) {
-    Transform& t = AddTransform();
-    t.rz = deg;
-    return *this;
+    return Append(Transform::Rotation(0, 0, deg));
   }
 
   TransformList& RotateFront(float rx, float ry, float rz) {
-    AddTransformFront(Transform::Rotation(rx, ry, rz));
-    return *this;
+    return AppendFront(Transform::Rotation(rx, ry, rz));
   }
 
   TransformList& TranslateFront(float x, float y, float z) {
-    AddTransformFront({x, y, z});
-    return *this;
+    return AppendFront(Transform(x, y, z));
   }
 
   TransformList& Translate(float x, float y, float z) {
-    AddTransform({x, y, z});
-    return *this;
+    return Append(Transform(x, y, z));
   }
 
   TransformList& Translate(const glm::vec3& v) {
@@ -170,18 +204,57 @@ class TransformList {
     return Translate(0, 0, z);
   }
 
+  // Adds a transform like AddTransform but keeps the matrix.
+  TransformList& Append(const Transform& t) {
+    if (matrix_valid_) {
+      matrix_ = t.Matrix() * matrix_;
+    }
+    float_matrix_valid_ = false;
+    transforms_.push_back(t);
+    return *this;
+  }
+
+  TransformList& AppendFront(const Transform& t) {
+    if (matrix_valid_) {
+      matrix_ = matrix_ * t.Matrix();
+    }
+    float_matrix_valid_ = false;
+    transforms_.push_front(t);
+    return *this;
+  }
+
   TransformList& Append(const TransformList& other) {
-    transforms_.insert(transforms_.end(), other.transforms_.begin(), other.transforms_.end());
+    if (matrix_valid_) {
+      matrix_ = other.Matrix() * matrix_;
+    }
+    float_matrix_valid_ = false;
+    transforms_.append(other.transforms_.begin(), other.transforms_.end());
     return *this;
   }
 
   TransformList& AppendFront(const TransformList& other) {
-    transforms_.insert(transforms_.begin(), other.transforms_.begin(), other.transforms_.end());
+    if (matrix_valid_) {
+      matrix_ = matrix_ * other.Matrix();
+    }
+    float_matrix_valid_ = false;
+    transforms_.prepend(other.transforms_.begin(), other.transforms_.end());
     return *this;
   }
 
  private:
-  std::vector<Transform> transforms_;
+  void Invalidate() {
+    matrix_valid_ = false;
+    float_matrix_valid_ = false;
+  }
+
+  // Corner lists of the keys in the case are up to about 20 transforms, most are below 16, so
+  // building and copying them rarely allocates. Front insertion is constant time.
+  SmallDeque<Transform, 16> transforms_;
+  mutable glm::dmat4 matrix_ = glm::dmat4(1.0);
+  mutable bool matrix_valid_ = true;
+  // Rounded from matrix_ when float points are applied.
+  mutable glm::mat4 float_matrix_ = glm::mat4(1.0f);
+  mutable bool float_matrix_valid_ = true;
 };
 
 }  // namespace scad